@@ -0,0 +1,197 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "burst.h"
+#include "jtag.h"
+
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+
+//TCK is toggled by DMA writes to the BSRR of its port, so it works on any
+//pin. TIM1 compare 1 sets TCK at the start of each period and compare 2
+//resets it half way through, through DMA1 channels 2 and 3. The repetition
+//counter and one pulse mode stop the timer after the requested periods,
+//only the update interrupt at the end of each run reaches the CPU.
+
+#define BURST_DMA_SET		DMA_CHANNEL2	///< DMA1 channel of the TIM1_CH1 request
+#define BURST_DMA_RESET		DMA_CHANNEL3	///< DMA1 channel of the TIM1_CH2 request
+
+static uint32_t burst_Set;			///< BSRR value that raises TCK
+static uint32_t burst_Reset;			///< BSRR value that lowers TCK
+static uint32_t burst_Port;			///< GPIO port TCK is on
+static volatile uint32_t burst_Remaining;	///< Clocks still to be given after the current run
+static volatile uint32_t burst_Run;		///< Clocks in the current run
+static volatile bool burst_Running;		///< A burst is in progress
+
+static void burst_StartRun();
+
+/**
+ * @brief Initialise the clock burst timer
+ */
+void burst_Init()
+{
+	burst_Running = false;
+
+	rcc_periph_clock_enable(RCC_TIM1);
+	rcc_periph_clock_enable(RCC_DMA1);
+	nvic_enable_irq(NVIC_TIM1_UP_TIM16_IRQ);
+}
+
+/**
+ * @brief Start giving TCK clocks in the background
+ *
+ * The clock rate matches jtag_Clock(), as long as the period is at least
+ * BURST_PERIOD_MIN timer ticks. Only TCK changes, so the TAP stays in
+ * whatever state TMS holds it in. The clocks are added to
+ * jtag_GetClockCount() as each run finishes.
+ *
+ * @param[in] count The number of clocks to give
+ * @retval true The burst has started, or count was 0
+ * @retval false TCK isn't allocated or a burst is already running
+ */
+bool burst_Start(uint32_t count)
+{
+	bool success = false;
+	uint16_t bit;
+	uint32_t ticks;
+
+	if(!burst_Running && jtag_GetSignalPort(JTAG_SIGNAL_TCK, &burst_Port, &bit))
+	{
+		success = true;
+		if(count > 0)
+		{
+			burst_Set = bit;
+			burst_Reset = (uint32_t)bit << 16;
+			GPIO_BSRR(burst_Port) = burst_Reset;
+
+			//each delay loop of jtag_Clock() is 4 cycles, twice per clock
+			ticks = jtag_GetClockDelay() * 8;
+			if(ticks < BURST_PERIOD_MIN)
+			{
+				ticks = BURST_PERIOD_MIN;
+			}
+			else if(ticks > 0x10000)
+			{
+				ticks = 0x10000;
+			}
+
+			timer_reset(TIM1);
+			timer_set_mode(TIM1, TIM_CR1_CKD_CK_INT, TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+			timer_one_shot_mode(TIM1);
+			timer_update_on_overflow(TIM1);	//so TIM_EGR_UG doesn't interrupt
+			timer_set_prescaler(TIM1, 0);
+			timer_set_period(TIM1, ticks - 1);
+			timer_set_oc_value(TIM1, TIM_OC1, 1);
+			timer_set_oc_value(TIM1, TIM_OC2, (ticks / 2) + 1);
+			timer_enable_irq(TIM1, TIM_DIER_UIE | TIM_DIER_CC1DE | TIM_DIER_CC2DE);
+
+			dma_channel_reset(DMA1, BURST_DMA_SET);
+			dma_set_peripheral_address(DMA1, BURST_DMA_SET, (uint32_t)&GPIO_BSRR(burst_Port));
+			dma_set_memory_address(DMA1, BURST_DMA_SET, (uint32_t)&burst_Set);
+			dma_set_number_of_data(DMA1, BURST_DMA_SET, 1);
+			dma_set_read_from_memory(DMA1, BURST_DMA_SET);
+			dma_set_memory_size(DMA1, BURST_DMA_SET, DMA_CCR_MSIZE_32BIT);
+			dma_set_peripheral_size(DMA1, BURST_DMA_SET, DMA_CCR_PSIZE_32BIT);
+			dma_enable_circular_mode(DMA1, BURST_DMA_SET);
+			dma_set_priority(DMA1, BURST_DMA_SET, DMA_CCR_PL_VERY_HIGH);
+			dma_enable_channel(DMA1, BURST_DMA_SET);
+
+			dma_channel_reset(DMA1, BURST_DMA_RESET);
+			dma_set_peripheral_address(DMA1, BURST_DMA_RESET, (uint32_t)&GPIO_BSRR(burst_Port));
+			dma_set_memory_address(DMA1, BURST_DMA_RESET, (uint32_t)&burst_Reset);
+			dma_set_number_of_data(DMA1, BURST_DMA_RESET, 1);
+			dma_set_read_from_memory(DMA1, BURST_DMA_RESET);
+			dma_set_memory_size(DMA1, BURST_DMA_RESET, DMA_CCR_MSIZE_32BIT);
+			dma_set_peripheral_size(DMA1, BURST_DMA_RESET, DMA_CCR_PSIZE_32BIT);
+			dma_enable_circular_mode(DMA1, BURST_DMA_RESET);
+			dma_set_priority(DMA1, BURST_DMA_RESET, DMA_CCR_PL_VERY_HIGH);
+			dma_enable_channel(DMA1, BURST_DMA_RESET);
+
+			burst_Remaining = count;
+			burst_Running = true;
+			burst_StartRun();
+		}
+	}
+	return success;
+}
+
+/**
+ * @brief Start the next run of up to BURST_RUN_MAX clocks
+ */
+static void burst_StartRun()
+{
+	burst_Run = (burst_Remaining > BURST_RUN_MAX) ? BURST_RUN_MAX : burst_Remaining;
+	burst_Remaining -= burst_Run;
+
+	timer_set_repetition_counter(TIM1, burst_Run - 1);
+	timer_generate_event(TIM1, TIM_EGR_UG);	//load the repetition counter
+	timer_clear_flag(TIM1, TIM_SR_UIF);
+	timer_enable_counter(TIM1);
+}
+
+/**
+ * @brief Check if a burst is still being clocked out
+ */
+bool burst_IsRunning()
+{
+	return burst_Running;
+}
+
+/**
+ * @brief Stop a burst
+ *
+ * Clocks of the current run are counted as given. TCK is left low.
+ */
+void burst_Stop()
+{
+	if(burst_Running)
+	{
+		timer_disable_counter(TIM1);
+		timer_disable_irq(TIM1, TIM_DIER_UIE | TIM_DIER_CC1DE | TIM_DIER_CC2DE);
+		dma_disable_channel(DMA1, BURST_DMA_SET);
+		dma_disable_channel(DMA1, BURST_DMA_RESET);
+		GPIO_BSRR(burst_Port) = burst_Reset;
+		jtag_AddClocks(burst_Run);
+		burst_Remaining = 0;
+		burst_Running = false;
+	}
+}
+
+/**
+ * @brief End of a timer run
+ *
+ * Counts the clocks and starts the next run, or finishes the burst.
+ */
+void tim1_up_tim16_isr()
+{
+	if(timer_get_flag(TIM1, TIM_SR_UIF))
+	{
+		timer_clear_flag(TIM1, TIM_SR_UIF);
+		if(burst_Remaining > 0)
+		{
+			jtag_AddClocks(burst_Run);
+			burst_StartRun();
+		}
+		else
+		{
+			burst_Stop();
+		}
+	}
+}
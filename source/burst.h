@@ -0,0 +1,32 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_BURST_H_)
+#define _BURST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BURST_RUN_MAX		(65536)	///< Most clocks per timer run, the size of the TIM1 repetition counter
+#define BURST_PERIOD_MIN	(32)	///< Shortest TCK period in timer ticks, leaves the DMA time for both writes
+
+extern void burst_Init();
+extern bool burst_Start(uint32_t count);
+extern bool burst_IsRunning();
+extern void burst_Stop();
+
+#endif
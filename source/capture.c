@@ -0,0 +1,237 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "capture.h"
+#include "jtag.h"
+#include <stddef.h>
+
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/exti.h>
+#include <libopencm3/cm3/nvic.h>
+
+/**
+ * @brief The interrupts of the EXTI lines of the pins
+ */
+static const uint8_t capture_IRQs[] = {
+	NVIC_EXTI0_IRQ,
+	NVIC_EXTI1_IRQ,
+	NVIC_EXTI2_TSC_IRQ,
+	NVIC_EXTI3_IRQ,
+	NVIC_EXTI4_IRQ,
+	NVIC_EXTI9_5_IRQ,
+	NVIC_EXTI15_10_IRQ,
+};
+
+#define CAPTURE_IRQS	(sizeof(capture_IRQs) / sizeof(capture_IRQs[0]))	///< Number of entries in capture_IRQs
+
+static scanlog_Log * volatile capture_Log;	///< Log the edges go into, NULL when not capturing
+static volatile uint16_t capture_Pins;	///< Bitmask of the pins being captured
+static uint16_t capture_Last;		///< Captured pin states after the last edge
+static uint32_t capture_Clock;		///< jtag clock count when the capture started
+static volatile bool capture_Full;	///< An edge couldn't be logged
+
+static void capture_Enable(bool enable);
+
+/**
+ * @brief Enable or mask the edge interrupts
+ *
+ * Edges while masked stay pending and are logged once enabled again.
+ */
+static void capture_Enable(bool enable)
+{
+	unsigned int index;
+
+	for(index = 0; index < CAPTURE_IRQS; ++index)
+	{
+		if(enable)
+		{
+			nvic_enable_irq(capture_IRQs[index]);
+		}
+		else
+		{
+			nvic_disable_irq(capture_IRQs[index]);
+		}
+	}
+}
+
+/**
+ * @brief Initialize the edge capture
+ *
+ * Routes all 16 EXTI lines to port D and enables their interrupts, the lines
+ * themselves stay masked until capture_Start().
+ */
+void capture_Init()
+{
+	unsigned int line;
+
+	capture_Log = NULL;
+	capture_Pins = 0;
+
+	rcc_periph_clock_enable(RCC_SYSCFG);
+	for(line = 0; line < CAPTURE_PIN_MAX; ++line)
+	{
+		exti_select_source(1 << line, GPIOD);
+	}
+	capture_Enable(true);
+}
+
+/**
+ * @brief Start logging the edges on some pins
+ *
+ * The current pin states are recorded as the first sample. From then on
+ * each edge is logged against the number of clocks given by jtag_Clock(), an
+ * edge during clock n shows up in sample n + 1, the same as if every clock
+ * had been sampled.
+ *
+ * Only pins below #CAPTURE_PIN_MAX can be captured, the others keep their
+ * starting state in the log.
+ *
+ * @param[in,out] log The log to fill, has to be empty.
+ * @param[in] pins Bitmask of the pins to capture, should be inputs.
+ */
+void capture_Start(scanlog_Log *log, scanlog_Mask pins)
+{
+	capture_Stop();
+
+	scanlog_Record(log, jtag_ReadPins());
+	capture_Last = (uint16_t)scanlog_GetLast(log);
+	capture_Clock = jtag_GetClockCount();
+	capture_Pins = (uint16_t)pins;
+	capture_Full = false;
+	capture_Log = log;
+
+	exti_set_trigger(pins, EXTI_TRIGGER_BOTH);
+	exti_reset_request(pins);
+	exti_enable_request(pins);
+}
+
+/**
+ * @brief Bring the log up to the current clock
+ *
+ * Should be called after each clock, so the number of samples covers the
+ * clocks where nothing changed. The edge interrupts are masked while the
+ * log is updated and read, so they can't change it halfway through.
+ *
+ * @returns The number of samples since the pins last changed, see
+ * scanlog_GetUnchanged().
+ */
+unsigned int capture_Update()
+{
+	unsigned int unchanged = 0;
+
+	if(capture_Log != NULL)
+	{
+		capture_Enable(false);
+		scanlog_SetSamples(capture_Log, (jtag_GetClockCount() - capture_Clock) + 1);
+		unchanged = scanlog_GetUnchanged(capture_Log);
+		capture_Enable(true);
+	}
+	return unchanged;
+}
+
+/**
+ * @brief Check if edges have been lost because the log is full
+ */
+bool capture_IsFull()
+{
+	return capture_Full;
+}
+
+/**
+ * @brief Stop logging edges
+ */
+void capture_Stop()
+{
+	exti_disable_request(capture_Pins);
+	exti_reset_request(capture_Pins);
+	capture_Update();
+	capture_Log = NULL;
+	capture_Pins = 0;
+}
+
+/**
+ * @brief Log an edge on one or more pins
+ *
+ * The pins are read back rather than trusting the trigger, so edges that
+ * happened close together only log the net change.
+ *
+ * @param[in] lines The EXTI lines handled by the interrupt
+ */
+static void capture_Edge(uint32_t lines)
+{
+	uint16_t data, changed;
+
+	//clear first, an edge after reading the pins has to interrupt again
+	exti_reset_request(lines);
+	data = GPIOD_IDR;
+
+	if(capture_Log != NULL)
+	{
+		changed = (data ^ capture_Last) & capture_Pins;
+		if(changed != 0)
+		{
+			unsigned int sample = (jtag_GetClockCount() - capture_Clock) + 1;
+
+			if(scanlog_AddEvent(capture_Log, sample, changed))
+			{
+				scanlog_SetSamples(capture_Log, sample + 1);
+				capture_Last ^= changed;
+			}
+			else
+			{
+				capture_Full = true;
+			}
+		}
+	}
+}
+
+//EXTI interrupt handlers, each just logs the edge
+void exti0_isr()
+{
+	capture_Edge(EXTI0);
+}
+
+void exti1_isr()
+{
+	capture_Edge(EXTI1);
+}
+
+void exti2_tsc_isr()
+{
+	capture_Edge(EXTI2);
+}
+
+void exti3_isr()
+{
+	capture_Edge(EXTI3);
+}
+
+void exti4_isr()
+{
+	capture_Edge(EXTI4);
+}
+
+void exti9_5_isr()
+{
+	capture_Edge(EXTI5 | EXTI6 | EXTI7 | EXTI8 | EXTI9);
+}
+
+void exti15_10_isr()
+{
+	capture_Edge(EXTI10 | EXTI11 | EXTI12 | EXTI13 | EXTI14 | EXTI15);
+}
@@ -0,0 +1,33 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_CAPTURE_H_)
+#define _CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "scanlog.h"
+
+#define CAPTURE_PIN_MAX	(16)	///< Only pins 0 - 15 (port D) can be captured, one per EXTI line
+
+extern void capture_Init();
+extern void capture_Start(scanlog_Log *log, scanlog_Mask pins);
+extern unsigned int capture_Update();
+extern bool capture_IsFull();
+extern void capture_Stop();
+
+#endif
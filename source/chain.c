@@ -27,11 +27,13 @@
 // Module local variables
 static unsigned int chain_IRLength;
 static unsigned int chain_Devices;
+static uint32_t chain_IDCodes[CHAIN_MAX_DEVICES];	///< ID Codes found by chain_Detect(), 0 for BYPASS
 
 // Module local functions
 static bool chain_findDevices();
 static bool chain_findIRLength();
 static uint32_t chain_findIDCode();
+static bool chain_checkPattern();
 
 /**
  * @brief Initializes the chain module
@@ -145,21 +147,13 @@ static bool chain_findDevices()
  */
 uint32_t chain_findIDCode()
 {
-	unsigned int count;
 	uint32_t idcode;
 
 	if(jtag_Get(JTAG_SIGNAL_TDO))
 	{
-		//start of an ID Code
-		idcode = 0x00000000;
-
-		//shift in all 32 bits of the code
-		for(count = 0; count < 32; ++count)
-		{
-			idcode >>= 1;
-			idcode |= (jtag_Get(JTAG_SIGNAL_TDO) ? 0x80000000 : 0);
-			jtag_Clock();
-		}
+		//start of an ID Code, shift in all 32 bits of the code. TDI
+		//stays high, as left by chain_findDevices()
+		idcode = jtag_Shift(0xFFFFFFFF, 32);
 	}
 	else
 	{
@@ -179,6 +173,8 @@ bool chain_Detect()
 {
 	bool success = false;
 
+	chain_Devices = 0;
+
 	//get some of the chain information
 	if(chain_findIRLength() && chain_findDevices())
 	{
@@ -191,10 +187,12 @@ bool chain_Detect()
 		jtag_Set(JTAG_SIGNAL_TDI, true);
 
 		message_Write(MESSAGE_LEVEL_GENERAL, "[+] %i Device(s) found, with total IR Length of %i\r\n", chain_Devices, chain_IRLength);
+		success = (chain_Devices > 0);
 
 		for(device = 0; device < chain_Devices; ++device)
 		{
 			uint32_t idcode = chain_findIDCode();
+			chain_IDCodes[device] = idcode;
 			if(idcode != 0)
 			{
 				message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Device %i - ID Code %08X\r\n", device +1, idcode);
@@ -207,3 +205,130 @@ bool chain_Detect()
 	}
 	return success;
 }
+
+/**
+ * @brief Shift a test pattern through the chain in BYPASS
+ *
+ * Every device is put into BYPASS and a PRBS7 pattern is shifted through
+ * the data registers. Each device delays the pattern by one bit.
+ *
+ * @retval true Every bit came out of TDO as it went into TDI
+ */
+static bool chain_checkPattern()
+{
+	uint32_t sent[CHAIN_PATTERN_WORDS];
+	uint32_t received[CHAIN_PATTERN_WORDS];
+	uint8_t lfsr = 0x7F;
+	unsigned int word, bit, count;
+	bool match = true;
+
+	//load BYPASS into every device
+	jtagTAP_SetState(JTAGTAP_STATE_IR_SHIFT);
+	jtag_Set(JTAG_SIGNAL_TDI, true);
+	for(count = 0; count < chain_IRLength; ++count)
+	{
+		jtag_Clock();
+	}
+	jtagTAP_SetState(JTAGTAP_STATE_DR_SHIFT);
+
+	for(word = 0; word < CHAIN_PATTERN_WORDS; ++word)
+	{
+		sent[word] = 0;
+		for(bit = 0; bit < 32; ++bit)
+		{
+			//x^7 + x^6 + 1
+			uint8_t next = ((lfsr >> 6) ^ (lfsr >> 5)) & 0x01;
+			lfsr = ((lfsr << 1) | next) & 0x7F;
+			sent[word] |= (uint32_t)next << bit;
+		}
+		received[word] = jtag_Shift(sent[word], 32);
+	}
+
+	//the first bits out are the captured BYPASS registers
+	for(count = chain_Devices; match && (count < (CHAIN_PATTERN_WORDS * 32)); ++count)
+	{
+		unsigned int in = count - chain_Devices;
+
+		match = (((received[count / 32] >> (count % 32)) ^ (sent[in / 32] >> (in % 32))) & 0x01) == 0;
+	}
+	return match;
+}
+
+/**
+ * @brief Calibrate when TDO is sampled
+ *
+ * Sweeps the sample phase over the low half of the TCK period in
+ * CHAIN_PHASE_STEPS steps, checking a test pattern at each one. The centre
+ * of the longest run of steps that pass is used, and remembered by the jtag
+ * module for the current signals and clock rate.
+ *
+ * @pre chain_Detect() has found the devices on the chain
+ * @retval true A working phase was found and set
+ * @retval false The chain hasn't been detected or no phase works, the
+ * phase is left as it was.
+ */
+bool chain_Calibrate()
+{
+	bool success = false;
+	unsigned int delay = jtag_GetClockDelay();
+	unsigned int original = jtag_GetSamplePhase();
+	unsigned int step, start = 0, best_start = 0, best_length = 0;
+
+	if(chain_Devices > 0)
+	{
+		for(step = 0; step < CHAIN_PHASE_STEPS; ++step)
+		{
+			jtag_SetSamplePhase((delay * step) / (CHAIN_PHASE_STEPS - 1));
+			if(chain_checkPattern())
+			{
+				if((step - start + 1) > best_length)
+				{
+					best_start = start;
+					best_length = step - start + 1;
+				}
+			}
+			else
+			{
+				start = step + 1;
+			}
+		}
+
+		if(best_length > 0)
+		{
+			step = best_start + ((best_length - 1) / 2);
+			jtag_SetSamplePhase((delay * step) / (CHAIN_PHASE_STEPS - 1));
+			message_Write(MESSAGE_LEVEL_GENERAL, "[+] Sample phase window %i - %i of %i, using %i\r\n", best_start, best_start + best_length - 1, CHAIN_PHASE_STEPS - 1, step);
+			success = true;
+		}
+		else
+		{
+			jtag_SetSamplePhase(original);
+		}
+		jtagTAP_SetState(JTAGTAP_STATE_RESET);
+	}
+	return success;
+}
+
+/**
+ * @brief Get the number of devices found by the last chain_Detect()
+ */
+unsigned int chain_GetDevices()
+{
+	return chain_Devices;
+}
+
+/**
+ * @brief Get the ID Code of a device found by the last chain_Detect()
+ *
+ * @param[in] device The device number, 0 is the device closest to TDO.
+ * @return The ID Code, or 0 if the device is in BYPASS or doesn't exist.
+ */
+uint32_t chain_GetIDCode(unsigned int device)
+{
+	uint32_t idcode = 0;
+	if(device < chain_Devices)
+	{
+		idcode = chain_IDCodes[device];
+	}
+	return idcode;
+}
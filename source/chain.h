@@ -19,11 +19,17 @@
 #define _CHAIN_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define CHAIN_MAX_DEVICES		(20)	///< Maximum number of devices in a chain supported
 #define CHAIN_MAX_IRLEN			(CHAIN_MAX_DEVICES * 32)	///< Maximum chain IR length supported for autodetection
+#define CHAIN_PHASE_STEPS		(16)	///< Number of sample phases tried by chain_Calibrate()
+#define CHAIN_PATTERN_WORDS		(4)	///< Length of the chain_Calibrate() test pattern, in 32 bit words
 
 extern void chain_Init();
 extern bool chain_Detect();
+extern bool chain_Calibrate();
+extern unsigned int chain_GetDevices();
+extern uint32_t chain_GetIDCode(unsigned int device);
 
 #endif
@@ -21,22 +21,131 @@
 #include "knock.h"
 #include "jtag.h"
 #include "jtagtap.h"
+#include "results.h"
+#include "burst.h"
+#include "serial.h"
+#include <stdint.h>
 #include <string.h>
-#include <errno.h>
+#include <strings.h>
+
+#define COMEXEC_HEX_INVALID	0xFF	///< Not a hex digit in comexec_HexNibbles
+#define COMEXEC_SHIFT_NIBBLES	8	///< Nibbles handed to jtag_Shift() at once
+
+/**
+ * @brief Parses a command's arguments and executes it
+ *
+ * @param[in] Param The command table entry's parameter.
+ * @param[in] Argc The number of tokens, including the command name.
+ * @param[in] Argv The tokens, Argv[0] is the command name.
+ */
+typedef void (*comexec_Handler)(int Param, unsigned int Argc, const comexec_Token *Argv);
+
+/**
+ * @brief A command table entry
+ */
+typedef struct comexec_sCommand
+{
+	const char *Name;		///< Command name, the table is sorted on it
+	comexec_Handler Handler;	///< Parses the arguments and executes the command
+	int Param;			///< Passed to the handler, so commands can share one
+	unsigned char MinArgs;		///< Fewest arguments accepted, after the name
+	unsigned char MaxArgs;		///< Most arguments accepted, after the name
+	const char *Usage;		///< The arguments, for help
+	const char *Help;		///< What the command does, for help
+}comexec_Command;
+
+/**
+ * @brief TAP states that can be named in the tap command
+ */
+static const struct
+{
+	const char *Name;
+	jtagTAP_TAPState State;
+}comexec_TAPStates[] = {
+	{"reset", JTAGTAP_STATE_RESET},
+	{"run_idle", JTAGTAP_STATE_IDLE},
+	{"shift_dr", JTAGTAP_STATE_DR_SHIFT},
+	{"pause_dr", JTAGTAP_STATE_DR_PAUSE},
+	{"shift_ir", JTAGTAP_STATE_IR_SHIFT},
+	{"pause_ir", JTAGTAP_STATE_IR_PAUSE},
+};
 
 static void comexec_SendReply(bool Success);
+static bool comexec_CheckIdle();
+
+static bool comexec_ClockPending;	///< A clock command is waiting for its burst to finish
+static bool comexec_Failed;		///< The last reply sent was ERROR
+static bool comexec_Shifting;		///< Input is hex for the shift command
+static bool comexec_ShiftLF;		///< Shift data ended with CR, drop the LF after it
+
+/**
+ * @brief Value of each hex digit, COMEXEC_HEX_INVALID for anything else
+ */
+static const uint8_t comexec_HexNibbles[256] = {
+	[0 ... 255] = COMEXEC_HEX_INVALID,
+	['0'] = 0x0, ['1'] = 0x1, ['2'] = 0x2, ['3'] = 0x3, ['4'] = 0x4,
+	['5'] = 0x5, ['6'] = 0x6, ['7'] = 0x7, ['8'] = 0x8, ['9'] = 0x9,
+	['a'] = 0xA, ['b'] = 0xB, ['c'] = 0xC, ['d'] = 0xD, ['e'] = 0xE, ['f'] = 0xF,
+	['A'] = 0xA, ['B'] = 0xB, ['C'] = 0xC, ['D'] = 0xD, ['E'] = 0xE, ['F'] = 0xF,
+};
+static const char comexec_HexDigits[16] = "0123456789ABCDEF";	///< Hex digit for each nibble
 
 //Command handlers
 static void comexec_MessageLevel(message_Levels Level);
+static void comexec_MessageFormat(message_Formats Format);
 static void comexec_Chain();
-static void comexec_ScanForJTAG(unsigned int Pins, knock_Mode Mode);
+static void comexec_Calibrate();
+static void comexec_ScanForJTAG(unsigned int Pins, knock_Mode Mode, unsigned int Options);
+static void comexec_ScanControl(const comexec_Token *Action);
+static void comexec_Results(unsigned int Modes, bool ConfirmedOnly, bool Csv);
 static void comexec_SignalConfig(jtag_Signal Signal, int Pin);
 static void comexec_Config();
+static void comexec_ClockConfig(unsigned int Rate, unsigned int Samples);
 static void comexec_TAP(jtagTAP_TAPState State);
 static void comexec_Clock(unsigned int Counts);
+static void comexec_ShiftStart();
+static void comexec_ShiftNibbles(uint32_t Tdi, unsigned int Nibbles);
 static void comexec_SetSignal(jtag_Signal Signal, bool State);
 static void comexec_GetSignal(jtag_Signal Signal);
 static void comexec_Help();
+static int comexec_Compare(const comexec_Token *Token, const char *Keyword);
+static bool comexec_Match(const comexec_Token *Token, const char *Keyword);
+
+//Command parsers
+static void comexec_ParseChain(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseClock(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseConfig(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseHelp(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseMessage(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseResults(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseScan(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseShift(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseSignal(int Param, unsigned int Argc, const comexec_Token *Argv);
+static void comexec_ParseTAP(int Param, unsigned int Argc, const comexec_Token *Argv);
+
+/**
+ * @brief The commands, sorted by name for comexec_Find()
+ */
+static const comexec_Command comexec_Commands[] = {
+	{"chain", comexec_ParseChain, 0, 0, 1, "[calibrate]", "Detect the devices on the chain, or calibrate the TDO sample point"},
+	{"clock", comexec_ParseClock, 0, 1, 1, "n", "Give n TCK clocks"},
+	{"config", comexec_ParseConfig, 0, 0, 5, "[signal [pin]] | [clock [rate] [sample n]]", "Display or set the signal pins or the clock"},
+	{"help", comexec_ParseHelp, 0, 0, 0, "", "Display this list"},
+	{"message", comexec_ParseMessage, 0, 0, 2, "[level] | [format [text|binary]]", "Display or set the message level or format"},
+	{"results", comexec_ParseResults, 0, 0, 6, "[reset|bypass|swd] [confirmed] [csv] [clear]", "List the scan hits"},
+	{"rtck", comexec_ParseSignal, JTAG_SIGNAL_RTCK, 0, 0, "", "Display RTCK"},
+	{"scan", comexec_ParseScan, 0, 1, 5, "npins [reset|bypass|swd] [first] [incremental] [capture] | abort|resume|status|incremental", "Scan for a JTAG or SWD port"},
+	{"shift", comexec_ParseShift, 0, 0, 0, "", "Shift hex through the current TAP shift state"},
+	{"srst", comexec_ParseSignal, JTAG_SIGNAL_SRST, 0, 1, "[0|1]", "Display or set SRST"},
+	{"tap", comexec_ParseTAP, 0, 0, 1, "[reset|run_idle|shift_dr|pause_dr|shift_ir|pause_ir]", "Display or move the TAP state"},
+	{"tck", comexec_ParseSignal, JTAG_SIGNAL_TCK, 0, 1, "[0|1]", "Display or set TCK"},
+	{"tdi", comexec_ParseSignal, JTAG_SIGNAL_TDI, 0, 1, "[0|1]", "Display or set TDI"},
+	{"tdo", comexec_ParseSignal, JTAG_SIGNAL_TDO, 0, 0, "", "Display TDO"},
+	{"tms", comexec_ParseSignal, JTAG_SIGNAL_TMS, 0, 1, "[0|1]", "Display or set TMS"},
+	{"trst", comexec_ParseSignal, JTAG_SIGNAL_TRST, 0, 1, "[0|1]", "Display or set TRST"},
+};
+
+#define COMEXEC_COMMANDS	(sizeof(comexec_Commands) / sizeof(comexec_Commands[0]))	///< Number of commands in the table
 
 /**
  * @brief Sets the current message level
@@ -51,7 +160,12 @@ void comexec_MessageLevel(message_Levels Level)
 	bool success = false;
 	if(Level == MESSAGE_LEVEL_MAX)
 	{
-		message_Write(MESSAGE_LEVEL_GENERAL, "Current Level: %i\r\n", message_GetLevel());
+		//required, so the reply isn't compiled out by a low build level
+		message_Write(MESSAGE_LEVEL_REQUIRED, "Current Level: %i\r\n", message_GetLevel());
+		if(MESSAGE_BUILD_LEVEL < MESSAGE_LEVEL_MAX - 1)
+		{
+			message_Write(MESSAGE_LEVEL_REQUIRED, "Levels above %i are not built in.\r\n", MESSAGE_BUILD_LEVEL);
+		}
 		success = true;
 	}
 	else
@@ -69,6 +183,28 @@ void comexec_MessageLevel(message_Levels Level)
 	comexec_SendReply(success);
 }
 
+/**
+ * @brief Sets the message output format
+ *
+ * Binary output sends each message as a record to be decoded on the host by
+ * tools/logdecode. If the provided format is @ref MESSAGE_FORMAT_MAX, the
+ * current format is displayed.
+ *
+ * @param[in] Format Message format to set.
+ */
+void comexec_MessageFormat(message_Formats Format)
+{
+	if(Format == MESSAGE_FORMAT_MAX)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Current Format: %s\r\n", message_FormatNames[message_GetFormat()]);
+	}
+	else
+	{
+		message_SetFormat(Format);
+	}
+	comexec_SendReply(true);
+}
+
 /**
  * @brief Enumerates devices on the JTAG chain
  *
@@ -78,10 +214,34 @@ void comexec_MessageLevel(message_Levels Level)
  */
 void comexec_Chain()
 {
-	bool success = chain_Detect();
-	if(!success)
+	bool success = false;
+	if(comexec_CheckIdle())
 	{
-		message_Write(MESSAGE_LEVEL_VERBOSE, "No devices found on chain. Are the signal assignments correct?\r\n");
+		success = chain_Detect();
+		if(!success)
+		{
+			message_Write(MESSAGE_LEVEL_VERBOSE, "No devices found on chain. Are the signal assignments correct?\r\n");
+		}
+	}
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Calibrate when TDO is sampled on the configured chain
+ *
+ * The chain is detected first, then the sample phase is swept against a
+ * test pattern shifted through the devices in BYPASS.
+ */
+void comexec_Calibrate()
+{
+	bool success = false;
+	if(comexec_CheckIdle())
+	{
+		success = chain_Detect() && chain_Calibrate();
+		if(!success)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "Calibration failed.\r\n");
+		}
 	}
 	comexec_SendReply(success);
 }
@@ -98,26 +258,167 @@ void comexec_Chain()
  * bypass mode scans BYPASS commands into the TAPs and looks for TDO. Takes
  * (npins*(npins-1)*(npins-2) operations.
  *
- * All pins are left deconfigured when the scan finishes.
+ * swd mode tries each pair as SWCLK/SWDIO and reads the DP IDR. Takes
+ * npins*(npins-1) operations.
+ *
+ * All pins are left deconfigured when the scan finishes, unless a chain was
+ * confirmed, then the best one is configured along with any TRST and SRST
+ * pins found for it.
+ *
+ * The scan runs in the background, the reply is sent once it has started.
  *
  * @param[in] Pins The number of pins to use in the scan, must be 4 or more
  * @param[in] Mode The scanning mode to use
+ * @param[in] Options The scanning options, KNOCK_OPTION_xxx
  */
-void comexec_ScanForJTAG(unsigned int Pins, knock_Mode Mode)
+void comexec_ScanForJTAG(unsigned int Pins, knock_Mode Mode, unsigned int Options)
 {
 	bool success = false;
-	if((Pins >=4 ) && (Pins <= JTAG_PIN_MAX))
+	if(!comexec_CheckIdle())
+	{
+		//can't start another one
+	}
+	else if((Pins >=4 ) && (Pins <= JTAG_PIN_MAX))
 	{
-		knock_Scan(Mode, Pins);
+		knock_Start(Mode, Pins, Options);
 		success = true;	//the command itself doesn't fail, even if the scan doesn't find anything.
 	}
 	else
 	{
-		message_Write(MESSAGE_LEVEL_GENERAL, "At least 4 pins are required for a scan. Max 16.\r\n");
+		message_Write(MESSAGE_LEVEL_GENERAL, "At least 4 pins are required for a scan. Max %i.\r\n", JTAG_PIN_MAX);
+	}
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Control a background scan
+ *
+ * abort stops the current scan, resume carries on with an aborted scan from
+ * where it stopped, status displays the progress and incremental repeats the
+ * last scan, only re-testing the pairs that may have changed.
+ *
+ * @param[in] Action One of abort, resume, status or incremental
+ */
+void comexec_ScanControl(const comexec_Token *Action)
+{
+	bool success = false;
+
+	if(comexec_Match(Action, "abort"))
+	{
+		success = knock_Abort();
+		if(!success)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "No scan in progress.\r\n");
+		}
+	}
+	else if(comexec_Match(Action, "resume"))
+	{
+		success = !knock_IsRunning() && knock_Resume();
+		if(!success)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "No scan to resume.\r\n");
+		}
+	}
+	else if(comexec_Match(Action, "incremental"))
+	{
+		if(comexec_CheckIdle())
+		{
+			success = knock_Incremental();
+			if(!success)
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "No previous scan.\r\n");
+			}
+		}
+	}
+	else
+	{
+		knock_Status();
+		success = true;
 	}
 	comexec_SendReply(success);
 }
 
+/**
+ * @brief Display the scan results
+ *
+ * Lists the hits kept by the results module, either as text or one comma
+ * separated line per hit for host automation:
+ *
+ *     result,n,tck,tms,tdi,tdo,modes,score,seen,clocks,devices,idcode...
+ *
+ * Pins are numbered from 1 as for the config command, 0 for a pin the hit
+ * doesn't use, modes is a bitmask of 1 << mode and ID Codes are hex, 0 for a
+ * device in BYPASS. SWD ports have SWCLK as tck, SWDIO as tms and the DP IDR
+ * as their ID Code.
+ *
+ * @param[in] Modes Only show hits found by one of these modes, 1 << mode.
+ * @param[in] ConfirmedOnly Only show hits confirmed by chain detection.
+ * @param[in] Csv Use the machine readable format.
+ */
+void comexec_Results(unsigned int Modes, bool ConfirmedOnly, bool Csv)
+{
+	unsigned int index;
+
+	if(!Csv)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "%i hit(s) stored\r\n", results_Count());
+	}
+
+	for(index = 0; index < results_Count(); ++index)
+	{
+		const results_Hit *hit = results_Get(index);
+		unsigned int id;
+
+		if(((hit->modes & Modes) == 0) || (ConfirmedOnly && (hit->score < RESULTS_SCORE_CONFIRMED)))
+		{
+			//filtered out
+		}
+		else if(Csv)
+		{
+			message_Write(MESSAGE_LEVEL_REQUIRED, "result,%i,%i,%i,%i,%i,%i,%i,%i,%u,%i", index + 1, hit->tck + 1, hit->tms + 1,
+				(hit->tdi == RESULTS_PIN_NONE) ? 0 : hit->tdi + 1, (hit->tdo == RESULTS_PIN_NONE) ? 0 : hit->tdo + 1,
+				hit->modes, hit->score, hit->seen, hit->clocks, hit->devices);
+			for(id = 0; (id < hit->devices) && (id < RESULTS_MAX_IDCODES); ++id)
+			{
+				message_Write(MESSAGE_LEVEL_REQUIRED, ",%08X", hit->idcodes[id]);
+			}
+			message_Write(MESSAGE_LEVEL_REQUIRED, "\r\n");
+		}
+		else if(hit->tdo == RESULTS_PIN_NONE)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "[%i] SWCLK: %i SWDIO: %i Score: %i Clocks: %u Modes: swd\r\n", index + 1, hit->tck + 1, hit->tms + 1, hit->score, hit->clocks);
+			message_Write(MESSAGE_LEVEL_GENERAL, "     DPIDR %08X\r\n", hit->idcodes[0]);
+		}
+		else
+		{
+			knock_Mode mode;
+
+			message_Write(MESSAGE_LEVEL_GENERAL, "[%i] TCK: %i TMS: %i TDO: %i TDI: %i Score: %i Clocks: %u Modes:", index + 1, hit->tck + 1, hit->tms + 1, hit->tdo + 1, hit->tdi + 1, hit->score, hit->clocks);
+			for(mode = KNOCK_MODE_RESET; mode < KNOCK_MODE_MAX; ++mode)
+			{
+				if((hit->modes & (1 << mode)) != 0)
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, " %s", knock_ModeNames[mode]);
+				}
+			}
+			message_Write(MESSAGE_LEVEL_GENERAL, "\r\n");
+
+			for(id = 0; (id < hit->devices) && (id < RESULTS_MAX_IDCODES); ++id)
+			{
+				if(hit->idcodes[id] != 0)
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "     Device %i - ID Code %08X\r\n", id + 1, hit->idcodes[id]);
+				}
+				else
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "     Device %i - BYPASS\r\n", id + 1);
+				}
+			}
+		}
+	}
+	comexec_SendReply(true);
+}
+
 /**
  * @brief Configures a signal
  *
@@ -185,6 +486,31 @@ void comexec_Config()
 	comexec_SendReply(true);
 }
 
+/**
+ * @brief Set and display the JTAG clock configuration
+ *
+ * @param[in] Rate The TCK rate in kHz, 0 to leave it alone.
+ * @param[in] Samples The number of reads TDO is voted over, 0 to leave it
+ * alone.
+ */
+void comexec_ClockConfig(unsigned int Rate, unsigned int Samples)
+{
+	bool success = true;
+
+	if((Rate != 0) && !jtag_SetClockRate(Rate))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "rate needs to be 1 - %i.\r\n", JTAG_CLOCK_KHZ_MAX);
+		success = false;
+	}
+	if((Samples != 0) && !jtag_SetOversample(Samples))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "sample needs to be 1, 3 or 5.\r\n");
+		success = false;
+	}
+	message_Write(MESSAGE_LEVEL_GENERAL, "Clock: %i kHz, TDO sampled %i times\r\n", jtag_GetClockRate(), jtag_GetOversample());
+	comexec_SendReply(success);
+}
+
 /**
  * @brief Set or display the current TAP state
  *
@@ -218,18 +544,182 @@ void comexec_TAP(jtagTAP_TAPState State)
 /**
  * @brief Toggle the clock signal.
  *
- * Assumes that the clock signal has been assigned to a pin.
- * Does nothing otherwise.
+ * The clocks are given by burst_Start() in the background, the reply is
+ * sent by comexec_Task() once they are done. Fails if the clock signal
+ * hasn't been assigned to a pin.
  *
  * @param[in] Counts The number of clock pulses to provide
  */
 void comexec_Clock(unsigned int Counts)
 {
-	while((Counts--) > 0)
+	bool success = comexec_CheckIdle();
+	if(success)
 	{
-		jtag_Clock();
+		success = burst_Start(Counts);
+		if(!success)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "TCK isn't assigned.\r\n");
+		}
+	}
+
+	if(success && burst_IsRunning())
+	{
+		comexec_ClockPending = true;
+	}
+	else
+	{
+		comexec_SendReply(success);
 	}
-	comexec_SendReply(true);
+}
+
+/**
+ * @brief Finish off commands that run in the background
+ *
+ * Called from the main loop, sends the reply to a clock command once its
+ * burst has finished.
+ */
+void comexec_Task()
+{
+	if(comexec_ClockPending && !burst_IsRunning())
+	{
+		comexec_ClockPending = false;
+		comexec_SendReply(true);
+	}
+}
+
+/**
+ * @brief Enter shift mode
+ *
+ * Hex received after this is shifted through the current Shift-IR or
+ * Shift-DR state by comexec_Shift(), until a character that isn't hex.
+ */
+void comexec_ShiftStart()
+{
+	bool success = comexec_CheckIdle();
+	jtagTAP_TAPState state = jtagTAP_GetState();
+
+	if(success && (!jtag_IsAllocated(JTAG_SIGNAL_TCK) || !jtag_IsAllocated(JTAG_SIGNAL_TDI) || !jtag_IsAllocated(JTAG_SIGNAL_TDO)))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "TCK, TDI and TDO have to be assigned.\r\n");
+		success = false;
+	}
+	if(success && (state != JTAGTAP_STATE_DR_SHIFT) && (state != JTAGTAP_STATE_IR_SHIFT))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "TAP has to be in SHIFT_DR or SHIFT_IR.\r\n");
+		success = false;
+	}
+
+	if(success)
+	{
+		comexec_Shifting = true;
+		comexec_ShiftLF = false;
+		message_Write(MESSAGE_LEVEL_REQUIRED, ">>");
+	}
+	else
+	{
+		comexec_SendReply(false);
+	}
+}
+
+/**
+ * @brief Shift nibbles and send TDO back as hex
+ *
+ * The hex is formatted straight into the transmit ring, so it goes out by
+ * DMA while the following input is shifted.
+ *
+ * @param[in] Tdi The nibbles to shift, first nibble in the low bits.
+ * @param[in] Nibbles The number of nibbles, up to COMEXEC_SHIFT_NIBBLES.
+ */
+void comexec_ShiftNibbles(uint32_t Tdi, unsigned int Nibbles)
+{
+	uint32_t tdo = jtag_Shift(Tdi, Nibbles * 4);
+	char *buffer = serial_Reserve(COMEXEC_SHIFT_NIBBLES);
+	unsigned int index;
+
+	for(index = 0; index < Nibbles; ++index)
+	{
+		buffer[index] = comexec_HexDigits[tdo & 0x0F];
+		tdo >>= 4;
+	}
+	serial_Commit(Nibbles);
+}
+
+/**
+ * @brief Check if the input is shift data
+ *
+ * @retval true The shift command is taking the input, or the LF after it.
+ */
+bool comexec_IsShifting()
+{
+	return comexec_Shifting || comexec_ShiftLF;
+}
+
+/**
+ * @brief Shift received hex data
+ *
+ * Decodes the hex straight from the received data, with a table lookup per
+ * character, and shifts it COMEXEC_SHIFT_NIBBLES at a time, so the length
+ * of a shift isn't limited by the command buffer. Each nibble is shifted
+ * least significant bit first. The nibbles left at the end of the data are
+ * shifted straight away rather than waiting for more.
+ *
+ * Shift mode ends at the first character that isn't hex, which is consumed.
+ * If that is the CR of a CRLF the LF is consumed too, even when it comes in
+ * the next call, so it doesn't run as an empty command.
+ *
+ * @param[in] Buffer The received data.
+ * @param[in] Len The length of the data.
+ * @return The number of bytes consumed, less than Len if shift mode ended.
+ */
+unsigned int comexec_Shift(const char *Buffer, unsigned int Len)
+{
+	const char *src = Buffer;
+	const char *end = Buffer + Len;
+	uint32_t tdi = 0;
+	unsigned int nibbles = 0;
+	uint8_t nibble;
+	bool ended = false;
+
+	while(comexec_Shifting && (src < end))
+	{
+		nibble = comexec_HexNibbles[(uint8_t)*src++];
+		if(nibble == COMEXEC_HEX_INVALID)
+		{
+			comexec_Shifting = false;
+			comexec_ShiftLF = (src[-1] == '\r');
+			ended = true;
+		}
+		else
+		{
+			tdi |= (uint32_t)nibble << (nibbles * 4);
+			if(++nibbles == COMEXEC_SHIFT_NIBBLES)
+			{
+				comexec_ShiftNibbles(tdi, nibbles);
+				tdi = 0;
+				nibbles = 0;
+			}
+		}
+	}
+	if(nibbles > 0)
+	{
+		comexec_ShiftNibbles(tdi, nibbles);
+	}
+
+	if(ended)
+	{
+		message_Write(MESSAGE_LEVEL_REQUIRED, "\r\n");
+		comexec_SendReply(true);
+	}
+
+	if(comexec_ShiftLF && (src < end))
+	{
+		comexec_ShiftLF = false;
+		if(*src == '\n')
+		{
+			++src;
+		}
+	}
+	return src - Buffer;
 }
 
 /**
@@ -267,6 +757,7 @@ void comexec_GetSignal(jtag_Signal Signal)
  */
 void comexec_SendReply(bool Success)
 {
+	comexec_Failed = !Success;
 	if(Success)
 	{
 		message_Write(MESSAGE_LEVEL_REQUIRED, "OK\r\n");
@@ -279,136 +770,554 @@ void comexec_SendReply(bool Success)
 	message_Write(MESSAGE_LEVEL_REQUIRED, "> ");
 }
 
+/**
+ * @brief Check that the JTAG signals are free to use
+ *
+ * While a scan is running it owns the pins, commands that drive them have to
+ * wait until it is done or aborted.
+ *
+ * @retval true No scan is in progress.
+ */
+bool comexec_CheckIdle()
+{
+	bool idle = !knock_IsRunning();
+	if(!idle)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Scan in progress, use scan abort first.\r\n");
+	}
+	else if(burst_IsRunning())
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Clocks in progress.\r\n");
+		idle = false;
+	}
+	return idle;
+}
+
 /**
  * @brief Display the list of available commands
  *
  */
 void comexec_Help()
 {
+	unsigned int index;
 
+	message_Write(MESSAGE_LEVEL_GENERAL, "Valid Commands:\r\n");
+	for(index = 0; index < COMEXEC_COMMANDS; ++index)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "  %s%s%s\r\n\t%s\r\n", comexec_Commands[index].Name,
+			(comexec_Commands[index].Usage[0] != '\0') ? " " : "", comexec_Commands[index].Usage, comexec_Commands[index].Help);
+	}
+	comexec_SendReply(true);
 }
 
 /**
- * @brief Execute the given command
+ * @brief Compare a token with a keyword, ignoring case
  *
- * Parses the supplied command and converts any arguments into the data types
- * expected by the various handler functions.
+ * @param[in] Token The token, it isn't terminated.
+ * @param[in] Keyword The keyword.
+ * @return Less than, equal to or greater than zero as the token sorts
+ * before, equal to or after the keyword.
+ */
+int comexec_Compare(const comexec_Token *Token, const char *Keyword)
+{
+	int compare = strncasecmp(Token->Text, Keyword, Token->Length);
+
+	if((compare == 0) && (Keyword[Token->Length] != '\0'))
+	{
+		//the token is a prefix of the keyword
+		compare = -1;
+	}
+	return compare;
+}
+
+/**
+ * @brief Check whether a token is a keyword, ignoring case
  *
- * @param[in] Buffer The command to execute in string format
+ * @param[in] Token The token.
+ * @param[in] Keyword The keyword.
+ * @retval true The token is the keyword.
  */
-void comexec_Execute(char *Buffer)
+bool comexec_Match(const comexec_Token *Token, const char *Keyword)
 {
-	char *pSaveToken;
-	char *Token;
-	bool parseSuccess = false;
+	return comexec_Compare(Token, Keyword) == 0;
+}
 
-	Token = strtok_r(Buffer, " ", &pSaveToken);
+/**
+ * @brief Get a number argument
+ *
+ * The value was converted when the command was tokenized.
+ *
+ * @param[in] Token The argument.
+ * @param[out] Value The number.
+ * @retval true The whole argument was a decimal number.
+ */
+static bool comexec_ParseNumber(const comexec_Token *Token, unsigned int *Value)
+{
+	*Value = Token->Value;
+	return Token->Number;
+}
 
-	if(strcmp(Token, "help") == 0)
+/**
+ * @brief Parse chain [calibrate]
+ */
+void comexec_ParseChain(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	if(Argc == 1)
 	{
-		comexec_Help();
+		comexec_Chain();
 	}
-	else if(strcmp(Token, "chain") == 0)
+	else if(comexec_Match(&Argv[1], "calibrate"))
 	{
-		comexec_Chain();
+		comexec_Calibrate();
 	}
-	else if(strcmp(Token, "clock") == 0)
+	else
 	{
-		unsigned int count;
+		message_Write(MESSAGE_LEVEL_GENERAL, "unknown chain option.\r\n");
+		comexec_SendReply(false);
+	}
+}
+
+/**
+ * @brief Parse clock n
+ */
+void comexec_ParseClock(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	unsigned int count;
 
-		//check and convert the required counts value
-		if((Token = strtok_r(NULL, " ", &pSaveToken)) != NULL)
+	if(comexec_ParseNumber(&Argv[1], &count))
+	{
+		comexec_Clock(count);
+	}
+	else
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "n needs to be a number.\r\n");
+		comexec_SendReply(false);
+	}
+}
+
+/**
+ * @brief Parse config [signal [pin]] | [clock [rate|adaptive] [sample n]]
+ */
+void comexec_ParseConfig(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	bool parseSuccess = true;
+	unsigned int rate = 0, samples = 0;
+	unsigned int pin;
+	unsigned int index;
+	jtag_Signal sig;
+
+	if(Argc == 1)
+	{
+		comexec_Config();
+	}
+	else if(comexec_Match(&Argv[1], "clock"))
+	{
+		//optional rate, then optional sample count
+		for(index = 2; parseSuccess && (index < Argc); ++index)
 		{
-			errno = 0;
-			count = strtoul(Token, NULL, 10);
-			if(errno == 0)
+			if(comexec_Match(&Argv[index], "adaptive"))
 			{
-				//execute the clock command
-				comexec_Clock(count);
+				message_Write(MESSAGE_LEVEL_GENERAL, "adaptive clocking isn't supported.\r\n");
+				parseSuccess = false;
 			}
-			else
+			else if(comexec_Match(&Argv[index], "sample"))
 			{
-				message_Write(MESSAGE_LEVEL_GENERAL, "n needs to be a number.\r\n");
-				comexec_SendReply(false);
+				++index;
+				if((index >= Argc) || !comexec_ParseNumber(&Argv[index], &samples) || (samples == 0))
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "sample needs to be a number.\r\n");
+					parseSuccess = false;
+				}
 			}
+			else if(!comexec_ParseNumber(&Argv[index], &rate) || (rate == 0))
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "rate needs to be a number.\r\n");
+				parseSuccess = false;
+			}
+		}
+
+		if(parseSuccess)
+		{
+			comexec_ClockConfig(rate, samples);
+		}
+		else
+		{
+			comexec_SendReply(false);
+		}
+	}
+	else
+	{
+		//otherwise a signal, with an optional pin
+		sig = JTAG_SIGNAL_TCK;
+		while((sig < JTAG_SIGNAL_MAX) && !comexec_Match(&Argv[1], jtag_SignalNames[sig]))
+		{
+			++sig;
+		}
+
+		if((sig == JTAG_SIGNAL_MAX) || (Argc > 3))
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "unknown config option.\r\n");
+			comexec_SendReply(false);
+		}
+		else if(Argc == 2)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "%s: %i\r\n", jtag_SignalNames[sig], jtag_GetCfg(sig) + 1);
+			comexec_SendReply(true);
+		}
+		else if(!comexec_ParseNumber(&Argv[2], &pin))
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "pin needs to be a number.\r\n");
+			comexec_SendReply(false);
+		}
+		else if(comexec_CheckIdle())
+		{
+			comexec_SignalConfig(sig, (pin <= JTAG_PIN_MAX) ? (int)pin : -1);
 		}
 		else
 		{
-			message_Write(MESSAGE_LEVEL_GENERAL, "missing parameter count.\r\n");
 			comexec_SendReply(false);
 		}
 	}
-	else if(strcmp(Token, "message") == 0)
+}
+
+/**
+ * @brief Parse help
+ */
+void comexec_ParseHelp(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	comexec_Help();
+}
+
+/**
+ * @brief Parse message [level] | [format [text|binary]]
+ */
+void comexec_ParseMessage(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	message_Formats format = MESSAGE_FORMAT_MAX;
+	unsigned int level = MESSAGE_LEVEL_MAX;
+
+	if((Argc > 1) && (comexec_Match(&Argv[1], "format")))
 	{
-		message_Levels level = MESSAGE_LEVEL_MAX;
-		parseSuccess = true;
-		//check and convert the required counts value
-		if((Token = strtok_r(NULL, " ", &pSaveToken)) != NULL)
+		//check and convert the optional format name
+		if(Argc > 2)
 		{
-			errno = 0;
-			level = strtoul(Token, NULL, 10);
-			if(errno != 0)
+			format = MESSAGE_FORMAT_TEXT;
+			while((format < MESSAGE_FORMAT_MAX) && !comexec_Match(&Argv[2], message_FormatNames[format]))
 			{
-				parseSuccess = false;
-				message_Write(MESSAGE_LEVEL_GENERAL, "level needs to be a number.\r\n");
-				comexec_SendReply(false);
+				++format;
 			}
 		}
-		if(parseSuccess)
+
+		if((Argc > 2) && (format == MESSAGE_FORMAT_MAX))
 		{
-			comexec_MessageLevel(level);
+			message_Write(MESSAGE_LEVEL_GENERAL, "format must be text or binary.\r\n");
+			comexec_SendReply(false);
+		}
+		else
+		{
+			comexec_MessageFormat(format);
 		}
 	}
-	else if(strcmp(Token, "scan") == 0)
+	else if(Argc > 2)
 	{
-		knock_Mode scanMode = KNOCK_MODE_RESET;
-		unsigned int pins;
+		message_Write(MESSAGE_LEVEL_GENERAL, "unknown message option.\r\n");
+		comexec_SendReply(false);
+	}
+	else if((Argc > 1) && !comexec_ParseNumber(&Argv[1], &level))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "level needs to be a number.\r\n");
+		comexec_SendReply(false);
+	}
+	else
+	{
+		//MESSAGE_LEVEL_MAX displays the level, keep an out of range level invalid
+		if((Argc > 1) && (level >= MESSAGE_LEVEL_MAX))
+		{
+			level = MESSAGE_LEVEL_MAX + 1;
+		}
+		comexec_MessageLevel(level);
+	}
+}
 
-		//check and convert the required npins value
-		if((Token = strtok_r(NULL, " ", &pSaveToken)) != NULL)
+/**
+ * @brief Parse results [reset|bypass|swd] [confirmed] [csv] [clear]
+ */
+void comexec_ParseResults(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	bool parseSuccess = true;
+	unsigned int modes = 0;
+	bool confirmed = false;
+	bool csv = false;
+	bool clear = false;
+	knock_Mode mode;
+	unsigned int index;
+
+	for(index = 1; parseSuccess && (index < Argc); ++index)
+	{
+		mode = KNOCK_MODE_RESET;
+		while((mode < KNOCK_MODE_MAX) && !comexec_Match(&Argv[index], knock_ModeNames[mode]))
 		{
-			errno = 0;
-			pins = strtoul(Token, NULL, 10);
-			if(errno == 0)
-			{
-				parseSuccess = true;
-				if((Token = strtok_r(NULL, " ", &pSaveToken)) != NULL)
-				{
-					//handle the mode if supplied
-					if(strcmp(Token, "reset") == 0)
-					{
-						scanMode = KNOCK_MODE_RESET;
-					}
-					else if(strcmp(Token, "bypass") == 0)
-					{
-						scanMode = KNOCK_MODE_BYPASS;
-					}
-					else
-					{
-						message_Write(MESSAGE_LEVEL_GENERAL, "invalid mode.\r\n");
-						comexec_SendReply(false);
-						parseSuccess = false;
-					}
-				}
+			++mode;
+		}
 
-				if(parseSuccess)
-				{
-					//execute the scan command
-					comexec_ScanForJTAG(pins, scanMode);
-				}
+		if(mode < KNOCK_MODE_MAX)
+		{
+			modes |= (1 << mode);
+		}
+		else if(comexec_Match(&Argv[index], "confirmed"))
+		{
+			confirmed = true;
+		}
+		else if(comexec_Match(&Argv[index], "csv"))
+		{
+			csv = true;
+		}
+		else if(comexec_Match(&Argv[index], "clear"))
+		{
+			clear = true;
+		}
+		else
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "invalid filter.\r\n");
+			parseSuccess = false;
+		}
+	}
+
+	if(!parseSuccess)
+	{
+		comexec_SendReply(false);
+	}
+	else if(clear)
+	{
+		results_Init();
+		message_Write(MESSAGE_LEVEL_GENERAL, "Results cleared.\r\n");
+		comexec_SendReply(true);
+	}
+	else
+	{
+		comexec_Results((modes != 0) ? modes : ~0U, confirmed, csv);
+	}
+}
+
+/**
+ * @brief Parse scan npins [reset|bypass|swd] [first] [incremental] [capture]
+ * or scan abort|resume|status|incremental
+ */
+void comexec_ParseScan(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	bool parseSuccess = true;
+	knock_Mode scanMode = KNOCK_MODE_RESET;
+	unsigned int scanOptions = 0;
+	unsigned int pins;
+	unsigned int index;
+
+	if((comexec_Match(&Argv[1], "abort")) || (comexec_Match(&Argv[1], "resume")) || (comexec_Match(&Argv[1], "status")) || (comexec_Match(&Argv[1], "incremental")))
+	{
+		comexec_ScanControl(&Argv[1]);
+	}
+	else if(!comexec_ParseNumber(&Argv[1], &pins))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "npins needs to be a number.\r\n");
+		comexec_SendReply(false);
+	}
+	else
+	{
+		//handle the mode and options if supplied
+		for(index = 2; parseSuccess && (index < Argc); ++index)
+		{
+			if(comexec_Match(&Argv[index], "reset"))
+			{
+				scanMode = KNOCK_MODE_RESET;
+			}
+			else if(comexec_Match(&Argv[index], "bypass"))
+			{
+				scanMode = KNOCK_MODE_BYPASS;
+			}
+			else if(comexec_Match(&Argv[index], "swd"))
+			{
+				scanMode = KNOCK_MODE_SWD;
+			}
+			else if(comexec_Match(&Argv[index], "first"))
+			{
+				scanOptions |= KNOCK_OPTION_FIRST;
+			}
+			else if(comexec_Match(&Argv[index], "incremental"))
+			{
+				scanOptions |= KNOCK_OPTION_INCREMENTAL;
+			}
+			else if(comexec_Match(&Argv[index], "capture"))
+			{
+				scanOptions |= KNOCK_OPTION_CAPTURE;
 			}
 			else
 			{
-				message_Write(MESSAGE_LEVEL_GENERAL, "npins needs to be a number.\r\n");
-				comexec_SendReply(false);
+				message_Write(MESSAGE_LEVEL_GENERAL, "invalid mode.\r\n");
 				parseSuccess = false;
 			}
+		}
 
+		if(parseSuccess)
+		{
+			comexec_ScanForJTAG(pins, scanMode, scanOptions);
 		}
 		else
 		{
-			message_Write(MESSAGE_LEVEL_GENERAL, "missing parameter npins.\r\n");
 			comexec_SendReply(false);
 		}
 	}
 }
+
+/**
+ * @brief Parse shift
+ */
+void comexec_ParseShift(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	comexec_ShiftStart();
+}
+
+/**
+ * @brief Parse a signal command, tck|tms|tdi|tdo|trst|srst|rtck [state]
+ *
+ * Param is the jtag_Signal the command is for.
+ */
+void comexec_ParseSignal(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	unsigned int state;
+
+	if(!jtag_IsAllocated(Param))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "%s isn't assigned.\r\n", jtag_SignalNames[Param]);
+		comexec_SendReply(false);
+	}
+	else if(Argc == 1)
+	{
+		comexec_GetSignal(Param);
+	}
+	else if(!comexec_ParseNumber(&Argv[1], &state) || (state > 1))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "state needs to be 0 or 1.\r\n");
+		comexec_SendReply(false);
+	}
+	else if(comexec_CheckIdle())
+	{
+		comexec_SetSignal(Param, state == 1);
+	}
+	else
+	{
+		comexec_SendReply(false);
+	}
+}
+
+/**
+ * @brief Parse tap [state]
+ */
+void comexec_ParseTAP(int Param, unsigned int Argc, const comexec_Token *Argv)
+{
+	unsigned int index = 0;
+
+	if(Argc == 1)
+	{
+		comexec_TAP(JTAGTAP_STATE_MAX);
+	}
+	else
+	{
+		while((index < sizeof(comexec_TAPStates) / sizeof(comexec_TAPStates[0])) && !comexec_Match(&Argv[1], comexec_TAPStates[index].Name))
+		{
+			++index;
+		}
+
+		if(index == sizeof(comexec_TAPStates) / sizeof(comexec_TAPStates[0]))
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "unknown TAP state.\r\n");
+			comexec_SendReply(false);
+		}
+		else if(comexec_CheckIdle())
+		{
+			comexec_TAP(comexec_TAPStates[index].State);
+		}
+		else
+		{
+			comexec_SendReply(false);
+		}
+	}
+}
+
+/**
+ * @brief Find a command in the command table
+ *
+ * The table is sorted by name, so a binary search takes at most
+ * log2(COMEXEC_COMMANDS) + 1 comparisons, whichever command it is.
+ *
+ * @param[in] Name The command name token.
+ * @return The command or NULL if there isn't one by that name.
+ */
+static const comexec_Command *comexec_Find(const comexec_Token *Name)
+{
+	const comexec_Command *command = NULL;
+	unsigned int low = 0;
+	unsigned int high = COMEXEC_COMMANDS;
+	unsigned int middle;
+	int compare;
+
+	while((command == NULL) && (low < high))
+	{
+		middle = (low + high) / 2;
+		compare = comexec_Compare(Name, comexec_Commands[middle].Name);
+		if(compare == 0)
+		{
+			command = &comexec_Commands[middle];
+		}
+		else if(compare < 0)
+		{
+			high = middle;
+		}
+		else
+		{
+			low = middle + 1;
+		}
+	}
+	return command;
+}
+
+/**
+ * @brief Execute the given command
+ *
+ * Looks the command up in comexec_Commands and checks the number of
+ * arguments before handing the tokens to its handler, which converts them
+ * into the data types expected by the various handler functions.
+ *
+ * @param[in] Tokens The tokens of the command, at most COMEXEC_TOKENS_MAX
+ * are read.
+ * @param[in] Count The number of tokens in the command, this may be more
+ * than were kept.
+ * @retval true The command replied OK, or hasn't replied yet as it runs in
+ * the background.
+ * @retval false The command replied ERROR.
+ */
+bool comexec_Execute(const comexec_Token *Tokens, unsigned int Count)
+{
+	const comexec_Command *command;
+
+	comexec_Failed = false;
+
+	if(Count == 0)
+	{
+		//empty line, just issue a new prompt
+		message_Write(MESSAGE_LEVEL_REQUIRED, "> ");
+	}
+	else if((command = comexec_Find(&Tokens[0])) == NULL)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Invalid command\r\n");
+		comexec_SendReply(false);
+	}
+	else if((Count - 1 < command->MinArgs) || (Count - 1 > command->MaxArgs))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "usage: %s %s\r\n", command->Name, command->Usage);
+		comexec_SendReply(false);
+	}
+	else
+	{
+		command->Handler(command->Param, Count, Tokens);
+	}
+	return !comexec_Failed;
+}
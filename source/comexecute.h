@@ -19,6 +19,30 @@
 #if !defined(_COMEXECUTE_H_)
 #define _COMEXECUTE_H_
 
-extern void comexec_Execute(char *Buffer);
+#include <stdbool.h>
+#include <stdint.h>
+
+#define COMEXEC_ARGS_MAX	8	///< Most arguments any command takes, after its name
+#define COMEXEC_TOKENS_MAX	(COMEXEC_ARGS_MAX + 2)	///< Tokens kept per command, enough to spot one too many
+
+/**
+ * @brief A token of a command
+ *
+ * Tokens refer to the command where it was received, they aren't
+ * terminated or changed to lower case. Keywords are matched regardless of
+ * case.
+ */
+typedef struct comexec_sToken
+{
+	const char *Text;	///< Start of the token
+	unsigned int Length;	///< Number of characters in the token
+	uint32_t Value;		///< Value of the token, if Number is set
+	bool Number;		///< The token is a decimal number that fits in 32 bits
+}comexec_Token;
+
+extern bool comexec_Execute(const comexec_Token *Tokens, unsigned int Count);
+extern void comexec_Task();
+extern bool comexec_IsShifting();
+extern unsigned int comexec_Shift(const char *Buffer, unsigned int Len);
 
 #endif
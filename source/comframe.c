@@ -0,0 +1,780 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "comframe.h"
+#include "comprocessor.h"
+#include "serial.h"
+#include "message.h"
+#include "jtag.h"
+#include "jtagtap.h"
+#include "chain.h"
+#include "burst.h"
+#include "knock.h"
+#include "results.h"
+#include <string.h>
+
+#define COMFRAME_ENCODED_MAX	(1 + COMFRAME_PACKET_MAX + (COMFRAME_PACKET_MAX / 254) + 1 + 1)	///< Magic, COBS encoded packet and delimiter
+
+static uint8_t comframe_Rx[COMFRAME_PACKET_MAX];	///< Decoded packet being received
+static unsigned int comframe_RxLength;		///< Bytes in comframe_Rx
+static bool comframe_RxOverflow;		///< The packet didn't fit in comframe_Rx
+static uint8_t comframe_Block;			///< COBS code of the current block
+static uint8_t comframe_BlockLeft;		///< Bytes left in the current block
+
+static bool comframe_ClockPending;		///< A clock command is waiting for its burst to finish
+static uint8_t comframe_ClockSequence;		///< Sequence number of the pending clock command
+
+/**
+ * @brief CRC-16/CCITT-FALSE remainders for each nibble
+ */
+static const uint16_t comframe_CRCTable[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+/**
+ * @brief Initialize the framed protocol
+ */
+void comframe_Init()
+{
+	comframe_ClockPending = false;
+	comframe_Start();
+}
+
+/**
+ * @brief Calculate a CRC-16/CCITT-FALSE
+ *
+ * Uses a nibble table, a fair trade between a 512 byte table and eight
+ * shifts per byte.
+ *
+ * @param data The bytes to calculate the CRC over
+ * @param length The number of bytes
+ * @return The CRC
+ */
+uint16_t comframe_CRC(const uint8_t *data, unsigned int length)
+{
+	uint16_t crc = 0xFFFF;
+	while(length-- > 0)
+	{
+		crc = (crc << 4) ^ comframe_CRCTable[(crc >> 12) ^ (*data >> 4)];
+		crc = (crc << 4) ^ comframe_CRCTable[(crc >> 12) ^ (*data & 0x0F)];
+		++data;
+	}
+	return crc;
+}
+
+/**
+ * @brief COBS encode a packet
+ *
+ * @param[in] src The packet
+ * @param length The length of the packet
+ * @param[out] dest Space for the encoded packet, length + length / 254 + 1
+ * bytes
+ * @return The length of the encoded packet
+ */
+static unsigned int comframe_Encode(const uint8_t *src, unsigned int length, uint8_t *dest)
+{
+	uint8_t *start = dest;
+	uint8_t *code = dest++;
+	uint8_t run = 1;
+
+	while(length-- > 0)
+	{
+		if(*src == 0)
+		{
+			*code = run;
+			code = dest++;
+			run = 1;
+		}
+		else
+		{
+			*dest++ = *src;
+			if(++run == 0xFF)
+			{
+				*code = run;
+				code = dest++;
+				run = 1;
+			}
+		}
+		++src;
+	}
+	*code = run;
+	return dest - start;
+}
+
+/**
+ * @brief Send a reply packet
+ *
+ * The packet is built and COBS encoded straight into space reserved in the
+ * serial transmit ring.
+ *
+ * @param id The command being replied to
+ * @param sequence The sequence number of the command
+ * @param status The comframe_Status of the command
+ * @param data Reply data after the status
+ * @param length Bytes of reply data, up to COMFRAME_DATA_MAX - 1
+ */
+static void comframe_Send(uint8_t id, uint8_t sequence, comframe_Status status, const uint8_t *data, unsigned int length)
+{
+	uint8_t packet[COMFRAME_PACKET_MAX];
+	uint8_t *buffer;
+	unsigned int count;
+	uint16_t crc;
+
+	packet[0] = id | COMFRAME_REPLY;
+	packet[1] = sequence;
+	packet[2] = length + 1;
+	packet[COMFRAME_HEADER] = status;
+	memcpy(&packet[COMFRAME_HEADER + 1], data, length);
+	count = COMFRAME_HEADER + 1 + length;
+	crc = comframe_CRC(packet, count);
+	packet[count++] = crc & 0xFF;
+	packet[count++] = crc >> 8;
+
+	buffer = (uint8_t *)serial_Reserve(COMFRAME_ENCODED_MAX);
+	buffer[0] = COMFRAME_MAGIC;
+	count = 1 + comframe_Encode(packet, count, &buffer[1]);
+	buffer[count++] = 0x00;
+	serial_Commit(count);
+}
+
+/**
+ * @brief Store a 16 bit value little endian
+ */
+static void comframe_Put16(uint8_t *dest, uint16_t value)
+{
+	dest[0] = value & 0xFF;
+	dest[1] = value >> 8;
+}
+
+/**
+ * @brief Store a 32 bit value little endian
+ */
+static void comframe_Put32(uint8_t *dest, uint32_t value)
+{
+	dest[0] = value & 0xFF;
+	dest[1] = (value >> 8) & 0xFF;
+	dest[2] = (value >> 16) & 0xFF;
+	dest[3] = value >> 24;
+}
+
+/**
+ * @brief Check the JTAG signals are free to use
+ */
+static bool comframe_IsIdle()
+{
+	return !knock_IsRunning() && !burst_IsRunning();
+}
+
+/**
+ * @brief Set or read the message level
+ */
+static comframe_Status comframe_Message(const uint8_t *data, unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+	if(length == 1)
+	{
+		if(data[0] < MESSAGE_LEVEL_MAX)
+		{
+			message_SetLevel(data[0]);
+		}
+		else
+		{
+			status = COMFRAME_STATUS_PARAMETER;
+		}
+	}
+	else if(length != 0)
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	reply[0] = message_GetLevel();
+	*replyLength = 1;
+	return status;
+}
+
+/**
+ * @brief Assign or read the signal pins
+ *
+ * Pins are numbered from 1, 0 leaves a signal unassigned.
+ */
+static comframe_Status comframe_Config(const uint8_t *data, unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+	int map[JTAG_SIGNAL_MAX];
+	jtag_Signal sig;
+	int pin;
+
+	if(length == JTAG_SIGNAL_MAX)
+	{
+		for(sig = JTAG_SIGNAL_TCK; (sig < JTAG_SIGNAL_MAX) && (status == COMFRAME_STATUS_OK); ++sig)
+		{
+			map[sig] = (data[sig] == 0) ? JTAG_SIGNAL_NOT_ALLOCATED : (data[sig] - 1);
+			if(data[sig] > JTAG_PIN_MAX)
+			{
+				status = COMFRAME_STATUS_PARAMETER;
+			}
+		}
+		if(status == COMFRAME_STATUS_OK)
+		{
+			if(!comframe_IsIdle())
+			{
+				status = COMFRAME_STATUS_BUSY;
+			}
+			else if(!jtag_CfgAll(map))
+			{
+				status = COMFRAME_STATUS_FAILED;
+			}
+		}
+	}
+	else if(length != 0)
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+
+	for(sig = JTAG_SIGNAL_TCK; sig < JTAG_SIGNAL_MAX; ++sig)
+	{
+		pin = jtag_GetCfg(sig);
+		reply[sig] = (pin == JTAG_SIGNAL_NOT_ALLOCATED) ? 0 : (pin + 1);
+	}
+	*replyLength = JTAG_SIGNAL_MAX;
+	return status;
+}
+
+/**
+ * @brief Set or read a signal
+ */
+static comframe_Status comframe_Signal(const uint8_t *data, unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+
+	if((length != 1) && (length != 2))
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	else if((data[0] >= JTAG_SIGNAL_MAX) || !jtag_IsAllocated(data[0]))
+	{
+		status = COMFRAME_STATUS_PARAMETER;
+	}
+	else
+	{
+		if(length == 2)
+		{
+			if(comframe_IsIdle())
+			{
+				jtag_Set(data[0], data[1] != 0);
+			}
+			else
+			{
+				status = COMFRAME_STATUS_BUSY;
+			}
+		}
+		reply[0] = jtag_Get(data[0]);
+		*replyLength = 1;
+	}
+	return status;
+}
+
+/**
+ * @brief Move the TAP or read its state
+ */
+static comframe_Status comframe_TAP(const uint8_t *data, unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+
+	if(length == 1)
+	{
+		if((data[0] == JTAGTAP_STATE_UNKNOWN) || (data[0] >= JTAGTAP_STATE_MAX))
+		{
+			status = COMFRAME_STATUS_PARAMETER;
+		}
+		else if(!comframe_IsIdle())
+		{
+			status = COMFRAME_STATUS_BUSY;
+		}
+		else
+		{
+			jtagTAP_SetState(data[0]);
+		}
+	}
+	else if(length != 0)
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	reply[0] = jtagTAP_GetState();
+	*replyLength = 1;
+	return status;
+}
+
+/**
+ * @brief Start a burst of clocks
+ *
+ * The reply is sent by comframe_Task() once the burst has finished.
+ */
+static comframe_Status comframe_Clock(const uint8_t *data, unsigned int length)
+{
+	comframe_Status status = COMFRAME_STATUS_PENDING;
+	uint32_t count;
+
+	if(length != 4)
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	else if(!comframe_IsIdle())
+	{
+		status = COMFRAME_STATUS_BUSY;
+	}
+	else
+	{
+		count = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+		if(!burst_Start(count))
+		{
+			status = COMFRAME_STATUS_FAILED;
+		}
+		else if(!burst_IsRunning())
+		{
+			status = COMFRAME_STATUS_OK;
+		}
+	}
+	return status;
+}
+
+/**
+ * @brief Shift bits through the current TAP state
+ *
+ * TDI and TDO are packed least significant bit first, TMS is left alone.
+ * jtag_Shift() is given up to 32 bits at a time.
+ */
+static comframe_Status comframe_Shift(const uint8_t *data, unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+	unsigned int bits;
+	unsigned int bytes;
+	unsigned int index;
+	unsigned int chunk;
+	uint32_t word;
+
+	bits = (length >= 2) ? (data[0] | (data[1] << 8)) : 0;
+	bytes = (bits + 7) / 8;
+	if((length < 2) || (length != 2 + bytes) || (bits > COMFRAME_SHIFT_MAX))
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	else if(!jtag_IsAllocated(JTAG_SIGNAL_TCK) || !jtag_IsAllocated(JTAG_SIGNAL_TDI) || !jtag_IsAllocated(JTAG_SIGNAL_TDO))
+	{
+		status = COMFRAME_STATUS_FAILED;
+	}
+	else if(!comframe_IsIdle())
+	{
+		status = COMFRAME_STATUS_BUSY;
+	}
+	else
+	{
+		data += 2;
+		for(index = 0; index < bytes; index += 4)
+		{
+			chunk = ((bytes - index) < 4) ? (bytes - index) : 4;
+			word = 0;
+			memcpy(&word, &data[index], chunk);
+			word = jtag_Shift(word, ((bits - (index * 8)) < 32) ? (bits - (index * 8)) : 32);
+			memcpy(&reply[index], &word, chunk);
+		}
+		*replyLength = bytes;
+	}
+	return status;
+}
+
+/**
+ * @brief Detect the chain
+ *
+ * Replies with the number of devices, then the ID Code of each device that
+ * fits.
+ */
+static comframe_Status comframe_Chain(unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+	unsigned int devices;
+	unsigned int device;
+
+	if(length != 0)
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	else if(!comframe_IsIdle())
+	{
+		status = COMFRAME_STATUS_BUSY;
+	}
+	else if(!chain_Detect())
+	{
+		status = COMFRAME_STATUS_FAILED;
+	}
+	else
+	{
+		devices = chain_GetDevices();
+		reply[0] = devices;
+		*replyLength = 1;
+		for(device = 0; (device < devices) && (*replyLength + 4 < COMFRAME_DATA_MAX); ++device)
+		{
+			comframe_Put32(&reply[*replyLength], chain_GetIDCode(device));
+			*replyLength += 4;
+		}
+	}
+	return status;
+}
+
+/**
+ * @brief Start or control a scan, or read its progress
+ *
+ * Three bytes start a scan on pins 1 - pins with a knock_Mode and
+ * KNOCK_OPTION_xxx bits, one byte is a comframe_ScanAction. Always replies
+ * with the comframe_ScanState, pairs done(2), pairs in total(2), hits(1) and
+ * the seconds left(2).
+ */
+static comframe_Status comframe_Scan(const uint8_t *data, unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+	knock_Progress progress;
+
+	if(length == 3)
+	{
+		if((data[0] < 4) || (data[0] > JTAG_PIN_MAX) || (data[1] >= KNOCK_MODE_MAX) || ((data[2] & ~KNOCK_OPTIONS_ALL) != 0))
+		{
+			status = COMFRAME_STATUS_PARAMETER;
+		}
+		else if(!comframe_IsIdle())
+		{
+			status = COMFRAME_STATUS_BUSY;
+		}
+		else
+		{
+			knock_Start(data[1], data[0], data[2]);
+		}
+	}
+	else if(length == 1)
+	{
+		switch(data[0])
+		{
+			case COMFRAME_SCAN_ABORT:
+				if(!knock_Abort())
+				{
+					status = COMFRAME_STATUS_FAILED;
+				}
+				break;
+
+			case COMFRAME_SCAN_RESUME:
+				if(knock_IsRunning())
+				{
+					status = COMFRAME_STATUS_BUSY;
+				}
+				else if(!knock_Resume())
+				{
+					status = COMFRAME_STATUS_FAILED;
+				}
+				break;
+
+			case COMFRAME_SCAN_INCREMENTAL:
+				if(!comframe_IsIdle())
+				{
+					status = COMFRAME_STATUS_BUSY;
+				}
+				else if(!knock_Incremental())
+				{
+					status = COMFRAME_STATUS_FAILED;
+				}
+				break;
+
+			default:
+				status = COMFRAME_STATUS_PARAMETER;
+				break;
+		}
+	}
+	else if(length != 0)
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+
+	knock_GetProgress(&progress);
+	reply[0] = progress.running ? COMFRAME_SCAN_RUNNING : (progress.resumable ? COMFRAME_SCAN_ABORTED : COMFRAME_SCAN_STOPPED);
+	comframe_Put16(&reply[1], progress.done);
+	comframe_Put16(&reply[3], progress.total);
+	reply[5] = (progress.hits < 0xFF) ? progress.hits : 0xFF;
+	comframe_Put16(&reply[6], (progress.eta < 0xFFFF) ? progress.eta : 0xFFFF);
+	*replyLength = 8;
+	return status;
+}
+
+/**
+ * @brief Read the scan results
+ *
+ * Replies with the number of hits. Given a 0 based index, that hit follows
+ * as tck, tms, tdi, tdo, modes, score, seen, devices, clocks(4) and the
+ * ID Codes(4 each) kept. Pins are numbered from 1, 0 for a pin the hit
+ * doesn't use, as in the csv results.
+ */
+static comframe_Status comframe_Results(const uint8_t *data, unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+	const results_Hit *hit;
+	unsigned int id;
+
+	reply[0] = results_Count();
+	*replyLength = 1;
+	if(length == 1)
+	{
+		if(data[0] >= results_Count())
+		{
+			status = COMFRAME_STATUS_PARAMETER;
+		}
+		else
+		{
+			hit = results_Get(data[0]);
+			reply[1] = hit->tck + 1;
+			reply[2] = hit->tms + 1;
+			reply[3] = (hit->tdi == RESULTS_PIN_NONE) ? 0 : (hit->tdi + 1);
+			reply[4] = (hit->tdo == RESULTS_PIN_NONE) ? 0 : (hit->tdo + 1);
+			reply[5] = hit->modes;
+			reply[6] = hit->score;
+			reply[7] = hit->seen;
+			reply[8] = hit->devices;
+			comframe_Put32(&reply[9], hit->clocks);
+			*replyLength = 13;
+			for(id = 0; (id < hit->devices) && (id < RESULTS_MAX_IDCODES); ++id)
+			{
+				comframe_Put32(&reply[*replyLength], hit->idcodes[id]);
+				*replyLength += 4;
+			}
+		}
+	}
+	else if(length != 0)
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	return status;
+}
+
+/**
+ * @brief Set or read the clock rate in kHz and the TDO sample count
+ *
+ * A rate or sample count of 0 is left alone.
+ */
+static comframe_Status comframe_ClockConfig(const uint8_t *data, unsigned int length, uint8_t *reply, unsigned int *replyLength)
+{
+	comframe_Status status = COMFRAME_STATUS_OK;
+	uint32_t rate;
+
+	if(length == 5)
+	{
+		rate = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+		if((rate != 0) && !jtag_SetClockRate(rate))
+		{
+			status = COMFRAME_STATUS_PARAMETER;
+		}
+		if((data[4] != 0) && !jtag_SetOversample(data[4]))
+		{
+			status = COMFRAME_STATUS_PARAMETER;
+		}
+	}
+	else if(length != 0)
+	{
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	comframe_Put32(reply, jtag_GetClockRate());
+	reply[4] = jtag_GetOversample();
+	*replyLength = 5;
+	return status;
+}
+
+/**
+ * @brief Check and execute a received packet
+ */
+static void comframe_Dispatch()
+{
+	uint8_t reply[COMFRAME_DATA_MAX];
+	unsigned int replyLength = 0;
+	unsigned int length = comframe_Rx[2];
+	comframe_Status status;
+	const uint8_t *data = &comframe_Rx[COMFRAME_HEADER];
+	uint8_t id = comframe_Rx[0];
+	uint8_t sequence = comframe_Rx[1];
+
+	if(comframe_RxOverflow || (comframe_RxLength < COMFRAME_HEADER + COMFRAME_CRC_SIZE) ||
+		(length != comframe_RxLength - COMFRAME_HEADER - COMFRAME_CRC_SIZE))
+	{
+		id = COMFRAME_CMD_INVALID;
+		sequence = (comframe_RxLength > 1) ? sequence : 0;
+		status = COMFRAME_STATUS_LENGTH;
+	}
+	else if(comframe_CRC(comframe_Rx, COMFRAME_HEADER + length) != (comframe_Rx[COMFRAME_HEADER + length] | (comframe_Rx[COMFRAME_HEADER + length + 1] << 8)))
+	{
+		id = COMFRAME_CMD_INVALID;
+		status = COMFRAME_STATUS_CRC;
+	}
+	else
+	{
+		switch(id)
+		{
+			case COMFRAME_CMD_PING:
+				memcpy(reply, data, (length < COMFRAME_DATA_MAX) ? length : (COMFRAME_DATA_MAX - 1));
+				replyLength = (length < COMFRAME_DATA_MAX) ? length : (COMFRAME_DATA_MAX - 1);
+				status = COMFRAME_STATUS_OK;
+				break;
+
+			case COMFRAME_CMD_EXECUTE:
+				//same as a typed command, tokenized where it is
+				status = comproc_Execute((const char *)data, length) ? COMFRAME_STATUS_OK : COMFRAME_STATUS_FAILED;
+				break;
+
+			case COMFRAME_CMD_MESSAGE:
+				status = comframe_Message(data, length, reply, &replyLength);
+				break;
+
+			case COMFRAME_CMD_CONFIG:
+				status = comframe_Config(data, length, reply, &replyLength);
+				break;
+
+			case COMFRAME_CMD_SIGNAL:
+				status = comframe_Signal(data, length, reply, &replyLength);
+				break;
+
+			case COMFRAME_CMD_TAP:
+				status = comframe_TAP(data, length, reply, &replyLength);
+				break;
+
+			case COMFRAME_CMD_CLOCK:
+				status = comframe_Clock(data, length);
+				break;
+
+			case COMFRAME_CMD_SHIFT:
+				status = comframe_Shift(data, length, reply, &replyLength);
+				break;
+
+			case COMFRAME_CMD_CHAIN:
+				status = comframe_Chain(length, reply, &replyLength);
+				break;
+
+			case COMFRAME_CMD_SCAN:
+				status = comframe_Scan(data, length, reply, &replyLength);
+				break;
+
+			case COMFRAME_CMD_RESULTS:
+				status = comframe_Results(data, length, reply, &replyLength);
+				break;
+
+			case COMFRAME_CMD_CLOCK_CONFIG:
+				status = comframe_ClockConfig(data, length, reply, &replyLength);
+				break;
+
+			default:
+				status = COMFRAME_STATUS_COMMAND;
+				break;
+		}
+	}
+
+	if(status == COMFRAME_STATUS_PENDING)
+	{
+		comframe_ClockPending = true;
+		comframe_ClockSequence = sequence;
+	}
+	else
+	{
+		comframe_Send(id, sequence, status, reply, replyLength);
+	}
+}
+
+/**
+ * @brief Start receiving a packet
+ *
+ * Called by the command processor once it has seen COMFRAME_MAGIC.
+ */
+void comframe_Start()
+{
+	comframe_RxLength = 0;
+	comframe_RxOverflow = false;
+	comframe_Block = 0;
+	comframe_BlockLeft = 0;
+}
+
+/**
+ * @brief Receive a byte of a packet
+ *
+ * The packet is COBS decoded as it arrives, so it never has to be buffered
+ * twice. Once the delimiter is seen the packet is checked, executed and
+ * replied to.
+ *
+ * @param data The received byte
+ * @retval true More of the packet is expected.
+ * @retval false The packet has ended, the following bytes are text.
+ */
+bool comframe_Receive(uint8_t data)
+{
+	bool more = true;
+
+	if(data == 0x00)
+	{
+		//a block cut short means bytes were lost
+		if(comframe_BlockLeft != 0)
+		{
+			comframe_RxOverflow = true;
+		}
+		comframe_Dispatch();
+		more = false;
+	}
+	else if(comframe_BlockLeft == 0)
+	{
+		//a new block, ending any previous block short of 254 bytes with a zero
+		if((comframe_Block != 0) && (comframe_Block != 0xFF))
+		{
+			if(comframe_RxLength < COMFRAME_PACKET_MAX)
+			{
+				comframe_Rx[comframe_RxLength++] = 0x00;
+			}
+			else
+			{
+				comframe_RxOverflow = true;
+			}
+		}
+		comframe_Block = data;
+		comframe_BlockLeft = data - 1;
+	}
+	else
+	{
+		if(comframe_RxLength < COMFRAME_PACKET_MAX)
+		{
+			comframe_Rx[comframe_RxLength++] = data;
+		}
+		else
+		{
+			comframe_RxOverflow = true;
+		}
+		--comframe_BlockLeft;
+	}
+	return more;
+}
+
+/**
+ * @brief Finish off packets that run in the background
+ *
+ * Called from the main loop, sends the reply to a clock command once its
+ * burst has finished.
+ */
+void comframe_Task()
+{
+	if(comframe_ClockPending && !burst_IsRunning())
+	{
+		comframe_ClockPending = false;
+		comframe_Send(COMFRAME_CMD_CLOCK, comframe_ClockSequence, COMFRAME_STATUS_OK, NULL, 0);
+	}
+}
@@ -0,0 +1,107 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_COMFRAME_H_)
+#define _COMFRAME_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Framed binary protocol
+ *
+ * A packet is sent as COMFRAME_MAGIC, the COBS encoded packet and a zero
+ * delimiter. COMFRAME_MAGIC is only recognised at the start of a command
+ * line, so typed commands are unaffected. The decoded packet is:
+ *
+ *     id(1) sequence(1) length(1) data(length) crc(2)
+ *
+ * The CRC is CRC-16/CCITT-FALSE over everything before it, little endian.
+ * Replies echo the sequence number, set bit 7 of the id and start their
+ * data with one of the comframe_Status values.
+ */
+#define COMFRAME_MAGIC		0x01	///< Starts a packet in place of a command line
+#define COMFRAME_DATA_MAX	130	///< Maximum data bytes in a packet
+#define COMFRAME_HEADER		3	///< Bytes before the data
+#define COMFRAME_CRC_SIZE	2	///< Bytes in the CRC
+#define COMFRAME_PACKET_MAX	(COMFRAME_HEADER + COMFRAME_DATA_MAX + COMFRAME_CRC_SIZE)	///< Largest decoded packet
+#define COMFRAME_REPLY		0x80	///< Set in the id of a reply
+#define COMFRAME_SHIFT_MAX	((COMFRAME_DATA_MAX - 2) * 8)	///< Most bits in one COMFRAME_CMD_SHIFT
+
+/**
+ * @brief Packet commands
+ */
+typedef enum comframe_eCommand
+{
+	COMFRAME_CMD_PING = 0x00,	///< Replies with the data sent
+	COMFRAME_CMD_EXECUTE = 0x01,	///< Executes the data as a text command, its output stays text, FAILED if it replied ERROR
+	COMFRAME_CMD_MESSAGE = 0x02,	///< [level] sets the message level, replies with the level
+	COMFRAME_CMD_CONFIG = 0x10,	///< [pin per signal] assigns the signals, replies with the pins, 0 is unassigned
+	COMFRAME_CMD_SIGNAL = 0x11,	///< signal [state] sets an output, replies with its state
+	COMFRAME_CMD_TAP = 0x12,	///< [state] moves the TAP, replies with the state
+	COMFRAME_CMD_CLOCK = 0x13,	///< count(4) gives TCK clocks, replies once they are done
+	COMFRAME_CMD_SHIFT = 0x14,	///< bits(2) tdi... shifts TDI out, replies with TDO
+	COMFRAME_CMD_CHAIN = 0x15,	///< Detects the chain, replies with the device count and ID Codes(4 each)
+	COMFRAME_CMD_SCAN = 0x16,	///< [pins mode options] or [action] starts or controls a scan, replies with its progress
+	COMFRAME_CMD_RESULTS = 0x17,	///< [index] replies with the hit count and the hit at index
+	COMFRAME_CMD_CLOCK_CONFIG = 0x18,	///< [rate(4) samples(1)] sets the clock, replies with the rate and samples
+	COMFRAME_CMD_INVALID = 0x7F,	///< Replies to packets that couldn't be read
+}comframe_Command;
+
+/**
+ * @brief Actions of a one byte COMFRAME_CMD_SCAN
+ */
+typedef enum comframe_eScanAction
+{
+	COMFRAME_SCAN_ABORT = 0,	///< Stops the running scan
+	COMFRAME_SCAN_RESUME,		///< Carries on with an aborted scan
+	COMFRAME_SCAN_INCREMENTAL,	///< Repeats the last scan, only re-testing pairs that may have changed
+	COMFRAME_SCAN_MAX
+}comframe_ScanAction;
+
+/**
+ * @brief Scan states in a COMFRAME_CMD_SCAN reply
+ */
+typedef enum comframe_eScanState
+{
+	COMFRAME_SCAN_STOPPED = 0,	///< No scan is running
+	COMFRAME_SCAN_RUNNING,		///< A scan is running
+	COMFRAME_SCAN_ABORTED,		///< The last scan was aborted and can be resumed
+}comframe_ScanState;
+
+/**
+ * @brief Reply status, the first data byte of every reply
+ */
+typedef enum comframe_eStatus
+{
+	COMFRAME_STATUS_OK = 0,		///< Command executed
+	COMFRAME_STATUS_CRC,		///< The packet CRC was wrong
+	COMFRAME_STATUS_LENGTH,		///< The packet was too short, too long or its length was wrong
+	COMFRAME_STATUS_COMMAND,	///< Unknown command
+	COMFRAME_STATUS_PARAMETER,	///< Invalid command data
+	COMFRAME_STATUS_BUSY,		///< A scan or clock burst owns the signals
+	COMFRAME_STATUS_FAILED,		///< The command couldn't be carried out
+	COMFRAME_STATUS_PENDING,	///< Internal, the reply is sent by comframe_Task()
+}comframe_Status;
+
+extern void comframe_Init();
+extern void comframe_Start();
+extern bool comframe_Receive(uint8_t data);
+extern void comframe_Task();
+extern uint16_t comframe_CRC(const uint8_t *data, unsigned int length);
+
+#endif
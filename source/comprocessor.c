@@ -18,11 +18,20 @@
 
 #include "comprocessor.h"
 #include "comexecute.h"
+#include "comframe.h"
+#include <stdint.h>
+#include <string.h>
 
 #define COMPROC_BUFFER_LENGTH	(80)			///< Maximum command length supported
 
 static unsigned int comproc_BufferLength;		///< Length of the command in the buffer
 static char comproc_Buffer[COMPROC_BUFFER_LENGTH+1];	///< Command buffer
+static bool comproc_Framed;				///< Bytes are going to a binary packet
+static comexec_Token comproc_Tokens[COMEXEC_TOKENS_MAX];	///< Tokens of the command being executed
+static comexec_Token comproc_SpareToken;		///< Scratch space for tokens past COMEXEC_TOKENS_MAX
+static unsigned int comproc_TokenCount;			///< Number of tokens in the command, including any not kept
+
+static unsigned int comproc_Tokenize(const char *Data, unsigned int Length, bool Editing, bool *Complete);
 
 /**
  * @brief Initialize the command processor
@@ -32,16 +41,125 @@ void comproc_Init()
 {
 	//Initialize the buffer length
 	comproc_BufferLength = 0;
+	comproc_Framed = false;
+	comframe_Init();
+}
+
+/**
+ * @brief Split a command into tokens
+ *
+ * A single pass over the command finds the tokens and converts the ones that
+ * are decimal numbers, the command isn't copied or changed. Tokens are
+ * separated by spaces and CR, the command ends at LF. Any tokens past
+ * COMEXEC_TOKENS_MAX are counted but not kept.
+ *
+ * @param[in] Data The command.
+ * @param[in] Length The number of bytes available.
+ * @param[in] Editing Stop at a backspace or delete, leaving it to be
+ * processed.
+ * @param[out] Complete Set when the LF ending the command was found.
+ * @return The number of bytes used, including the LF.
+ */
+unsigned int comproc_Tokenize(const char *Data, unsigned int Length, bool Editing, bool *Complete)
+{
+	comexec_Token *token = NULL;
+	unsigned int index;
+	uint32_t digit;
+	char data;
+
+	comproc_TokenCount = 0;
+	*Complete = false;
+	for(index = 0; index < Length; ++index)
+	{
+		data = Data[index];
+		if(data == '\n')
+		{
+			*Complete = true;
+			++index;
+			break;
+		}
+		else if(Editing && ((data == '\b') || (data == 0x7F)))
+		{
+			break;
+		}
+		else if((data == ' ') || (data == '\r') || (data == '\0'))
+		{
+			token = NULL;
+		}
+		else
+		{
+			if(token == NULL)
+			{
+				//start a new token
+				token = (comproc_TokenCount < COMEXEC_TOKENS_MAX) ? &comproc_Tokens[comproc_TokenCount] : &comproc_SpareToken;
+				++comproc_TokenCount;
+				token->Text = &Data[index];
+				token->Length = 0;
+				token->Value = 0;
+				token->Number = true;
+			}
+			++token->Length;
+
+			//keep the number up to date, as long as it fits
+			digit = (uint32_t)(data - '0');
+			if(token->Number && (digit <= 9) && (token->Value <= (UINT32_MAX - digit) / 10))
+			{
+				token->Value = (token->Value * 10) + digit;
+			}
+			else
+			{
+				token->Number = false;
+			}
+		}
+	}
+	return index;
+}
+
+/**
+ * @brief Execute commands that aren't coming from the serial stream
+ *
+ * Each line is executed in turn. While the shift command is taking input,
+ * the following lines are passed on to comexec_Shift() as its data.
+ *
+ * @param[in] Line The commands, separated by LF, the last one doesn't need a
+ * terminator.
+ * @param[in] Length The length of the commands.
+ * @return false if any comexec_Execute() failed.
+ */
+bool comproc_Execute(const char *Line, unsigned int Length)
+{
+	bool success = true;
+	bool complete;
+	unsigned int used = 0;
+
+	do
+	{
+		if(comexec_IsShifting())
+		{
+			used += comexec_Shift(&Line[used], Length - used);
+		}
+		else
+		{
+			used += comproc_Tokenize(&Line[used], Length - used, false, &complete);
+			if(!comexec_Execute(comproc_Tokens, comproc_TokenCount))
+			{
+				success = false;
+			}
+		}
+	} while(used < Length);
+	return success;
 }
 
 /**
  * @brief Process an incoming command
  *
- * The incoming buffer may provide a few bytes to a valid command, process
- * them into the command buffer, changing case and handling backspace and
- * delete as required. When a valid terminator is found, hand the command
- * buffer off for execution. Commands should process one after another, no
- * matter where the packet boundaries lie.
+ * The incoming buffer may provide a few bytes to a valid command. A whole
+ * command at the start of the buffer is tokenized and executed where it is,
+ * without copying. Otherwise the bytes are processed into the command
+ * buffer, handling backspace and delete as required, and when a valid
+ * terminator is found the command buffer is tokenized and executed. Commands
+ * should process one after another, no matter where the packet boundaries
+ * lie.
  *
  * The backspace and delete characters should remove previous input from the
  * command buffer, one byte per instance. The length of the buffer should
@@ -53,16 +171,57 @@ void comproc_Init()
  * in the buffer will be silently discarded when a terminator is finally seen
  * and normal processing will resume.
  *
+ * A @ref COMFRAME_MAGIC at the start of a command switches to a binary
+ * packet, the bytes are passed untouched to comframe_Receive() until the
+ * end of the packet. While the shift command is taking input, the data is
+ * passed on to comexec_Shift() in as large pieces as possible.
  */
 void comproc_Process(const char * buffer, unsigned int len)
 {
 	const char *src = buffer;
 	char *dest = &comproc_Buffer[comproc_BufferLength];
+	unsigned int used;
+	bool complete;
 
 	while(len > 0)
 	{
-		if(comproc_BufferLength < COMPROC_BUFFER_LENGTH)
+		if(comexec_IsShifting())
+		{
+			//shift data goes straight to the shift command, a chunk at a time
+			used = comexec_Shift(src, len);
+		}
+		else if(comproc_Framed)
+		{
+			comproc_Framed = comframe_Receive(*src);
+			used = 1;
+		}
+		else if((comproc_BufferLength == 0) && (*src == COMFRAME_MAGIC))
+		{
+			comproc_Framed = true;
+			comframe_Start();
+			used = 1;
+		}
+		else if((comproc_BufferLength == 0) && ((used = comproc_Tokenize(src, len, true, &complete)) > 0))
+		{
+			if(complete)
+			{
+				//a whole command, execute it where it is unless it's oversized
+				if(used <= COMPROC_BUFFER_LENGTH)
+				{
+					comexec_Execute(comproc_Tokens, comproc_TokenCount);
+				}
+			}
+			else
+			{
+				//the rest of the command is still to come, or needs editing
+				comproc_BufferLength = (used < COMPROC_BUFFER_LENGTH) ? used : COMPROC_BUFFER_LENGTH;
+				memcpy(comproc_Buffer, src, comproc_BufferLength);
+				dest = &comproc_Buffer[comproc_BufferLength];
+			}
+		}
+		else if(comproc_BufferLength < COMPROC_BUFFER_LENGTH)
 		{
+			used = 1;
 			//process backspace and delete first
 			if((*src == '\b') || (*src == 0x7F))
 			{
@@ -76,28 +235,19 @@ void comproc_Process(const char * buffer, unsigned int len)
 			else
 			{
 				//copy the byte from the incomming buffer into the command buffer
-				//converting to lowercase if needed
-				if((*src >= 'A') && (*src <= 'Z'))
-				{
-					*dest = (*src | 0x20);		//convert to lowercase
-				}
-				else
-				{
-					*dest = *src;
-				}
+				*dest = *src;
 				++comproc_BufferLength;
 				++dest;
 
 				//have we reached the end of a command
 				if(*src == '\n')
 				{
-					//NULL terminate the buffer
-					comproc_Buffer[comproc_BufferLength] = '\x00';
-
-					comexec_Execute(comproc_Buffer);
+					comproc_Tokenize(comproc_Buffer, comproc_BufferLength, false, &complete);
 					//reset the index and pointer
 					comproc_BufferLength = 0;
 					dest = comproc_Buffer;
+
+					comexec_Execute(comproc_Tokens, comproc_TokenCount);
 				}
 
 			}
@@ -106,6 +256,7 @@ void comproc_Process(const char * buffer, unsigned int len)
 		{
 			//the buffer is full, wait for a terminator and then reset
 			//execute isn't called as the command is invalid
+			used = 1;
 			if(*src == '\n')
 			{
 				comproc_BufferLength = 0;
@@ -113,9 +264,9 @@ void comproc_Process(const char * buffer, unsigned int len)
 			}
 		}
 
-		//a byte was consumed from the input stream, update length
+		//bytes were consumed from the input stream, update length
 		//and the pointer
-		++src;
-		--len;
+		src += used;
+		len -= used;
 	}
 }
@@ -19,7 +19,10 @@
 #if !defined(_COMPROCESSOR_H_)
 #define _COMPROCESSOR_H_
 
+#include <stdbool.h>
+
 extern void comproc_Init();
 extern void comproc_Process(const char * buffer, unsigned int len);
+extern bool comproc_Execute(const char *Line, unsigned int Length);
 
 #endif
@@ -17,12 +17,86 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
 #include "jtag.h"
 
+/**
+ * @brief A run of pins on one GPIO port
+ *
+ * Logical pins are numbered through the segments in order, so a segment's
+ * pins are read with a single shift and mask of the port's input register.
+ */
+typedef struct jtag_sSegment {
+	uint32_t port;		///< GPIO port the pins are on
+	uint8_t bit;		///< First bit on the port
+	uint8_t pin;		///< Logical number of the first pin
+	uint16_t mask;		///< Mask of the pins, starting at bit 0
+} jtag_Segment;
+
+/**
+ * @brief Mapping of the logical pins to the GPIO ports
+ *
+ * Pins that are used on the STM32F3DISCOVERY (USART2, USB, the sensors,
+ * LEDs, SWD and the crystals) are left out. Segments on the same port are
+ * kept next to each other, so each port is only read once.
+ */
+static const jtag_Segment jtag_Segments[] = {
+	{ GPIOD, 0,	0,	0xFFFF },	//PD0 - PD15 are pins 0 - 15
+	{ GPIOC, 0,	16,	0x1FFF },	//PC0 - PC12 are pins 16 - 28
+	{ GPIOB, 10,	29,	0x003F },	//PB10 - PB15 are pins 29 - 34
+	{ GPIOB, 0,	35,	0x0003 },	//PB0 - PB1 are pins 35 - 36
+	{ GPIOF, 2,	37,	0x0001 },	//PF2 is pin 37
+	{ GPIOF, 4,	38,	0x0001 },	//PF4 is pin 38
+	{ GPIOF, 9,	39,	0x0001 },	//PF9 is pin 39
+};
+
+#define JTAG_SEGMENTS	(sizeof(jtag_Segments)/sizeof(jtag_Segment))	///< Number of entries in jtag_Segments
+
+/**
+ * @brief The GPIO ports used by #jtag_Segments
+ */
+static const uint32_t jtag_Ports[] = { GPIOD, GPIOC, GPIOB, GPIOF };
+
+#define JTAG_PORTS	(sizeof(jtag_Ports)/sizeof(uint32_t))	///< Number of entries in jtag_Ports
+
+#define JTAG_PHASES	(4)	///< Number of calibrated sample phases remembered
+
+/**
+ * @brief A calibrated TDO sample phase
+ *
+ * Kept for the pins TCK, TMS, TDI and TDO are on and the clock rate it was
+ * calibrated at.
+ */
+typedef struct jtag_sPhase {
+	int pins[JTAG_SIGNAL_TDO + 1];	///< Pins of TCK - TDO
+	unsigned int delay;		///< Clock delay, 0 for an unused entry
+	unsigned int phase;		///< Sample phase
+} jtag_Phase;
+
 static int jtag_Signals[JTAG_SIGNAL_MAX];
-static unsigned int jtag_PinUsage;		///< Bit mask of the pins used for signals.
+static uint32_t jtag_SignalPort[JTAG_SIGNAL_MAX];	///< GPIO port of each allocated signal
+static uint16_t jtag_SignalBit[JTAG_SIGNAL_MAX];	///< Bit mask of each allocated signal on its port
+static uint32_t jtag_SignalSpread[JTAG_SIGNAL_MAX];	///< Mode register mask (2 bits per pin) of each allocated signal
+static uint32_t jtag_PortSpread[JTAG_PORTS];	///< Mode register mask of the scan pins on each of #jtag_Ports
+static uint32_t jtag_PortUsed[JTAG_PORTS];	///< Mode register mask of the allocated pins on each of #jtag_Ports
+static jtag_PinMask jtag_PinUsage;		///< Bit mask of the pins used for signals.
+static uint32_t jtag_ClockCount;		///< Number of TCK pulses given, wraps.
+static unsigned int jtag_ClockDelay;		///< Delay loop count for each half of a TCK period
+static unsigned int jtag_Oversample;		///< Number of reads TDO is voted over
+static unsigned int jtag_SamplePhase;		///< Delay loop count from the falling TCK edge to sampling TDO
+static jtag_Phase jtag_Phases[JTAG_PHASES];	///< Calibrated sample phases
+static unsigned int jtag_PhaseNext;		///< Next entry of jtag_Phases to replace
+
+static bool jtag_Locate(unsigned int num, uint32_t *port, unsigned int *bit);
+static uint32_t jtag_Spread(uint16_t mask);
+static unsigned int jtag_PortIndex(uint32_t port);
+static bool jtag_IsOutput(jtag_Signal sig);
+static bool jtag_SampleTDO();
+static void jtag_Delay(unsigned int loops);
+static jtag_Phase *jtag_FindPhase();
+static void jtag_RecallPhase();
 
 const char * const jtag_SignalNames[JTAG_SIGNAL_MAX] = {
 	[JTAG_SIGNAL_TCK] = "TCK",
@@ -34,6 +108,84 @@ const char * const jtag_SignalNames[JTAG_SIGNAL_MAX] = {
 	[JTAG_SIGNAL_RTCK] = "RTCK",
 };
 
+/**
+ * @brief Find the GPIO port and bit of a logical pin
+ *
+ * @param[in] num The logical pin number
+ * @param[out] port The GPIO port the pin is on
+ * @param[out] bit The bit number of the pin on the port
+ * @retval true The pin exists
+ */
+static bool jtag_Locate(unsigned int num, uint32_t *port, unsigned int *bit)
+{
+	bool found = false;
+	unsigned int seg;
+
+	for(seg = 0; seg < JTAG_SEGMENTS; ++seg)
+	{
+		const jtag_Segment *segment = &jtag_Segments[seg];
+
+		if((num >= segment->pin) && ((num - segment->pin) < 16) && (((segment->mask >> (num - segment->pin)) & 0x01) != 0))
+		{
+			*port = segment->port;
+			*bit = segment->bit + (num - segment->pin);
+			found = true;
+			break;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief Turn a 1 bit per pin mask into a 2 bit per pin mask
+ *
+ * For the MODER, OSPEEDR and PUPDR registers. Only used to work out the
+ * masks when the pins are configured, see #jtag_PortSpread and
+ * #jtag_SignalSpread.
+ */
+static uint32_t jtag_Spread(uint16_t mask)
+{
+	uint32_t spread = 0;
+	unsigned int bit;
+
+	for(bit = 0; bit < 16; ++bit)
+	{
+		if(((mask >> bit) & 0x01) != 0)
+		{
+			spread |= 3 << (bit * 2);
+		}
+	}
+	return spread;
+}
+
+/**
+ * @brief Find the index of a GPIO port in #jtag_Ports
+ *
+ * @param[in] port One of the ports used by #jtag_Segments
+ * @returns The index of the port
+ */
+static unsigned int jtag_PortIndex(uint32_t port)
+{
+	unsigned int index = 0;
+
+	while((index < (JTAG_PORTS - 1)) && (jtag_Ports[index] != port))
+	{
+		++index;
+	}
+	return index;
+}
+
+/**
+ * @brief Check if a signal is driven by the STM32
+ *
+ * @retval true The signal's pin is an output
+ * @retval false The signal's pin is an input (TDO and RTCK)
+ */
+static bool jtag_IsOutput(jtag_Signal sig)
+{
+	return !((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK));
+}
+
 /**
  * @brief Initialises the JTAG local variables.
  */
@@ -47,15 +199,38 @@ void jtag_Init()
 	}
 
 	jtag_PinUsage = 0;	//No pins currently allocated.
+	jtag_ClockDelay = JTAG_CLOCK_DELAY;
+	jtag_Oversample = 1;
+	jtag_SamplePhase = jtag_ClockDelay;
+	for(i = 0; i < JTAG_PHASES; ++i)
+	{
+		jtag_Phases[i].delay = 0;
+	}
+	jtag_PhaseNext = 0;
+
+	RCC_AHBENR |= 0x005C0000;	//Enable GPIOB, C, D and F clocks
+
+	for(i = 0; i < JTAG_PORTS; ++i)
+	{
+		jtag_PortSpread[i] = 0;
+		jtag_PortUsed[i] = 0;
+	}
+
+	//set up the pins to be all inputs, push-pull, no pullups and slow when set as outputs.
+	//outputs default to 0. Other pins on the ports are left alone.
+	for(i = 0; i < JTAG_SEGMENTS; ++i)
+	{
+		const jtag_Segment *segment = &jtag_Segments[i];
+		uint16_t bits = segment->mask << segment->bit;
+		uint32_t spread = jtag_Spread(bits);
 
-	//set up the io ports to be all inputs, push-pull, no pullups and slow when set as outputs.
-	//outputs default to 0
-	GPIOD_MODER = 0x00000000;
-	GPIOD_OTYPER = 0x00000000;
-	GPIOD_OSPEEDR = 0x00000000;
-	GPIOD_PUPDR = 0x00000000;
-	GPIOD_BSRR = 0xFFFF0000;
-	RCC_AHBENR |= 0x00100000;	//Enable GPIOD clock
+		GPIO_MODER(segment->port) &= ~spread;
+		GPIO_OTYPER(segment->port) &= 0x0000FFFF & ~bits;
+		GPIO_OSPEEDR(segment->port) &= ~spread;
+		GPIO_PUPDR(segment->port) &= ~spread;
+		GPIO_BSRR(segment->port) = (uint32_t)bits << 16;
+		jtag_PortSpread[jtag_PortIndex(segment->port)] |= spread;
+	}
 
 	//assign the default signal allocation
 	jtag_Cfg(JTAG_SIGNAL_TCK, 0);
@@ -67,8 +242,8 @@ void jtag_Init()
 /**
  * @brief Sets a JTAG signal to a STM32 pin number
  *
- * The supported pin numbers are from 0 - 15 and correspond to PD0 - PD15
- * Respectively.
+ * The supported pin numbers are from 0 - JTAG_PIN_MAX - 1, see
+ * #jtag_Segments for the port pin each one is on. 0 - 15 are PD0 - PD15.
  *
  * @param[in] sig The JTAG signal to configure.
  * @param[in] num The pin number the signal is connected to, or
@@ -80,41 +255,48 @@ bool jtag_Cfg(jtag_Signal sig, int num)
 	bool success = false;
 	if((sig >= JTAG_SIGNAL_TCK) && (sig < JTAG_SIGNAL_MAX))
 	{
-		unsigned int mask_and, mask_or;
+		uint32_t mask_and, mask_or;
+		uint32_t port;
+		unsigned int bit;
+
 		if(num < JTAG_PIN_MAX)
 		{
 			if(num != JTAG_SIGNAL_NOT_ALLOCATED)
 			{
 				//is the pin being requested currently free?
-				if((jtag_PinUsage & (1 << num)) == 0)
+				if(((jtag_PinUsage & JTAG_PIN(num)) == 0) && jtag_Locate(num, &port, &bit))
 				{
 					//Deconfigure the old pin if allocated
 					if(jtag_Signals[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
 					{
-						mask_and = 3 << (jtag_Signals[sig] * 2);
-						GPIOD_MODER = (GPIOD_MODER & ~mask_and);
-						jtag_PinUsage &= ~(1<<jtag_Signals[sig]);	//mark as un-allocated
+						GPIO_MODER(jtag_SignalPort[sig]) &= ~jtag_SignalSpread[sig];
+						jtag_PortUsed[jtag_PortIndex(jtag_SignalPort[sig])] &= ~jtag_SignalSpread[sig];
+						jtag_PinUsage &= ~JTAG_PIN(jtag_Signals[sig]);	//mark as un-allocated
 					}
 
 					//Configure the IO port mode
-					mask_and = 3 << (num * 2);
-					mask_or = ((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK)) ? 0 : 1;	//Input or output?
-					mask_or = mask_or << (num * 2);
-					GPIOD_MODER = (GPIOD_MODER & ~mask_and) | mask_or;
-					jtag_PinUsage |= (1<<num);
+					mask_and = 3 << (bit * 2);
+					mask_or = jtag_IsOutput(sig) ? 1 : 0;	//Input or output?
+					mask_or = mask_or << (bit * 2);
+					GPIO_MODER(port) = (GPIO_MODER(port) & ~mask_and) | mask_or;
+					jtag_PortUsed[jtag_PortIndex(port)] |= mask_and;
+					jtag_PinUsage |= JTAG_PIN(num);
 					jtag_Signals[sig] = num;	//set the allocation
+					jtag_SignalPort[sig] = port;
+					jtag_SignalBit[sig] = 1 << bit;
+					jtag_SignalSpread[sig] = mask_and;
 					success = true;
 				}
 			}
 			else
 			{
 				//Configure the pin as an input
-				unsigned int old_sig = jtag_Signals[sig];
+				int old_sig = jtag_Signals[sig];
 				if(old_sig != JTAG_SIGNAL_NOT_ALLOCATED)
 				{
-					mask_and = 3 << (old_sig * 2);
-					GPIOD_MODER = (GPIOD_MODER & ~mask_and);
-					jtag_PinUsage &= ~(1<<jtag_Signals[sig]);	//mark as un-allocated
+					GPIO_MODER(jtag_SignalPort[sig]) &= ~jtag_SignalSpread[sig];
+					jtag_PortUsed[jtag_PortIndex(jtag_SignalPort[sig])] &= ~jtag_SignalSpread[sig];
+					jtag_PinUsage &= ~JTAG_PIN(old_sig);	//mark as un-allocated
 				}
 				jtag_Signals[sig] = num;	//set the allocation
 				success = true;
@@ -122,6 +304,104 @@ bool jtag_Cfg(jtag_Signal sig, int num)
 
 		}
 	}
+
+	if(success)
+	{
+		jtag_RecallPhase();
+	}
+	return success;
+}
+
+/**
+ * @brief Sets every JTAG signal to a STM32 pin number in one go
+ *
+ * The whole map is checked before anything is changed, so on failure the
+ * current configuration is kept. The new mode of each port is worked out
+ * first and then written once, so the pins never pass through a half
+ * configured state and switching a whole map costs a single write per port.
+ * The mode register masks of the new pins are kept, so the other functions
+ * don't have to work them out again.
+ *
+ * @param[in] map The pin of each signal, indexed by #jtag_Signal, or
+ * JTAG_SIGNAL_NOT_ALLOCATED for signals that aren't used.
+ * @returns true if configuration suceeded, false if a pin is invalid or
+ * used by more than one signal.
+ */
+bool jtag_CfgAll(const int map[JTAG_SIGNAL_MAX])
+{
+	bool success = true;
+	uint32_t ports[JTAG_SIGNAL_MAX];
+	unsigned int bits[JTAG_SIGNAL_MAX];
+	uint32_t mask_and[JTAG_PORTS] = {0};
+	uint32_t mask_or[JTAG_PORTS] = {0};
+	uint32_t used[JTAG_PORTS] = {0};
+	jtag_PinMask usage = 0;
+	jtag_Signal sig;
+	unsigned int index;
+
+	//check the new map
+	for(sig = JTAG_SIGNAL_TCK; success && (sig < JTAG_SIGNAL_MAX); ++sig)
+	{
+		int num = map[sig];
+
+		if(num != JTAG_SIGNAL_NOT_ALLOCATED)
+		{
+			if((num >= 0) && (num < JTAG_PIN_MAX) && ((usage & JTAG_PIN(num)) == 0) && jtag_Locate(num, &ports[sig], &bits[sig]))
+			{
+				usage |= JTAG_PIN(num);
+			}
+			else
+			{
+				success = false;
+			}
+		}
+	}
+
+	if(success)
+	{
+		//work out the new mode of each port, old pins go back to inputs
+		for(sig = JTAG_SIGNAL_TCK; sig < JTAG_SIGNAL_MAX; ++sig)
+		{
+			if(jtag_Signals[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
+			{
+				mask_and[jtag_PortIndex(jtag_SignalPort[sig])] |= jtag_SignalSpread[sig];
+			}
+
+			if(map[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
+			{
+				index = jtag_PortIndex(ports[sig]);
+				mask_and[index] |= 3 << (bits[sig] * 2);
+				used[index] |= 3 << (bits[sig] * 2);
+				if(jtag_IsOutput(sig))
+				{
+					mask_or[index] |= 1 << (bits[sig] * 2);
+				}
+			}
+		}
+
+		for(index = 0; index < JTAG_PORTS; ++index)
+		{
+			if(mask_and[index] != 0)
+			{
+				GPIO_MODER(jtag_Ports[index]) = (GPIO_MODER(jtag_Ports[index]) & ~mask_and[index]) | mask_or[index];
+			}
+			jtag_PortUsed[index] = used[index];
+		}
+
+		//and the allocation
+		for(sig = JTAG_SIGNAL_TCK; sig < JTAG_SIGNAL_MAX; ++sig)
+		{
+			jtag_Signals[sig] = map[sig];
+			if(map[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
+			{
+				jtag_SignalPort[sig] = ports[sig];
+				jtag_SignalBit[sig] = 1 << bits[sig];
+				jtag_SignalSpread[sig] = 3 << (bits[sig] * 2);
+			}
+		}
+		jtag_PinUsage = usage;
+		jtag_RecallPhase();
+	}
 	return success;
 }
 
@@ -146,22 +426,36 @@ int jtag_GetCfg(jtag_Signal sig)
  */
 void jtag_Set(jtag_Signal sig, bool val)
 {
-	unsigned int pinNum;
-
 	if((sig >= JTAG_SIGNAL_TCK) && (sig < JTAG_SIGNAL_MAX) && !((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK)))
 	{
-		pinNum = jtag_Signals[sig];
+		if(jtag_Signals[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
+		{
+			//set/reset the appropriate pin, resetting is shifted further
+			GPIO_BSRR(jtag_SignalPort[sig]) = val ? jtag_SignalBit[sig] : ((uint32_t)jtag_SignalBit[sig] << 16);
+		}
+	}
+}
+
+/**
+ * @brief Turn an output signal around
+ *
+ * Used for SWDIO, which is carried on TMS and is driven by the target while
+ * it replies. The signal is still allocated as an output, jtag_Cfg() sets it
+ * back to normal.
+ *
+ * @param[in] sig The signal to turn around
+ * @param[in] output true to drive the pin, false to make it an input
+ */
+void jtag_SetDirection(jtag_Signal sig, bool output)
+{
+	uint32_t spread;
 
-		if(pinNum != JTAG_SIGNAL_NOT_ALLOCATED)
+	if((sig >= JTAG_SIGNAL_TCK) && (sig < JTAG_SIGNAL_MAX))
+	{
+		if(jtag_Signals[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
 		{
-			//set/reset the appropriate pin
-			pinNum = 1 << pinNum;
-			if(!val)
-			{
-				//resetting, shift it further
-				pinNum = pinNum << 16;
-			}
-			GPIOD_BSRR = pinNum;
+			spread = jtag_SignalSpread[sig];
+			GPIO_MODER(jtag_SignalPort[sig]) = (GPIO_MODER(jtag_SignalPort[sig]) & ~spread) | (output ? (spread & 0x55555555) : 0);
 		}
 	}
 }
@@ -175,38 +469,384 @@ void jtag_Set(jtag_Signal sig, bool val)
  */
 bool jtag_Get(jtag_Signal sig)
 {
-	unsigned int pinNum = jtag_Signals[sig];
 	bool pinState = false;
 
-	if(pinNum != JTAG_SIGNAL_NOT_ALLOCATED)
+	if(jtag_Signals[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
 	{
 		//read the pin state from the input register
-		pinState = ((GPIOD_IDR & (1 << pinNum)) != 0);
+		pinState = ((GPIO_IDR(jtag_SignalPort[sig]) & jtag_SignalBit[sig]) != 0);
 	}
 
 	return pinState;
 }
 
+/**
+ * @brief Read the state of every pin
+ *
+ * Each port's input register is read once.
+ *
+ * @returns The pin states, bit n is pin n.
+ */
+jtag_PinMask jtag_ReadPins()
+{
+	jtag_PinMask pins = 0;
+	uint32_t port = 0, idr = 0;
+	unsigned int seg;
+
+	for(seg = 0; seg < JTAG_SEGMENTS; ++seg)
+	{
+		const jtag_Segment *segment = &jtag_Segments[seg];
+
+		if((seg == 0) || (segment->port != port))
+		{
+			port = segment->port;
+			idr = GPIO_IDR(port);
+		}
+		pins |= (jtag_PinMask)((idr >> segment->bit) & segment->mask) << segment->pin;
+	}
+	return pins;
+}
+
 /**
  * @brief Toggles the JTAG clock
  *
  */
 void jtag_Clock()
 {
-	unsigned int cnt;
 	jtag_Set(JTAG_SIGNAL_TCK, true);
+	jtag_Delay(jtag_ClockDelay);
+	jtag_Set(JTAG_SIGNAL_TCK, false);
+	jtag_Delay(jtag_ClockDelay);
+	++jtag_ClockCount;
+}
 
-	for(cnt = 8000; cnt > 0; --cnt)
+/**
+ * @brief Busy wait
+ *
+ * @param[in] loops The number of delay loops, see JTAG_CLOCK_DELAY
+ */
+static void jtag_Delay(unsigned int loops)
+{
+	for(; loops > 0; --loops)
 	{
 		__asm("nop");
 	}
+}
+
+/**
+ * @brief Set the TCK rate
+ *
+ * The rate is approximate, it's set by the length of the delay loops in
+ * jtag_Clock() and doesn't include the time spent toggling the pins.
+ *
+ * @param[in] khz The clock rate in kHz, 1 - JTAG_CLOCK_KHZ_MAX
+ * @retval true The rate was set
+ * @retval false The rate is out of range
+ */
+bool jtag_SetClockRate(unsigned int khz)
+{
+	bool success = false;
+
+	if((khz > 0) && (khz <= JTAG_CLOCK_KHZ_MAX))
+	{
+		jtag_ClockDelay = JTAG_CLOCK_DELAY / khz;
+		jtag_RecallPhase();
+		success = true;
+	}
+	return success;
+}
 
-	jtag_Set(JTAG_SIGNAL_TCK, false);
+/**
+ * @brief Get the delay loop count of half a TCK period
+ *
+ * This is the largest sample phase that can be set.
+ */
+unsigned int jtag_GetClockDelay()
+{
+	return jtag_ClockDelay;
+}
 
-	for(cnt = 8000; cnt > 0; --cnt)
+/**
+ * @brief Set when TDO is sampled by jtag_Shift()
+ *
+ * TDO is sampled phase delay loops after the falling edge of TCK. The
+ * default is jtag_GetClockDelay(), just before the next rising edge. The
+ * phase is remembered for the current TCK, TMS, TDI and TDO pins and clock
+ * rate, and is used again whenever they're configured.
+ *
+ * @param[in] phase The sample delay, 0 - jtag_GetClockDelay()
+ * @retval true The phase was set
+ * @retval false The phase is longer than half a clock
+ */
+bool jtag_SetSamplePhase(unsigned int phase)
+{
+	bool success = false;
+	jtag_Phase *entry;
+	jtag_Signal sig;
+
+	if(phase <= jtag_ClockDelay)
 	{
-		__asm("nop");
+		entry = jtag_FindPhase();
+		if(entry == NULL)
+		{
+			entry = &jtag_Phases[jtag_PhaseNext];
+			jtag_PhaseNext = (jtag_PhaseNext + 1) % JTAG_PHASES;
+			for(sig = JTAG_SIGNAL_TCK; sig <= JTAG_SIGNAL_TDO; ++sig)
+			{
+				entry->pins[sig] = jtag_Signals[sig];
+			}
+			entry->delay = jtag_ClockDelay;
+		}
+		entry->phase = phase;
+		jtag_SamplePhase = phase;
+		success = true;
+	}
+	return success;
+}
+
+/**
+ * @brief Get when TDO is sampled by jtag_Shift()
+ */
+unsigned int jtag_GetSamplePhase()
+{
+	return jtag_SamplePhase;
+}
+
+/**
+ * @brief Find the remembered phase of the current configuration
+ *
+ * @returns The entry in #jtag_Phases, NULL if there isn't one.
+ */
+static jtag_Phase *jtag_FindPhase()
+{
+	jtag_Phase *found = NULL;
+	unsigned int index;
+
+	for(index = 0; (index < JTAG_PHASES) && (found == NULL); ++index)
+	{
+		jtag_Phase *entry = &jtag_Phases[index];
+
+		if((entry->delay == jtag_ClockDelay) &&
+			(entry->pins[JTAG_SIGNAL_TCK] == jtag_Signals[JTAG_SIGNAL_TCK]) &&
+			(entry->pins[JTAG_SIGNAL_TMS] == jtag_Signals[JTAG_SIGNAL_TMS]) &&
+			(entry->pins[JTAG_SIGNAL_TDI] == jtag_Signals[JTAG_SIGNAL_TDI]) &&
+			(entry->pins[JTAG_SIGNAL_TDO] == jtag_Signals[JTAG_SIGNAL_TDO]))
+		{
+			found = entry;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief Use the remembered phase of the configuration, or the default
+ */
+static void jtag_RecallPhase()
+{
+	const jtag_Phase *entry = jtag_FindPhase();
+
+	jtag_SamplePhase = (entry != NULL) ? entry->phase : jtag_ClockDelay;
+}
+
+/**
+ * @brief Get the approximate TCK rate in kHz
+ */
+unsigned int jtag_GetClockRate()
+{
+	return JTAG_CLOCK_DELAY / jtag_ClockDelay;
+}
+
+/**
+ * @brief Set the number of reads TDO is sampled over by jtag_Shift()
+ *
+ * With more than one read, TDO is read that many times around the sample
+ * point and the majority level is taken. This rides out ringing on long
+ * leads at higher clock rates.
+ *
+ * @param[in] reads 1, 3 or 5, up to JTAG_OVERSAMPLE_MAX
+ * @retval true The sampling was set
+ * @retval false reads isn't an odd number in range
+ */
+bool jtag_SetOversample(unsigned int reads)
+{
+	bool success = false;
+
+	if((reads > 0) && (reads <= JTAG_OVERSAMPLE_MAX) && ((reads & 0x01) != 0))
+	{
+		jtag_Oversample = reads;
+		success = true;
+	}
+	return success;
+}
+
+/**
+ * @brief Get the number of reads TDO is sampled over
+ */
+unsigned int jtag_GetOversample()
+{
+	return jtag_Oversample;
+}
+
+/**
+ * @brief Sample TDO, voting over the configured number of reads
+ *
+ * The reads are spread JTAG_OVERSAMPLE_GAP loops apart, the caller starts
+ * them early enough for the last one to land on the sample point.
+ *
+ * @retval true TDO is high
+ */
+static bool jtag_SampleTDO()
+{
+	uint32_t port = jtag_SignalPort[JTAG_SIGNAL_TDO];
+	uint16_t bit = jtag_SignalBit[JTAG_SIGNAL_TDO];
+	unsigned int read, high = 0;
+
+	for(read = 0; read < jtag_Oversample; ++read)
+	{
+		if(read != 0)
+		{
+			jtag_Delay(JTAG_OVERSAMPLE_GAP);
+		}
+		if((GPIO_IDR(port) & bit) != 0)
+		{
+			++high;
+		}
+	}
+	return (high * 2) > jtag_Oversample;
+}
+
+/**
+ * @brief Shift bits through the current Shift-IR/DR state
+ *
+ * For each bit TDO is sampled, TDI is set and TCK is clocked, LSB first.
+ * TMS is left alone, so the TAP stays in the shift state. The first bit is
+ * sampled straight away, the others jtag_SetSamplePhase() after the falling
+ * edge that shifted them out. TDO is sampled with jtag_SetOversample() reads,
+ * which end at the sample phase so the calibrated phase holds for any number
+ * of reads. The low half of TCK only grows if the phase is too early to fit
+ * the reads in.
+ *
+ * @param[in] tdi The bits to send on TDI
+ * @param[in] bits The number of bits to shift, up to 32
+ * @returns The bits read from TDO, the first in bit 0. 0 if TDO isn't
+ * allocated.
+ */
+uint32_t jtag_Shift(uint32_t tdi, unsigned int bits)
+{
+	uint32_t tdo = 0;
+	bool sample = (jtag_Signals[JTAG_SIGNAL_TDO] != JTAG_SIGNAL_NOT_ALLOCATED);
+	unsigned int spread = (jtag_Oversample - 1) * JTAG_OVERSAMPLE_GAP;	//delay between the first and last read
+	unsigned int before = (jtag_SamplePhase > spread) ? (jtag_SamplePhase - spread) : 0;
+	unsigned int after = (jtag_ClockDelay > (before + spread)) ? (jtag_ClockDelay - before - spread) : 0;
+	unsigned int bit;
+
+	if(sample && (bits > 0) && jtag_SampleTDO())
+	{
+		tdo = 1;
+	}
+
+	for(bit = 0; (bit < bits) && (bit < 32); ++bit)
+	{
+		jtag_Set(JTAG_SIGNAL_TDI, ((tdi >> bit) & 0x01) != 0);
+		jtag_Set(JTAG_SIGNAL_TCK, true);
+		jtag_Delay(jtag_ClockDelay);
+		jtag_Set(JTAG_SIGNAL_TCK, false);
+		jtag_Delay(before);
+		if(sample && ((bit + 1) < bits) && ((bit + 1) < 32))
+		{
+			if(jtag_SampleTDO())
+			{
+				tdo |= 1U << (bit + 1);
+			}
+		}
+		else
+		{
+			jtag_Delay(spread);	//keep the period the same without the reads
+		}
+		jtag_Delay(after);
+		++jtag_ClockCount;
+	}
+	return tdo;
+}
+
+/**
+ * @brief Get the number of clock pulses given so far
+ *
+ * The count wraps, unsigned subtraction of two readings gives the number of
+ * clocks in between.
+ */
+uint32_t jtag_GetClockCount()
+{
+	return jtag_ClockCount;
+}
+
+/**
+ * @brief Count clocks that were given without jtag_Clock()
+ *
+ * For clocks generated by hardware, see burst_Start().
+ *
+ * @param[in] count The number of clocks given
+ */
+void jtag_AddClocks(uint32_t count)
+{
+	jtag_ClockCount += count;
+}
+
+/**
+ * @brief Get the GPIO port and bit of a signal
+ *
+ * For peripherals that drive a signal's pin directly.
+ *
+ * @param[in] sig The signal
+ * @param[out] port The GPIO port the signal is on
+ * @param[out] bit Bit mask of the signal on the port
+ * @retval true The signal is allocated
+ */
+bool jtag_GetSignalPort(jtag_Signal sig, uint32_t *port, uint16_t *bit)
+{
+	bool allocated = jtag_IsAllocated(sig);
+
+	if(allocated)
+	{
+		*port = jtag_SignalPort[sig];
+		*bit = jtag_SignalBit[sig];
+	}
+	return allocated;
+}
+
+/**
+ * @brief Read the pins with the unallocated ones weakly pulled
+ *
+ * The internal pull resistors are applied to every pin that isn't assigned to
+ * a signal, given time to settle and the pins are read. The pulls are
+ * removed again before returning. A pin that is driven by the target reads
+ * the same whichever way it is pulled, a floating one follows the pull.
+ *
+ * @param[in] pull The pull to apply, see #jtag_Pull
+ * @returns The state of all the pins.
+ */
+jtag_PinMask jtag_SamplePins(jtag_Pull pull)
+{
+	unsigned int index;
+	jtag_PinMask data;
+	uint32_t pulls = (pull == JTAG_PULL_UP) ? 0x55555555 : ((pull == JTAG_PULL_DOWN) ? 0xAAAAAAAA : 0);
+
+	for(index = 0; index < JTAG_PORTS; ++index)
+	{
+		uint32_t unused = jtag_PortSpread[index] & ~jtag_PortUsed[index];
+
+		GPIO_PUPDR(jtag_Ports[index]) = (GPIO_PUPDR(jtag_Ports[index]) & ~unused) | (pulls & unused);
+	}
+
+	//the pulls are weak, give any capacitance on the line time to charge
+	jtag_Delay(JTAG_CLOCK_DELAY);
+	data = jtag_ReadPins();
+
+	for(index = 0; index < JTAG_PORTS; ++index)
+	{
+		GPIO_PUPDR(jtag_Ports[index]) &= ~jtag_PortSpread[index];
 	}
+	return data;
 }
 
 /**
@@ -19,8 +19,17 @@
 #define _JTAG_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #define JTAG_SIGNAL_NOT_ALLOCATED	(-1)	///< Flag for deallocating a signal
-#define JTAG_PIN_MAX			(16)	///< Maximum number of signals supported
+#define JTAG_PIN_MAX			(40)	///< Maximum number of signals supported
+
+#define JTAG_CLOCK_DELAY		(8000)	///< Delay loop count of half a TCK period at 1kHz, 4 cycles a loop at 64MHz
+#define JTAG_CLOCK_KHZ_MAX		(JTAG_CLOCK_DELAY)	///< Fastest TCK rate that can be set, in kHz
+#define JTAG_OVERSAMPLE_MAX		(5)	///< Most reads TDO can be voted over
+#define JTAG_OVERSAMPLE_GAP		(2)	///< Delay loop count between TDO reads
+
+typedef uint64_t jtag_PinMask;		///< Bit mask of pins, bit n is pin n
+#define JTAG_PIN(n)	((jtag_PinMask)1 << (n))	///< Mask of a single pin
 
 typedef enum jtag_eSignal
 {
@@ -34,15 +43,37 @@ typedef enum jtag_eSignal
 	JTAG_SIGNAL_MAX
 } jtag_Signal;
 
+typedef enum jtag_ePull
+{
+	JTAG_PULL_NONE = 0,		///< Leave the pin floating
+	JTAG_PULL_UP,			///< Weak pull up
+	JTAG_PULL_DOWN,			///< Weak pull down
+} jtag_Pull;
+
 extern const char * const jtag_SignalNames[JTAG_SIGNAL_MAX];
 
 extern void jtag_Init();
 
 extern bool jtag_Cfg(jtag_Signal sig, int num);
+extern bool jtag_CfgAll(const int map[JTAG_SIGNAL_MAX]);
 extern int jtag_GetCfg(jtag_Signal sig);
 extern void jtag_Set(jtag_Signal sig, bool val);
+extern void jtag_SetDirection(jtag_Signal sig, bool output);
 extern bool jtag_Get(jtag_Signal sig);
 extern bool jtag_IsAllocated(jtag_Signal sig);
 extern void jtag_Clock();
+extern uint32_t jtag_GetClockCount();
+extern void jtag_AddClocks(uint32_t count);
+extern bool jtag_GetSignalPort(jtag_Signal sig, uint32_t *port, uint16_t *bit);
+extern jtag_PinMask jtag_ReadPins();
+extern jtag_PinMask jtag_SamplePins(jtag_Pull pull);
+extern bool jtag_SetClockRate(unsigned int khz);
+extern unsigned int jtag_GetClockRate();
+extern unsigned int jtag_GetClockDelay();
+extern bool jtag_SetSamplePhase(unsigned int phase);
+extern unsigned int jtag_GetSamplePhase();
+extern bool jtag_SetOversample(unsigned int reads);
+extern unsigned int jtag_GetOversample();
+extern uint32_t jtag_Shift(uint32_t tdi, unsigned int bits);
 
 #endif
@@ -20,19 +20,158 @@
 #include "knock.h"
 #include "message.h"
 #include "chain.h"
+#include "systime.h"
+#include "results.h"
+#include "scanlog.h"
+#include "capture.h"
+#include "swd.h"
 #include <stdint.h>
+#include <stddef.h>
 
-#include <libopencm3/stm32/gpio.h>	//for IO port access
-
-#define KNOCK_RESULTS		(1024)		///< Number of results to store per run (max)
+#define KNOCK_EVENTS		(512)		///< Number of pin group changes to store per run (max), 4 bytes each
+#define KNOCK_MAX_CLOCKS	(32768)		///< Number of clocks to record per run (max)
 #define KNOCK_UNCHANGED		(48)		///< Number of results to store for unchanging inputs, has to be longer than an ID CODE
+#define KNOCK_PAIRS_PER_TICK	(1)		///< Number of TCK/TMS pairs scanned per call to knock_Task()
+#define KNOCK_RESET_DELAY	(50)		///< Milliseconds a reset is held for, and given to recover
+#define KNOCK_CONFIRM_BURSTS	(5)		///< Most confirmation bursts run on a potential TDI
+#define KNOCK_CONFIRM_PASSES	(3)		///< Bursts that have to see the marker to accept a TDI
+
+//TMS sequences, sent LSB first
+#define KNOCK_TMS_RESET		(0x1F)		///< 5 clocks, any state to Test-Logic-Reset
+#define KNOCK_TMS_TO_DR_SHIFT	(0x02)		///< 4 clocks, Test-Logic-Reset to Shift-DR
+#define KNOCK_TMS_TO_IR_SHIFT	(0x06)		///< 5 clocks, Test-Logic-Reset to Shift-IR
+
+static bool knock_ScanPair(knock_Mode mode, unsigned int tck, unsigned int tms);
+static bool knock_Report(knock_Mode mode, unsigned int tck, unsigned int tms, unsigned int tdi, unsigned int tdo, unsigned int confidence);
+static bool knock_IsLayoutPair(unsigned int tck, unsigned int tms);
+static bool knock_NextPair(unsigned int *tck, unsigned int *tms);
+static void knock_Finish();
+static unsigned int knock_GetETA();
+static bool knock_ScanReset(unsigned int tck, unsigned int tms);
+static bool knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, jtag_PinMask pins);
+static bool knock_ScanResetConfirmTDI(unsigned int tdo);
+static unsigned int knock_ScanResetScoreTDI(unsigned int tck, unsigned int tms, unsigned int tdi, unsigned int tdo, bool toggled);
+static bool knock_ScanBypass(unsigned int tck, unsigned int tms);
+static bool knock_ScanSWD(unsigned int swclk, unsigned int swdio);
+static bool knock_ReportSWD(unsigned int swclk, unsigned int swdio, uint32_t dpidr);
+static void knock_ReleaseSignals();
+static void knock_Assign(int tck, int tms, int tdi, int tdo);
+static jtag_PinMask knock_Fingerprint(bool incremental);
+static unsigned int knock_GetPairState(unsigned int tck, unsigned int tms);
+static bool knock_ConfigureBest();
+static void knock_ClockTMS(uint32_t tms, unsigned int count);
+static uint32_t knock_ReadSignature();
+static uint32_t knock_ReadParked(bool pulse);
+static bool knock_TestTRST(unsigned int pin, uint32_t signature);
+static void knock_HoldSRST(unsigned int pin);
+static void knock_ReleaseSRST(bool found);
+static void knock_ResetTask();
+static void knock_Done();
+static void knock_Delay(uint32_t ms);
+static void knock_SetPairState(unsigned int tck, unsigned int tms, unsigned int state);
+
+/**
+ * @brief A common debug header pinout
+ *
+ * Pin numbers are the 1 based header pin numbers. They are tried as knocker
+ * pins on the assumption that header pin 1 is wired to pin 1, pin 2 to pin 2
+ * and so on.
+ */
+typedef struct knock_sLayout {
+	const char *name;	///< Name of the header
+	unsigned int tck;	///< Header pin TCK is on
+	unsigned int tms;	///< Header pin TMS is on
+} knock_Layout;
+
+static const knock_Layout knock_Layouts[] = {
+	{ "ARM 20-pin",		9,	7 },
+	{ "ARM 10-pin Cortex",	4,	2 },
+	{ "TI 14-pin",		11,	1 },
+	{ "Altera 10-pin",	1,	5 },
+};
+
+#define KNOCK_LAYOUTS (sizeof(knock_Layouts)/sizeof(knock_Layout))	///< Number of known header layouts
+
+/**
+ * @brief Position of a scan, the next TCK/TMS pair to be tried
+ */
+typedef struct knock_sCursor {
+	unsigned int layout;	///< Next entry in #knock_Layouts, KNOCK_LAYOUTS once they're done
+	unsigned int tck;	///< Next TCK pin of the exhaustive search
+	unsigned int tms;	///< Next TMS pin of the exhaustive search
+} knock_Cursor;
+
+/**
+ * @brief What the last scan of a TCK/TMS pair came up with
+ *
+ * Kept as 2 bits per pair in #knock_PairStates.
+ */
+typedef enum knock_ePairState {
+	KNOCK_PAIR_UNTESTED = 0,	///< Still has to be scanned
+	KNOCK_PAIR_EXCLUDED,		///< Nothing responded on any pin
+	KNOCK_PAIR_INCONCLUSIVE,	///< Something responded, but no chain was reported
+	KNOCK_PAIR_HIT,			///< A potential chain was reported
+} knock_PairState;
+
+/**
+ * @brief What knock_Task() is working on
+ */
+typedef enum knock_eStep {
+	KNOCK_STEP_SCAN,		///< Scanning TCK/TMS pairs
+	KNOCK_STEP_PIN,			///< Trying the next pin as a reset pin
+	KNOCK_STEP_SRST_HELD,		///< Holding the pin being tried as SRST low
+	KNOCK_STEP_SRST_RELEASED,	///< Giving the target time to come out of reset
+} knock_Step;
 
-static void knock_ScanReset(unsigned int tck, unsigned int tms);
-static void knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, uint16_t pins, uint16_t tdi_state, unsigned int nresuts);
-static void knock_ScanBypass(unsigned int tck, unsigned int tms);
+#define KNOCK_PULL_IDLE		(1 << 0)	///< Fingerprint bit, level with no pull
+#define KNOCK_PULL_UP		(1 << 1)	///< Fingerprint bit, level when pulled up
+#define KNOCK_PULL_DOWN		(1 << 2)	///< Fingerprint bit, level when pulled down
 
 //configuration information
 static unsigned int knock_PinCount;
+static unsigned int knock_Options;
+static knock_Mode knock_ScanMode;
+
+//scan state
+static bool knock_Running;			///< A scan is being worked on by knock_Task()
+static bool knock_Resumable;			///< An aborted scan can be picked up again
+static bool knock_Found;			///< A chain has been confirmed during the scan
+static knock_Cursor knock_Position;		///< Checkpoint of the scan
+static unsigned int knock_PairsDone;		///< Number of TCK/TMS pairs tried so far
+static unsigned int knock_Hits;			///< Number of potential chains seen so far
+static uint32_t knock_Elapsed;			///< Milliseconds spent scanning so far
+static uint32_t knock_PairClocks;		///< Clock count when the current pair was started
+static unsigned int knock_PairsTotal;		///< Number of TCK/TMS pairs that need scanning
+static bool knock_PairActivity;			///< Something responded to the current pair
+static bool knock_PairReported;			///< A potential chain was reported for the current pair
+static knock_Step knock_State;			///< What knock_Task() is working on
+static bool knock_BestFound;			///< A chain has been confirmed by this scan
+static results_Hit knock_Best;			///< Best chain confirmed by this scan
+
+//search for the reset pins of the best chain
+static unsigned int knock_ResetPin;		///< Next pin to try as a reset pin
+static uint32_t knock_Signature;		///< What the chain reads back after a TAP reset
+static bool knock_TRSTTestable;			///< The chain reads back differently without a TAP reset
+static bool knock_TRSTFound;			///< TRST has been found
+static bool knock_SRSTFound;			///< SRST has been found
+static uint32_t knock_StepTime;			///< When the current reset step started
+
+//memory of previous scans, for incremental scans
+static bool knock_History;			///< The pair states belong to a previous scan
+static knock_Mode knock_HistoryMode;		///< Mode of the scan the pair states came from
+static unsigned int knock_HistoryPins;		///< Pin count of the scan the pair states came from
+static uint8_t knock_PairStates[(JTAG_PIN_MAX * JTAG_PIN_MAX) / 4];	///< #knock_PairState of every TCK/TMS pair
+static uint8_t knock_Fingerprints[JTAG_PIN_MAX];	///< KNOCK_PULL_xxx levels of each pin
+
+//recording of the reset scan
+static scanlog_Event knock_Events[KNOCK_EVENTS];	///< Storage for knock_Log
+static scanlog_Log knock_Log;				///< Pin states of each clock of the current reset scan
+
+const char * const knock_ModeNames[KNOCK_MODE_MAX] = {
+	[KNOCK_MODE_RESET] = "reset",
+	[KNOCK_MODE_BYPASS] = "bypass",
+	[KNOCK_MODE_SWD] = "swd",
+};
 static const unsigned int knock_IRShiftCount = 100;
 
 /**
@@ -42,46 +181,53 @@ static const unsigned int knock_IRShiftCount = 100;
  * out the data register, either getting an ID CODE, a BYPASS or garbage. It
  * will attempt to analyse the results to see if it's a valid result.
  *
+ * The pins are normally sampled after every clock. With #KNOCK_OPTION_CAPTURE
+ * the edges on the other pins are logged by interrupt instead and the loop
+ * only has to clock.
+ *
  * @param[in] tck The pin the TCK signal is on, for scanning
  * @param[in] tms The pin the TMS signal is on, for scanning
+ * @retval true A chain was confirmed on these pins
  */
-static void knock_ScanReset(unsigned int tck, unsigned int tms)
+static bool knock_ScanReset(unsigned int tck, unsigned int tms)
 {
+	bool found = false;
 	unsigned int count;
-	int unchanged_count = -1;	//the first time through always results in a unchanged count
-	uint16_t data, data_changed = 0x0000;
-	uint16_t prev_data;
-	uint16_t data_interesting = 0x0000;
-	uint16_t scan_results[KNOCK_RESULTS];
+	jtag_PinMask data_interesting;
+
+	scanlog_Init(&knock_Log, knock_Events, KNOCK_EVENTS);
 
 	jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
 	jtagTAP_SetState(JTAGTAP_STATE_DR_SHIFT);
 
-	prev_data = GPIOD_IDR;
-	for(count = 0; count < KNOCK_RESULTS; ++count)
+	if((knock_Options & KNOCK_OPTION_CAPTURE) != 0)
 	{
-		data = GPIOD_IDR;
-		data_changed = data ^ prev_data;
-		data_interesting |= data_changed;
-
-		prev_data = data;
-
-		scan_results[count] = data;
-
-		jtag_Clock();
-
-		if(data_changed == 0)
+		capture_Start(&knock_Log, (JTAG_PIN(knock_PinCount) - 1) & ~(JTAG_PIN(tck) | JTAG_PIN(tms)));
+		while((scanlog_GetSamples(&knock_Log) < KNOCK_MAX_CLOCKS) && !capture_IsFull())
 		{
-			if(++unchanged_count == KNOCK_UNCHANGED)
+			jtag_Clock();
+
+			if(capture_Update() >= KNOCK_UNCHANGED)
 			{
 				break;
 			}
 		}
-		else
+		capture_Stop();
+	}
+	else
+	{
+		while((scanlog_GetSamples(&knock_Log) < KNOCK_MAX_CLOCKS) && scanlog_Record(&knock_Log, jtag_ReadPins()))
 		{
-			unchanged_count = 0;	//something changed, reset the count.
+			jtag_Clock();
+
+			if(scanlog_GetUnchanged(&knock_Log) == KNOCK_UNCHANGED)
+			{
+				break;
+			}
 		}
 	}
+	count = scanlog_GetSamples(&knock_Log);
+	data_interesting = scanlog_GetChanged(&knock_Log);
 
 	if(data_interesting != 0)
 	{
@@ -93,12 +239,14 @@ static void knock_ScanReset(unsigned int tck, unsigned int tms)
 			{
 				//this line changed
 				unsigned int index;
+				scanlog_Reader reader;
 
-				data_interesting &= ~(1 << bit);	//mask off this bit, until it proves itself
+				data_interesting &= ~JTAG_PIN(bit);	//mask off this bit, until it proves itself
 
+				scanlog_Begin(&reader, &knock_Log);
 				for(index = 0; index < count; ++index)
 				{
-					if((((scan_results[index] >> bit) & 0x01) == 1) && (count - index >= 32))
+					if((((scanlog_Next(&reader) >> bit) & 0x01) == 1) && (count - index >= 32))
 					{
 						//this could be a potential ID CODE, get it
 						uint32_t idcode = 0x80000000;
@@ -106,11 +254,11 @@ static void knock_ScanReset(unsigned int tck, unsigned int tms)
 						while(++index < code_end)
 						{
 							idcode >>= 1;
-							idcode |= ((scan_results[index] >> bit) & 0x01) << 31;
+							idcode |= ((scanlog_Next(&reader) >> bit) & 0x01) << 31;
 						}
 						if((idcode != 0xFFFFFFFF))
 						{
-							data_interesting |= (1 << bit);		//this is interesting, keep it
+							data_interesting |= JTAG_PIN(bit);	//this is interesting, keep it
 						}
 						--index; //fixup
 					}
@@ -118,8 +266,10 @@ static void knock_ScanReset(unsigned int tck, unsigned int tms)
 
 			}
 		}
-		knock_ScanResetFindTDI(tck, tms, data_interesting, scan_results[count-1], count);
+		knock_PairActivity = (data_interesting != 0);
+		found = knock_ScanResetFindTDI(tck, tms, data_interesting);
 	}
+	return found;
 }
 
 /**
@@ -129,17 +279,19 @@ static void knock_ScanReset(unsigned int tck, unsigned int tms)
  * TDO, try and find TDI.
  *
  * The TAP is currently in JTAGTAP_STATE_DR_SHIFT and the shift registers are
- * full of whatever TDI is set to.
+ * full of whatever TDI is set to. The last sample in knock_Log holds the
+ * idle state of every pin, which is what a potential TDI gets toggled from.
  *
  * @param[in] tck The pin that TCK is on.
  * @param[in] tms The pin that TMS is on.
  * @param[in] pins A bitmask of potential TDOs.
- * @param[in] tdi_state The current state of all pins.
- * @param[in] nresults The number of results in the scan_results array.
+ * @retval true A chain was confirmed
  */
-static void knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, uint16_t pins, uint16_t tdi_state, unsigned int nresults)
+static bool knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, jtag_PinMask pins)
 {
+	bool confirmed = false;
 	unsigned int tdo;
+	jtag_PinMask tdi_state = scanlog_GetLast(&knock_Log);
 
 	for(tdo = 0; tdo < knock_PinCount; ++tdo)
 	{
@@ -150,47 +302,122 @@ static void knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, uint16_t
 			//look for pins that match the value above
 			for(tdi = 0; tdi < knock_PinCount; ++tdi)
 			{
-				if((tdi != tck) && (tdi != tms) && (tdi != tdo))
+				if(confirmed && ((knock_Options & KNOCK_OPTION_FIRST) != 0))
 				{
-					//we aren't already using this pin
-					unsigned int clocks, changes = 0;
-					unsigned int prev_tdo_val = (GPIOD_IDR & (1 << tdo));
-
-					jtag_Cfg(JTAG_SIGNAL_TDI, tdi);
-					jtag_Set(JTAG_SIGNAL_TDI, ((tdi_state >> tdi) & 1) == 0);	//toggle the TDI pin
-
-					for(clocks = 0; clocks < nresults; ++clocks)
-					{
-						unsigned int tdo_val = (GPIOD_IDR & (1 << tdo));
-						jtag_Clock();
+					break;	//only the first chain was wanted
+				}
 
-						if((tdo_val ^ prev_tdo_val) != 0)
-						{
-							++changes;
-						}
-						prev_tdo_val = tdo_val;
-					}
+				if((tdi != tck) && (tdi != tms) && (tdi != tdo))
+				{
+					unsigned int confidence;
 
-					//reset the pin state and clock again, undoing what we just did
-					jtag_Set(JTAG_SIGNAL_TDI, ((tdi_state >> tdi) & 1) == 1);	//toggle the TDI pin
-					for(clocks = 0; clocks < nresults; ++clocks)
-					{
-						jtag_Clock();
-					}
+					//we aren't already using this pin
+					knock_Assign(tck, tms, tdi, JTAG_SIGNAL_NOT_ALLOCATED);
+					confidence = knock_ScanResetScoreTDI(tck, tms, tdi, tdo, ((tdi_state >> tdi) & 1) == 0);
 
-					if(changes == 1)
+					if((confidence > 0) && knock_Report(KNOCK_MODE_RESET, tck, tms, tdi, tdo, confidence))
 					{
-						message_Write(MESSAGE_LEVEL_GENERAL, "[!] Potential Chain: TCK: %i TMS: %i TDO: %i TDI: %i\r\n", tck, tms, tdo, tdi);
-						jtag_Cfg(JTAG_SIGNAL_TDO, tdo);
-						chain_Detect();
+						confirmed = true;
 					}
 
-					jtag_Cfg(JTAG_SIGNAL_TDI, JTAG_SIGNAL_NOT_ALLOCATED);
-					jtag_Cfg(JTAG_SIGNAL_TDO, JTAG_SIGNAL_NOT_ALLOCATED);
+					knock_Assign(tck, tms, JTAG_SIGNAL_NOT_ALLOCATED, JTAG_SIGNAL_NOT_ALLOCATED);
 				}
 			}
 		}
 	}
+	return confirmed;
+}
+
+/**
+ * @brief Check if the toggled TDI shows up on a potential TDO
+ *
+ * The TAP is reset and moved back into JTAGTAP_STATE_DR_SHIFT, which
+ * replays whatever knock_ScanReset() captured in knock_Log, followed by the
+ * toggled TDI state. TDO is compared against the recorded scan one clock at a
+ * time and the walk stops at the first difference. A TDI is confirmed if that
+ * difference happens after the TDO pin had settled in the recorded scan, as
+ * that is where the marker edge has to come out of the data registers.
+ *
+ * Resetting the TAP is only a handful of clocks, so the data registers don't
+ * have to be clocked back to their previous state afterwards.
+ *
+ * @param[in] tdo The pin to test as TDO.
+ * @retval true The marker edge was seen on TDO.
+ * @retval false TDO didn't follow TDI.
+ */
+static bool knock_ScanResetConfirmTDI(unsigned int tdo)
+{
+	unsigned int clocks;
+	jtag_PinMask tdo_mask = JTAG_PIN(tdo);
+	unsigned int nresults = scanlog_GetSamples(&knock_Log);
+	unsigned int settled = scanlog_GetSettled(&knock_Log, tdo_mask);	//where TDO stopped changing in the recorded scan
+	scanlog_Reader reader;
+	bool found = false;
+
+	jtagTAP_SetState(JTAGTAP_STATE_RESET);
+	jtagTAP_SetState(JTAGTAP_STATE_DR_SHIFT);
+
+	scanlog_Begin(&reader, &knock_Log);
+	for(clocks = 0; clocks < nresults; ++clocks)
+	{
+		if(((jtag_ReadPins() ^ scanlog_Next(&reader)) & tdo_mask) != 0)
+		{
+			//first difference, it has to be the marker
+			found = (clocks >= settled);
+			break;
+		}
+		jtag_Clock();
+	}
+
+	return found;
+}
+
+/**
+ * @brief Run confirmation bursts on a potential TDI
+ *
+ * knock_ScanResetConfirmTDI() is repeated with TDI toggled, up to
+ * KNOCK_CONFIRM_BURSTS times. It stops as soon as KNOCK_CONFIRM_PASSES
+ * bursts have seen the marker, or once that can't happen any more, so a
+ * clean pin costs the minimum and a dead one is dropped early. A hit that
+ * has already been confirmed by chain detection is trusted after a single
+ * burst.
+ *
+ * TDI is left in its untoggled state.
+ *
+ * @param[in] tck The pin TCK is on
+ * @param[in] tms The pin TMS is on
+ * @param[in] tdi The pin TDI is on, and assigned to
+ * @param[in] tdo The pin to test as TDO
+ * @param[in] toggled The TDI state that is different to the recorded scan
+ * @returns The percentage of bursts that saw the marker, 0 if the TDI was
+ * rejected.
+ */
+static unsigned int knock_ScanResetScoreTDI(unsigned int tck, unsigned int tms, unsigned int tdi, unsigned int tdo, bool toggled)
+{
+	unsigned int bursts = KNOCK_CONFIRM_BURSTS;
+	unsigned int needed = KNOCK_CONFIRM_PASSES;
+	unsigned int passes = 0, runs = 0;
+	int index = results_Find(tck, tms, tdi, tdo);
+
+	if((index >= 0) && (results_Get(index)->score >= RESULTS_SCORE_CONFIRMED))
+	{
+		//already trusted, a single burst will do
+		bursts = 1;
+		needed = 1;
+	}
+
+	while((passes < needed) && ((runs - passes) <= (bursts - needed)))
+	{
+		jtag_Set(JTAG_SIGNAL_TDI, toggled);	//toggle the TDI pin
+		if(knock_ScanResetConfirmTDI(tdo))
+		{
+			++passes;
+		}
+		jtag_Set(JTAG_SIGNAL_TDI, !toggled);	//put the TDI pin back
+		++runs;
+	}
+
+	return (passes >= needed) ? ((passes * 100) / runs) : 0;
 }
 
 /**
@@ -201,21 +428,28 @@ static void knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, uint16_t
  *
  * @param[in] tck The pin TCK is on
  * @param[in] tms The pin TMS is on
+ * @retval true A chain was confirmed on these pins
  */
-static void knock_ScanBypass(unsigned int tck, unsigned int tms)
+static bool knock_ScanBypass(unsigned int tck, unsigned int tms)
 {
+	bool confirmed = false;
 	unsigned int tdi, tdo;
 	unsigned int count;
 
 	for(tdi = 0; tdi < knock_PinCount; ++tdi)
 	{
+		if(confirmed && ((knock_Options & KNOCK_OPTION_FIRST) != 0))
+		{
+			break;	//only the first chain was wanted
+		}
+
 		if((tdi != tck) && (tdi !=tms))
 		{
-			uint16_t tdo_candidates;
-			int tdo_change_clocks[16];
+			jtag_PinMask tdo_candidates;
+			int tdo_change_clocks[JTAG_PIN_MAX];
 
 			//we can use this pin
-			jtag_Cfg(JTAG_SIGNAL_TDI, tdi);
+			knock_Assign(tck, tms, tdi, JTAG_SIGNAL_NOT_ALLOCATED);
 			jtag_Set(JTAG_SIGNAL_TDI, true);	//set the pin to a known state
 
 			//put the JTAG TAP into a known state
@@ -226,28 +460,28 @@ static void knock_ScanBypass(unsigned int tck, unsigned int tms)
 			{
 				jtag_Clock();
 			}
-			tdo_candidates = GPIOD_IDR;	//any pin which is set here and changes to
+			tdo_candidates = jtag_ReadPins();	//any pin which is set here and changes to
 							//0 once and stays there is probably TDO
 
 			jtag_Set(JTAG_SIGNAL_TDI, false);
-			for(count = 0; count < 16; ++count)
+			for(count = 0; count < JTAG_PIN_MAX; ++count)
 			{
 				tdo_change_clocks[count] = 0;
 			}
 
 			for(count = 1; count < knock_IRShiftCount; ++count)
 			{
-				uint16_t tdo_sample ;
+				jtag_PinMask tdo_sample;
 				jtag_Clock();
 
-				tdo_sample = GPIOD_IDR;
+				tdo_sample = jtag_ReadPins();
 
 				for(tdo = 0; tdo < knock_PinCount; ++tdo)
 				{
 					//check if this is a candidate pin and not in use
-					if((tdo != tck) && (tdo != tms) && (tdo != tdi) && ((tdo_candidates & (1 << tdo)) != 0))
+					if((tdo != tck) && (tdo != tms) && (tdo != tdi) && ((tdo_candidates & JTAG_PIN(tdo)) != 0))
 					{
-						if((tdo_sample & (1 << tdo)) == 0)
+						if((tdo_sample & JTAG_PIN(tdo)) == 0)
 						{
 							//the pin went low, this is good
 							if(tdo_change_clocks[tdo] == 0)
@@ -266,12 +500,17 @@ static void knock_ScanBypass(unsigned int tck, unsigned int tms)
 
 			for(tdo = 0; tdo < knock_PinCount; ++tdo)
 			{
+				if(tdo_change_clocks[tdo] != 0)
+				{
+					knock_PairActivity = true;	//went low at some point
+				}
 				if(tdo_change_clocks[tdo] >= 2)
 				{
-					message_Write(MESSAGE_LEVEL_GENERAL, "[!] Potential Chain: TCK: %i TMS: %i TDO: %i TDI: %i\r\n", tck, tms, tdo, tdi);
-					jtag_Cfg(JTAG_SIGNAL_TDO, tdo);
-					chain_Detect();
-					jtag_Cfg(JTAG_SIGNAL_TDO, JTAG_SIGNAL_NOT_ALLOCATED);
+					if(knock_Report(KNOCK_MODE_BYPASS, tck, tms, tdi, tdo, 100))
+					{
+						confirmed = true;
+					}
+					knock_Assign(tck, tms, tdi, JTAG_SIGNAL_NOT_ALLOCATED);
 				}
 			}
 
@@ -284,57 +523,907 @@ static void knock_ScanBypass(unsigned int tck, unsigned int tms)
 			}
 		}
 	}
+	knock_Assign(tck, tms, JTAG_SIGNAL_NOT_ALLOCATED, JTAG_SIGNAL_NOT_ALLOCATED);
+	return confirmed;
 }
 
 /**
- * @brief Try and find a JTAG chain
+ * @brief Scan for a SWD port
  *
- * Unassignes all signals before scanning. A known pin shouldn't be used
- * in the scan.
+ * Switches a SWJ-DP over from JTAG, resets the line and reads the DP IDR.
+ * An OK ACK with good parity and the read-as-one bit 0 of the IDR set is
+ * taken as a port. A WAIT or FAULT ACK means something answered, but not
+ * well enough to be sure.
+ *
+ * @param[in] swclk The pin SWCLK is on, assigned to TCK
+ * @param[in] swdio The pin SWDIO is on, assigned to TMS
+ * @retval true A port was found on these pins
+ */
+static bool knock_ScanSWD(unsigned int swclk, unsigned int swdio)
+{
+	bool confirmed = false;
+	uint32_t dpidr = 0;
+	unsigned int ack;
+
+	swd_SwitchFromJTAG();
+	ack = swd_ReadDPIDR(&dpidr);
+
+	if((ack == SWD_ACK_OK) && ((dpidr & 0x01) == 1))
+	{
+		confirmed = knock_ReportSWD(swclk, swdio, dpidr);
+	}
+	else if((ack == SWD_ACK_OK) || (ack == SWD_ACK_WAIT) || (ack == SWD_ACK_FAULT) || (ack == SWD_ACK_PARITY))
+	{
+		knock_PairActivity = true;
+	}
+	return confirmed;
+}
+
+/**
+ * @brief Report a SWD port
+ *
+ * A DP IDR read can't happen by chance, so the port goes into the results
+ * as confirmed. Ports that are already known aren't announced again.
+ *
+ * @param[in] swclk The pin SWCLK is on
+ * @param[in] swdio The pin SWDIO is on
+ * @param[in] dpidr The DP IDR that was read
+ * @retval true The port has been confirmed
+ */
+static bool knock_ReportSWD(unsigned int swclk, unsigned int swdio, uint32_t dpidr)
+{
+	results_Hit hit;
+	unsigned int device;
+
+	if(results_Find(swclk, swdio, RESULTS_PIN_NONE, RESULTS_PIN_NONE) < 0)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[!] SWD Port: SWCLK: %i SWDIO: %i DPIDR: %08X\r\n", swclk, swdio, dpidr);
+		++knock_Hits;
+	}
+	knock_PairReported = true;
+
+	hit.tck = swclk;
+	hit.tms = swdio;
+	hit.tdi = RESULTS_PIN_NONE;
+	hit.tdo = RESULTS_PIN_NONE;
+	hit.score = RESULTS_SCORE_CONFIRMED;
+	hit.devices = 1;
+	hit.idcodes[0] = dpidr;
+	for(device = 1; device < RESULTS_MAX_IDCODES; ++device)
+	{
+		hit.idcodes[device] = 0;
+	}
+	hit.modes = 1 << KNOCK_MODE_SWD;
+	hit.clocks = jtag_GetClockCount() - knock_PairClocks;
+	results_Add(&hit);
+
+	return true;
+}
+
+/**
+ * @brief Report a potential chain and try to confirm it
+ *
+ * New hits are announced and checked with chain_Detect(), the outcome is
+ * kept in the results table. A hit that has already been confirmed isn't
+ * checked or announced again, only its modes and clocks are updated. Hits
+ * that chain detection can't confirm are scored by how reliably the scan
+ * saw them, up to RESULTS_SCORE_POTENTIAL.
+ *
+ * TDO is left assigned to the tdo pin.
+ *
+ * @param[in] mode The mode that found the chain
+ * @param[in] tck The pin TCK is on
+ * @param[in] tms The pin TMS is on
+ * @param[in] tdi The pin TDI is on, and assigned to
+ * @param[in] tdo The pin TDO is on
+ * @param[in] confidence Percentage of the scan's checks that saw the chain
+ * @retval true The chain has been confirmed
+ */
+static bool knock_Report(knock_Mode mode, unsigned int tck, unsigned int tms, unsigned int tdi, unsigned int tdo, unsigned int confidence)
+{
+	results_Hit hit;
+	int index = results_Find(tck, tms, tdi, tdo);
+
+	knock_Assign(tck, tms, tdi, tdo);
+
+	if((index >= 0) && (results_Get(index)->score >= RESULTS_SCORE_CONFIRMED))
+	{
+		//already confirmed, just note that this mode found it too
+		hit = *results_Get(index);
+	}
+	else
+	{
+		unsigned int device;
+
+		if(index < 0)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "[!] Potential Chain: TCK: %i TMS: %i TDO: %i TDI: %i\r\n", tck, tms, tdo, tdi);
+			++knock_Hits;
+		}
+		knock_PairReported = true;
+
+		hit.tck = tck;
+		hit.tms = tms;
+		hit.tdi = tdi;
+		hit.tdo = tdo;
+		hit.score = chain_Detect() ? RESULTS_SCORE_CONFIRMED : ((RESULTS_SCORE_POTENTIAL * confidence) / 100);
+		hit.devices = chain_GetDevices();
+		for(device = 0; device < RESULTS_MAX_IDCODES; ++device)
+		{
+			hit.idcodes[device] = chain_GetIDCode(device);
+		}
+	}
+	hit.modes = 1 << mode;
+	hit.clocks = jtag_GetClockCount() - knock_PairClocks;
+	results_Add(&hit);
+
+	if((hit.score >= RESULTS_SCORE_CONFIRMED) && (!knock_BestFound || (hit.score > knock_Best.score)))
+	{
+		knock_Best = hit;
+		knock_BestFound = true;
+	}
+	return (hit.score >= RESULTS_SCORE_CONFIRMED);
+}
+
+/**
+ * @brief Scan a single TCK/TMS pair
+ *
+ * The outcome is remembered in #knock_PairStates for incremental scans.
  *
  * @param[in] mode The scanning mode to use, see #knock_Mode
- * @param[in] pins The number of pins that are wired up, must be >= 4
+ * @param[in] tck The pin to try as TCK
+ * @param[in] tms The pin to try as TMS
+ * @retval true A chain was confirmed on these pins
+ */
+static bool knock_ScanPair(knock_Mode mode, unsigned int tck, unsigned int tms)
+{
+	bool found = false;
+
+	knock_PairClocks = jtag_GetClockCount();
+	knock_PairActivity = false;
+	knock_PairReported = false;
+	message_Write(MESSAGE_LEVEL_DEBUG, "Trying TCK: %i TMS: %i\r", tck, tms);
+	//assign the JTAG signals for this iteration
+	knock_Assign(tck, tms, JTAG_SIGNAL_NOT_ALLOCATED, JTAG_SIGNAL_NOT_ALLOCATED);
+	switch(mode)
+	{
+		case KNOCK_MODE_RESET:
+			found = knock_ScanReset(tck, tms);
+			break;
+
+		case KNOCK_MODE_BYPASS:
+			found = knock_ScanBypass(tck, tms);
+			break;
+
+		case KNOCK_MODE_SWD:
+			found = knock_ScanSWD(tck, tms);
+			break;
+
+		default:
+			break;
+	}
+	//unassign the signals
+	knock_ReleaseSignals();
+
+	if(knock_PairReported)
+	{
+		knock_SetPairState(tck, tms, KNOCK_PAIR_HIT);
+	}
+	else
+	{
+		knock_SetPairState(tck, tms, knock_PairActivity ? KNOCK_PAIR_INCONCLUSIVE : KNOCK_PAIR_EXCLUDED);
+	}
+	return found;
+}
+
+/**
+ * @brief Get the #knock_PairState of a TCK/TMS pair
+ */
+static unsigned int knock_GetPairState(unsigned int tck, unsigned int tms)
+{
+	unsigned int pair = (tck * JTAG_PIN_MAX) + tms;
+
+	return (knock_PairStates[pair / 4] >> ((pair % 4) * 2)) & 0x03;
+}
+
+/**
+ * @brief Set the #knock_PairState of a TCK/TMS pair
+ */
+static void knock_SetPairState(unsigned int tck, unsigned int tms, unsigned int state)
+{
+	unsigned int pair = (tck * JTAG_PIN_MAX) + tms;
+	unsigned int shift = (pair % 4) * 2;
+
+	knock_PairStates[pair / 4] = (knock_PairStates[pair / 4] & ~(0x03 << shift)) | (state << shift);
+}
+
+/**
+ * @brief Check if a TCK/TMS pair is tried by one of the known layouts
+ *
+ * @param[in] tck The pin TCK is on
+ * @param[in] tms The pin TMS is on
+ * @retval true The pair was already tried in the layout pass
+ */
+static bool knock_IsLayoutPair(unsigned int tck, unsigned int tms)
+{
+	bool retval = false;
+	unsigned int layout;
+
+	for(layout = 0; !retval && (layout < KNOCK_LAYOUTS); ++layout)
+	{
+		retval = ((knock_Layouts[layout].tck - 1) == tck) && ((knock_Layouts[layout].tms - 1) == tms);
+	}
+	return retval;
+}
+
+/**
+ * @brief Get the next TCK/TMS pair to scan
+ *
+ * The TCK/TMS pairs of the common header layouts in #knock_Layouts come
+ * first, followed by every other pair in numeric order. The position is
+ * kept in knock_Position so a scan can be picked up where it was left.
+ * Pairs that aren't #KNOCK_PAIR_UNTESTED are passed over.
+ *
+ * @param[out] tck The pin to try as TCK
+ * @param[out] tms The pin to try as TMS
+ * @retval true A pair was returned
+ * @retval false Every pair has been tried
+ */
+static bool knock_NextPair(unsigned int *tck, unsigned int *tms)
+{
+	bool found = false;
+
+	//the common header layouts are the most likely, try those first
+	while(!found && (knock_Position.layout < KNOCK_LAYOUTS))
+	{
+		const knock_Layout *layout = &knock_Layouts[knock_Position.layout++];
+
+		if(((layout->tck - 1) < knock_PinCount) && ((layout->tms - 1) < knock_PinCount)
+			&& (knock_GetPairState(layout->tck - 1, layout->tms - 1) == KNOCK_PAIR_UNTESTED))
+		{
+			message_Write(MESSAGE_LEVEL_VERBOSE, "Trying %s layout\r\n", layout->name);
+			*tck = layout->tck - 1;
+			*tms = layout->tms - 1;
+			found = true;
+		}
+	}
+
+	//fall back to trying everything else
+	while(!found && (knock_Position.tck < knock_PinCount))
+	{
+		*tck = knock_Position.tck;
+		*tms = knock_Position.tms;
+
+		if(++knock_Position.tms >= knock_PinCount)
+		{
+			knock_Position.tms = 0;
+			++knock_Position.tck;
+		}
+
+		found = (*tck != *tms) && !knock_IsLayoutPair(*tck, *tms) && (knock_GetPairState(*tck, *tms) == KNOCK_PAIR_UNTESTED);
+	}
+	return found;
+}
+
+/**
+ * @brief Unassign all the signals
  */
-void knock_Scan(knock_Mode mode, unsigned int pins)
+static void knock_ReleaseSignals()
 {
-	unsigned int tck, tms;
+	knock_Assign(JTAG_SIGNAL_NOT_ALLOCATED, JTAG_SIGNAL_NOT_ALLOCATED, JTAG_SIGNAL_NOT_ALLOCATED, JTAG_SIGNAL_NOT_ALLOCATED);
+}
+
+/**
+ * @brief Assign the JTAG signals for a permutation
+ *
+ * All the signals are switched at once with jtag_CfgAll(), the others are
+ * unassigned.
+ *
+ * @param[in] tck The pin for TCK, or JTAG_SIGNAL_NOT_ALLOCATED
+ * @param[in] tms The pin for TMS, or JTAG_SIGNAL_NOT_ALLOCATED
+ * @param[in] tdi The pin for TDI, or JTAG_SIGNAL_NOT_ALLOCATED
+ * @param[in] tdo The pin for TDO, or JTAG_SIGNAL_NOT_ALLOCATED
+ */
+static void knock_Assign(int tck, int tms, int tdi, int tdo)
+{
+	int map[JTAG_SIGNAL_MAX];
 	jtag_Signal sig;
-	knock_PinCount = pins;
 
-	//unassign all signals
 	for(sig = JTAG_SIGNAL_TCK; sig < JTAG_SIGNAL_MAX; ++sig)
 	{
-		jtag_Cfg(sig, JTAG_SIGNAL_NOT_ALLOCATED);
+		map[sig] = JTAG_SIGNAL_NOT_ALLOCATED;
 	}
+	map[JTAG_SIGNAL_TCK] = tck;
+	map[JTAG_SIGNAL_TMS] = tms;
+	map[JTAG_SIGNAL_TDI] = tdi;
+	map[JTAG_SIGNAL_TDO] = tdo;
+	jtag_CfgAll(map);
+}
 
-	message_Write(MESSAGE_LEVEL_GENERAL, "Scanning for JTAG port...\r\n");
+/**
+ * @brief Fingerprint the pins and work out which pairs need scanning
+ *
+ * Each pin is read floating, pulled up and pulled down, which tells a driven
+ * pin from a floating one and catches most wiring changes. For a full scan
+ * every pair is marked #KNOCK_PAIR_UNTESTED. For an incremental one only the
+ * pairs that could have been affected by a changed pin are: excluded pairs
+ * when their TCK or TMS changed, inconclusive pairs when any pin changed,
+ * since they depend on the TDI/TDO pins as well. Hits are always re-tested,
+ * so their results stay current.
+ *
+ * All signals have to be unassigned.
+ *
+ * @param[in] incremental Keep the state of pairs on unchanged pins
+ * @returns Bitmask of the pins whose fingerprint changed.
+ */
+static jtag_PinMask knock_Fingerprint(bool incremental)
+{
+	jtag_PinMask idle = jtag_SamplePins(JTAG_PULL_NONE);
+	jtag_PinMask up = jtag_SamplePins(JTAG_PULL_UP);
+	jtag_PinMask down = jtag_SamplePins(JTAG_PULL_DOWN);
+	jtag_PinMask changed = 0;
+	unsigned int pin, tck, tms;
+
+	for(pin = 0; pin < knock_PinCount; ++pin)
+	{
+		uint8_t print = 0;
+
+		print |= ((idle >> pin) & 0x01) ? KNOCK_PULL_IDLE : 0;
+		print |= ((up >> pin) & 0x01) ? KNOCK_PULL_UP : 0;
+		print |= ((down >> pin) & 0x01) ? KNOCK_PULL_DOWN : 0;
+		if(print != knock_Fingerprints[pin])
+		{
+			changed |= JTAG_PIN(pin);
+			knock_Fingerprints[pin] = print;
+		}
+	}
+
+	knock_PairsTotal = 0;
 	for(tck = 0; tck < knock_PinCount; ++tck)
 	{
-		message_Write(MESSAGE_LEVEL_VERBOSE, "Trying TCK: %i\r", tck);
 		for(tms = 0; tms < knock_PinCount; ++tms)
 		{
-			if(tck != tms)
+			unsigned int state = knock_GetPairState(tck, tms);
+			bool retest = !incremental || (state == KNOCK_PAIR_UNTESTED) || (state == KNOCK_PAIR_HIT) || (changed != 0);
+
+			if(state == KNOCK_PAIR_EXCLUDED)
+			{
+				retest = !incremental || ((changed & (JTAG_PIN(tck) | JTAG_PIN(tms))) != 0);
+			}
+			if(retest)
 			{
-				message_Write(MESSAGE_LEVEL_DEBUG, "Trying TCK: %i TMS: %i\r", tck, tms);
-				//assign the JTAG signals for this iteration
-				jtag_Cfg(JTAG_SIGNAL_TCK, tck);
-				jtag_Cfg(JTAG_SIGNAL_TMS, tms);
-				switch(mode)
+				knock_SetPairState(tck, tms, KNOCK_PAIR_UNTESTED);
+				if(tck != tms)
 				{
-					case KNOCK_MODE_RESET:
-						knock_ScanReset(tck, tms);
-						break;
-
-					case KNOCK_MODE_BYPASS:
-						knock_ScanBypass(tck, tms);
-						break;
+					++knock_PairsTotal;
 				}
-				//unassign the signals
-				jtag_Cfg(JTAG_SIGNAL_TCK, JTAG_SIGNAL_NOT_ALLOCATED);
-				jtag_Cfg(JTAG_SIGNAL_TMS, JTAG_SIGNAL_NOT_ALLOCATED);
 			}
 		}
 	}
+	return changed;
+}
+
+/**
+ * @brief Start looking for a JTAG chain
+ *
+ * Unassignes all signals before scanning. A known pin shouldn't be used
+ * in the scan. The scan itself is done a few pairs at a time by
+ * knock_Task().
+ *
+ * With #KNOCK_OPTION_FIRST the scan stops once a chain has been confirmed.
+ * With #KNOCK_OPTION_INCREMENTAL only the pairs that may have changed since
+ * the last scan with the same mode and number of pins are scanned, see
+ * knock_Fingerprint(). Hits from the skipped pairs stay in the results.
+ *
+ * @param[in] mode The scanning mode to use, see #knock_Mode
+ * @param[in] pins The number of pins that are wired up, must be >= 4
+ * @param[in] options Bitmask of KNOCK_OPTION_xxx flags
+ */
+void knock_Start(knock_Mode mode, unsigned int pins, unsigned int options)
+{
+	bool incremental = false;
+	jtag_PinMask changed;
+
+	knock_PinCount = pins;
+	knock_Options = options;
+	knock_ScanMode = mode;
+
+	knock_Position.layout = 0;
+	knock_Position.tck = 0;
+	knock_Position.tms = 0;
+	knock_PairsDone = 0;
+	knock_Hits = 0;
+	knock_Elapsed = 0;
+	knock_Found = false;
+	knock_BestFound = false;
+	knock_State = KNOCK_STEP_SCAN;
+
+	if((options & KNOCK_OPTION_INCREMENTAL) != 0)
+	{
+		incremental = knock_History && (knock_HistoryMode == mode) && (knock_HistoryPins == pins);
+		if(!incremental)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "No previous %s scan of %i pins, scanning every pair.\r\n", knock_ModeNames[mode], pins);
+		}
+	}
+
+	if(((options & KNOCK_OPTION_CAPTURE) != 0) && (pins > CAPTURE_PIN_MAX))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Edge capture only covers the first %i pins, sampling instead.\r\n", CAPTURE_PIN_MAX);
+		knock_Options &= ~KNOCK_OPTION_CAPTURE;
+	}
+
+	knock_ReleaseSignals();
+	changed = knock_Fingerprint(incremental);
+	knock_History = true;
+	knock_HistoryMode = mode;
+	knock_HistoryPins = pins;
+
+	if(incremental)
+	{
+		unsigned int pin, count = 0;
+
+		for(pin = 0; pin < pins; ++pin)
+		{
+			count += (changed >> pin) & 0x01;
+		}
+		message_Write(MESSAGE_LEVEL_GENERAL, "%i pins changed, re-testing %i of %i pairs.\r\n", count, knock_PairsTotal, pins * (pins - 1));
+	}
+
+	message_Write(MESSAGE_LEVEL_GENERAL, "Scanning for JTAG port...\r\n");
+	knock_Resume();
+}
+
+/**
+ * @brief Carry on with an aborted scan
+ *
+ * The scan continues from the pair after the last one completed.
+ *
+ * @retval true The scan has been resumed
+ * @retval false There is no scan to resume
+ */
+bool knock_Resume()
+{
+	if(!knock_Running && (knock_PinCount >= 4) && (knock_Position.tck < knock_PinCount))
+	{
+		knock_ReleaseSignals();
+		knock_Running = true;
+		knock_Resumable = false;
+	}
+	return knock_Running;
+}
+
+/**
+ * @brief Re-scan the pairs that may have changed since the last scan
+ *
+ * Uses the mode, number of pins and options of the last scan.
+ *
+ * @retval true The scan has been started
+ * @retval false There hasn't been a scan yet
+ */
+bool knock_Incremental()
+{
+	bool success = false;
+
+	if(knock_History && !knock_Running)
+	{
+		knock_Start(knock_HistoryMode, knock_HistoryPins, knock_Options | KNOCK_OPTION_INCREMENTAL);
+		success = true;
+	}
+	return success;
+}
+
+/**
+ * @brief Stop the current scan
+ *
+ * The position is kept so that knock_Resume() can carry on later.
+ *
+ * @retval true A scan was aborted
+ */
+bool knock_Abort()
+{
+	bool aborted = knock_Running;
+
+	if(aborted && (knock_State == KNOCK_STEP_SCAN))
+	{
+		knock_Running = false;
+		knock_Resumable = true;
+		message_Write(MESSAGE_LEVEL_GENERAL, "Scan aborted after %i of %i pairs.\r\n", knock_PairsDone, knock_PairsTotal);
+	}
+	else if(aborted)
+	{
+		//the scan is over, stop looking for the reset pins
+		if(knock_State != KNOCK_STEP_PIN)
+		{
+			jtag_Set(JTAG_SIGNAL_SRST, true);
+			jtag_Cfg(JTAG_SIGNAL_SRST, JTAG_SIGNAL_NOT_ALLOCATED);
+		}
+		jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
+		knock_Running = false;
+		knock_State = KNOCK_STEP_SCAN;
+		message_Write(MESSAGE_LEVEL_GENERAL, "Reset pin search aborted.\r\n");
+	}
+	return aborted;
+}
+
+/**
+ * @brief Check if a scan is in progress
+ */
+bool knock_IsRunning()
+{
+	return knock_Running;
+}
+
+/**
+ * @brief Estimate the number of seconds left in the scan
+ */
+static unsigned int knock_GetETA()
+{
+	unsigned int total = knock_PairsTotal;
+	unsigned int eta = 0;
+
+	if((knock_PairsDone > 0) && (knock_PairsDone < total))
+	{
+		eta = ((knock_Elapsed / knock_PairsDone) * (total - knock_PairsDone)) / 1000;
+	}
+	return eta;
+}
+
+/**
+ * @brief Get the progress of the current or last scan
+ *
+ * @param[out] progress Filled in with the progress.
+ */
+void knock_GetProgress(knock_Progress *progress)
+{
+	progress->done = knock_PairsDone;
+	progress->total = knock_PairsTotal;
+	progress->hits = knock_Hits;
+	progress->eta = knock_GetETA();
+	progress->running = knock_Running;
+	progress->resumable = knock_Resumable;
+}
+
+/**
+ * @brief Display the progress of the current or last scan
+ */
+void knock_Status()
+{
+	knock_Progress progress;
+
+	knock_GetProgress(&progress);
+	message_Write(MESSAGE_LEVEL_GENERAL, "Progress: %i/%i pairs, %i hits, ETA %is (%s)\r\n", progress.done, progress.total, progress.hits, progress.eta,
+		progress.running ? "running" : (progress.resumable ? "aborted" : "stopped"));
+}
+
+/**
+ * @brief Wait for a number of milliseconds
+ */
+static void knock_Delay(uint32_t ms)
+{
+	uint32_t start = systime_Get();
+
+	while((systime_Get() - start) < ms)
+	{
+		//wait
+	}
+}
+
+/**
+ * @brief Clock a sequence of TMS values
+ *
+ * The TAP module isn't told, set it to JTAGTAP_STATE_UNKNOWN afterwards.
+ *
+ * @param[in] tms The TMS values, LSB first
+ * @param[in] count The number of clocks
+ */
+static void knock_ClockTMS(uint32_t tms, unsigned int count)
+{
+	while(count-- > 0)
+	{
+		jtag_Set(JTAG_SIGNAL_TMS, (tms & 0x01) != 0);
+		jtag_Clock();
+		tms >>= 1;
+	}
+}
+
+/**
+ * @brief Read the first 32 bits of the data registers after a TAP reset
+ *
+ * These are the ID Code of the first device, or its BYPASS bit followed by
+ * the next devices, so they identify a chain that is responding. The TAP is
+ * reset using TMS only and left in Test-Logic-Reset.
+ */
+static uint32_t knock_ReadSignature()
+{
+	uint32_t data;
+
+	knock_ClockTMS(KNOCK_TMS_RESET, 5);
+	knock_ClockTMS(KNOCK_TMS_TO_DR_SHIFT, 4);
+	data = jtag_Shift(0xFFFFFFFF, 32);
+	knock_ClockTMS(KNOCK_TMS_RESET, 5);
+	return data;
+}
+
+/**
+ * @brief Park the TAP in Shift-IR and read the data registers back
+ *
+ * The TAP is moved into Shift-IR and the IR filled with ones. Optionally
+ * TRST is pulsed, then TMS is clocked 0, 1, 0, 0 and 32 bits are read. If the
+ * TAP was reset that sequence goes to Shift-DR and the bits match
+ * knock_ReadSignature(). If it wasn't the TAP ends up in Pause-IR, where TDO
+ * isn't driven.
+ *
+ * @param[in] pulse Pulse the TRST signal low
+ * @returns The bits read.
+ */
+static uint32_t knock_ReadParked(bool pulse)
+{
+	uint32_t data;
+	unsigned int bit;
+
+	knock_ClockTMS(KNOCK_TMS_RESET, 5);
+	knock_ClockTMS(KNOCK_TMS_TO_IR_SHIFT, 5);
+	jtag_Set(JTAG_SIGNAL_TDI, true);
+	for(bit = 0; bit < 32; ++bit)
+	{
+		jtag_Clock();
+	}
+
+	if(pulse)
+	{
+		jtag_Set(JTAG_SIGNAL_TRST, false);	//Assumes an active low signal
+		knock_Delay(1);
+		jtag_Set(JTAG_SIGNAL_TRST, true);
+	}
+
+	knock_ClockTMS(KNOCK_TMS_TO_DR_SHIFT, 4);
+	data = jtag_Shift(0xFFFFFFFF, 32);
+	knock_ClockTMS(KNOCK_TMS_RESET, 5);
+	return data;
+}
+
+/**
+ * @brief Check if a pin is TRST
+ *
+ * The pin is left assigned to TRST if it is.
+ *
+ * @param[in] pin The pin to try
+ * @param[in] signature The result of knock_ReadSignature()
+ * @retval true Pulsing the pin low reset the TAP
+ */
+static bool knock_TestTRST(unsigned int pin, uint32_t signature)
+{
+	bool found;
+
+	jtag_Cfg(JTAG_SIGNAL_TRST, pin);
+	jtag_Set(JTAG_SIGNAL_TRST, true);
+	found = (knock_ReadParked(true) == signature);
+	if(!found)
+	{
+		jtag_Cfg(JTAG_SIGNAL_TRST, JTAG_SIGNAL_NOT_ALLOCATED);
+	}
+	return found;
+}
+
+/**
+ * @brief Start trying a pin as SRST
+ *
+ * The pin is assigned to SRST and held low, see knock_ResetTask().
+ *
+ * @param[in] pin The pin to try
+ */
+static void knock_HoldSRST(unsigned int pin)
+{
+	jtag_Cfg(JTAG_SIGNAL_SRST, pin);
+	jtag_Set(JTAG_SIGNAL_SRST, false);	//Assumes an active low signal
+	knock_StepTime = systime_Get();
+	knock_State = KNOCK_STEP_SRST_HELD;
+}
+
+/**
+ * @brief Stop trying a pin as SRST
+ *
+ * The pin is released and left assigned to SRST if it is.
+ *
+ * @param[in] found The pin is SRST
+ */
+static void knock_ReleaseSRST(bool found)
+{
+	jtag_Set(JTAG_SIGNAL_SRST, true);
+	if(found)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[!] SRST: %i\r\n", knock_ResetPin);
+		knock_SRSTFound = true;
+	}
+	else
+	{
+		jtag_Cfg(JTAG_SIGNAL_SRST, JTAG_SIGNAL_NOT_ALLOCATED);
+	}
+	++knock_ResetPin;
+	knock_State = KNOCK_STEP_PIN;
+}
+
+/**
+ * @brief Configure the best chain found by the scan
+ *
+ * The confirmed JTAG hit with the best score from this scan is assigned to
+ * the JTAG signals, hits left in the results by earlier scans aren't used.
+ * The search for its reset pins is started if the chain reads back a usable
+ * signature.
+ *
+ * TRST is only looked for if the chain reads back differently when the TAP
+ * isn't reset, otherwise the test can't tell.
+ *
+ * @retval true The reset pins are to be searched for
+ */
+static bool knock_ConfigureBest()
+{
+	bool search = false;
+
+	if(knock_BestFound)
+	{
+		knock_Assign(knock_Best.tck, knock_Best.tms, knock_Best.tdi, knock_Best.tdo);
+		message_Write(MESSAGE_LEVEL_GENERAL, "Configured TCK: %i TMS: %i TDO: %i TDI: %i\r\n", knock_Best.tck, knock_Best.tms, knock_Best.tdo, knock_Best.tdi);
+
+		knock_Signature = knock_ReadSignature();
+		knock_TRSTTestable = (knock_ReadParked(false) != knock_Signature);
+		knock_TRSTFound = false;
+		knock_SRSTFound = false;
+		knock_ResetPin = 0;
+		search = (knock_Signature != 0x00000000) && (knock_Signature != 0xFFFFFFFF);
+	}
+	return search;
+}
+
+/**
+ * @brief Do a step of the search for the reset pins
+ *
+ * Each of the other scanned pins is tried as TRST and as SRST, both assumed
+ * to be active low. Any that work are left assigned, so later TAP resets
+ * take the TRST path. Holding SRST and waiting for the target to recover are
+ * steps of their own, so the main loop keeps running while they wait.
+ */
+static void knock_ResetTask()
+{
+	const results_Hit *best = &knock_Best;
+
+	switch(knock_State)
+	{
+		case KNOCK_STEP_PIN:
+			if((knock_ResetPin >= knock_PinCount) || (knock_TRSTFound && knock_SRSTFound))
+			{
+				knock_Done();
+			}
+			else if((knock_ResetPin == best->tck) || (knock_ResetPin == best->tms) || (knock_ResetPin == best->tdi) || (knock_ResetPin == best->tdo))
+			{
+				++knock_ResetPin;
+			}
+			else if(!knock_TRSTFound && knock_TRSTTestable && knock_TestTRST(knock_ResetPin, knock_Signature))
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "[!] TRST: %i\r\n", knock_ResetPin);
+				knock_TRSTFound = true;
+				++knock_ResetPin;
+			}
+			else if(!knock_SRSTFound)
+			{
+				knock_HoldSRST(knock_ResetPin);
+			}
+			else
+			{
+				++knock_ResetPin;
+			}
+			break;
+
+		case KNOCK_STEP_SRST_HELD:
+			//the target has to stop responding while held in reset
+			if((systime_Get() - knock_StepTime) < KNOCK_RESET_DELAY)
+			{
+				//still waiting
+			}
+			else if(knock_ReadSignature() != knock_Signature)
+			{
+				jtag_Set(JTAG_SIGNAL_SRST, true);
+				knock_StepTime = systime_Get();
+				knock_State = KNOCK_STEP_SRST_RELEASED;
+			}
+			else
+			{
+				knock_ReleaseSRST(false);
+			}
+			break;
+
+		case KNOCK_STEP_SRST_RELEASED:
+			//and come back once released
+			if((systime_Get() - knock_StepTime) >= KNOCK_RESET_DELAY)
+			{
+				knock_ReleaseSRST(knock_ReadSignature() == knock_Signature);
+			}
+			break;
+
+		default:
+			knock_Done();
+			break;
+	}
+}
+
+/**
+ * @brief Stop the scan once it and any search for reset pins is over
+ */
+static void knock_Done()
+{
+	jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
+	knock_Running = false;
+	knock_State = KNOCK_STEP_SCAN;
 	message_Write(MESSAGE_LEVEL_GENERAL, "...Done.\r\n");
 }
 
+/**
+ * @brief Finish off the scan
+ *
+ * A JTAG scan that confirmed a chain leaves the best one configured and goes
+ * on to look for its reset pins, see knock_ConfigureBest().
+ */
+static void knock_Finish()
+{
+	knock_Resumable = false;
+	knock_Position.layout = KNOCK_LAYOUTS;
+	knock_Position.tck = knock_PinCount;
+	if((knock_ScanMode != KNOCK_MODE_SWD) && knock_ConfigureBest())
+	{
+		knock_State = KNOCK_STEP_PIN;
+	}
+	else
+	{
+		knock_Done();
+	}
+}
+
+/**
+ * @brief Do a bounded chunk of the current scan
+ *
+ * Scans up to #KNOCK_PAIRS_PER_TICK TCK/TMS pairs and then returns, so the
+ * main loop can keep handling commands (such as an abort) while a scan is in
+ * progress. Once the pairs are done, each call does a step of the search for
+ * the reset pins instead.
+ */
+void knock_Task()
+{
+	unsigned int tck, tms, count;
+	uint32_t start;
+
+	if(knock_Running && (knock_State != KNOCK_STEP_SCAN))
+	{
+		knock_ResetTask();
+	}
+	else if(knock_Running)
+	{
+		start = systime_Get();
+		for(count = 0; (count < KNOCK_PAIRS_PER_TICK) && knock_Running && (knock_State == KNOCK_STEP_SCAN); ++count)
+		{
+			if(knock_NextPair(&tck, &tms))
+			{
+				if(knock_ScanPair(knock_ScanMode, tck, tms))
+				{
+					knock_Found = true;
+				}
+				++knock_PairsDone;
+
+				if(knock_Found && ((knock_Options & KNOCK_OPTION_FIRST) != 0))
+				{
+					knock_Finish();
+				}
+			}
+			else
+			{
+				knock_Finish();
+			}
+		}
+		knock_Elapsed += systime_Get() - start;
+
+		if(knock_Running && (knock_State == KNOCK_STEP_SCAN))
+		{
+			message_Write(MESSAGE_LEVEL_VERBOSE, "Progress: %i/%i pairs, %i hits, ETA %is\r", knock_PairsDone, knock_PairsTotal, knock_Hits, knock_GetETA());
+		}
+	}
+}
@@ -18,10 +18,40 @@
 #if !defined(_KNOCK_H_)
 #define _KNOCK_H_
 
+#include <stdbool.h>
+
 typedef enum knock_eMode {
 	KNOCK_MODE_RESET,		///< Use TAP Reset to try and find a chain
 	KNOCK_MODE_BYPASS,		///< Use BYPASS instruction to try and find a chain
+	KNOCK_MODE_SWD,			///< Look for a SWD port, TCK is tried as SWCLK and TMS as SWDIO
+	KNOCK_MODE_MAX
 } knock_Mode;
 
-extern void knock_Scan(knock_Mode mode, unsigned int Pins);
+extern const char * const knock_ModeNames[KNOCK_MODE_MAX];
+
+#define KNOCK_OPTION_FIRST	(1 << 0)	///< Stop scanning once a chain has been confirmed
+#define KNOCK_OPTION_INCREMENTAL	(1 << 1)	///< Only scan the pairs that may have changed since the last scan
+#define KNOCK_OPTION_CAPTURE	(1 << 2)	///< Log TDO edges by interrupt in reset scans, rather than sampling every clock
+#define KNOCK_OPTIONS_ALL	(KNOCK_OPTION_FIRST | KNOCK_OPTION_INCREMENTAL | KNOCK_OPTION_CAPTURE)	///< Every valid option bit
+
+/**
+ * @brief Progress of the current or last scan
+ */
+typedef struct knock_sProgress {
+	unsigned int done;	///< Number of TCK/TMS pairs tried so far
+	unsigned int total;	///< Number of TCK/TMS pairs that need scanning
+	unsigned int hits;	///< Number of potential chains seen so far
+	unsigned int eta;	///< Estimated seconds left
+	bool running;		///< The scan is still going
+	bool resumable;		///< The scan was aborted and can be resumed
+} knock_Progress;
+
+extern void knock_Start(knock_Mode mode, unsigned int Pins, unsigned int Options);
+extern bool knock_Resume();
+extern bool knock_Incremental();
+extern bool knock_Abort();
+extern bool knock_IsRunning();
+extern void knock_Status();
+extern void knock_GetProgress(knock_Progress *progress);
+extern void knock_Task();
 #endif
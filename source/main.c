@@ -25,23 +25,54 @@
 #include "knock.h"
 #include "message.h"
 #include "comprocessor.h"
+#include "chain.h"
+#include "systime.h"
+#include "results.h"
+#include "capture.h"
+#include "burst.h"
+#include "comexecute.h"
+#include "comframe.h"
 
 /**
  * Development board entry point
  */
 void main()
 {
+	const char *data;
+	unsigned int len;
 
 	//setup
 	rcc_clock_setup_hsi(&hsi_8mhz[CLOCK_64MHZ]);
+	systime_Init();
 	serial_Init();
 	message_Init();
+	jtag_Init();
+	jtagTAP_Init();
+	chain_Init();
+	results_Init();
+	capture_Init();
+	burst_Init();
 	comproc_Init();
 
 	//processing
 	while(true)
 	{
+		//handle any commands first, so a scan can be aborted
+		len = serial_Peek(&data);
+		if(len > 0)
+		{
+			comproc_Process(data, len);
+			serial_Release(len);
+		}
+		if(serial_Overflowed())
+		{
+			message_Write(MESSAGE_LEVEL_REQUIRED, "\r\nInput overflow, data lost.\r\n");
+		}
 
+		//then do a little more of any running scan
+		knock_Task();
+		comexec_Task();
+		comframe_Task();
 	}
 
 	//whoops, we dropped out of the main loop
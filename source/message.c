@@ -17,21 +17,41 @@
  */
 #include "message.h"
 #include "serial.h"
+#include "systime.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 #include <strings.h>
 #include <stdarg.h>
+#if defined(MESSAGE_USE_VSNPRINTF)
+#include <stdio.h>
+#endif
 
-#define MESSAGE_WRITE_BUFFER	256	///< The maximum length of a message
+#define MESSAGE_WRITE_BUFFER	256	///< The maximum length of a message, including the terminator
+#define MESSAGE_WRITE_MIN	64	///< The least space reserved for a message, most fit first time
+#define MESSAGE_DIGITS_MAX	10	///< The most digits a 32 bit integer can take, in decimal or hex
+#define MESSAGE_RECORD_LENGTH_MAX	(2 + 255)	///< Longest record, its length byte excludes the start and itself
 
 static message_Levels message_Level;	///< The current message level
+static message_Formats message_OutputFormat;	///< The current output format
+static const char message_HexDigits[16] = "0123456789ABCDEF";	///< Upper case hex digits
+static const char message_HexDigitsLower[16] = "0123456789abcdef";	///< Lower case hex digits
+
+const char * const message_FormatNames[MESSAGE_FORMAT_MAX] = {
+	[MESSAGE_FORMAT_TEXT] = "text",
+	[MESSAGE_FORMAT_BINARY] = "binary",
+};
 
 /**
  * @brief Initialize the message module
  *
- * Set the initial message level to MESSAGE_LEVEL_GENERAL
+ * Set the initial message level to MESSAGE_LEVEL_GENERAL and the output to
+ * text.
  */
 void message_Init()
 {
 	message_Level = MESSAGE_LEVEL_GENERAL;
+	message_OutputFormat = MESSAGE_FORMAT_TEXT;
 }
 
 /**
@@ -56,38 +76,384 @@ message_Levels message_GetLevel()
 	return message_Level;
 }
 
+/**
+ * @brief Set the output format
+ *
+ * @param[in] format The format to set, has to be one of the message_Formats
+ */
+void message_SetFormat(message_Formats format)
+{
+	if(format < MESSAGE_FORMAT_MAX)
+	{
+		message_OutputFormat = format;
+	}
+}
+
+/**
+ * @brief Get the current output format
+ *
+ */
+message_Formats message_GetFormat()
+{
+	return message_OutputFormat;
+}
+
+/**
+ * @brief Store a 32 bit value little endian
+ */
+static void message_Put32(char *buffer, uint32_t value)
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = (value >> 8) & 0xFF;
+	buffer[2] = (value >> 16) & 0xFF;
+	buffer[3] = (value >> 24) & 0xFF;
+}
+
+/**
+ * @brief Build a binary record for a message
+ *
+ * Rather than formatting the message the format string's address, the
+ * time and the raw arguments are packed as described for
+ * @ref MESSAGE_RECORD_START, leaving the formatting to tools/logdecode.
+ * The format string is only walked to find the conversions.
+ *
+ * @param[out] buffer The buffer to build the record in
+ * @param size The size of the buffer
+ * @param fmt The format string
+ * @param args The arguments for the format string
+ * @return The length of the record, size or more if it did not fit, or -1
+ * if it used an unsupported conversion or is too long for its length byte
+ */
+static int message_Record(char *buffer, unsigned int size, const char *fmt, va_list args)
+{
+	const char *format = fmt;
+	const char *text;
+	unsigned int count;
+	unsigned int length;
+	unsigned int value;
+	bool success;
+
+	count = MESSAGE_RECORD_HEADER;
+	success = true;
+	while(success && (*fmt != '\0'))
+	{
+		if(*fmt++ == '%')
+		{
+			while((*fmt >= '0') && (*fmt <= '9'))
+			{
+				fmt++;
+			}
+			switch(*fmt)
+			{
+				case 'i':
+				case 'd':
+				case 'u':
+				case 'x':
+				case 'X':
+				case 'c':
+					value = va_arg(args, unsigned int);
+					if(count + 4 < size)
+					{
+						message_Put32(&buffer[count], value);
+					}
+					count += 4;
+					break;
+
+				case 's':
+					text = va_arg(args, const char *);
+					if(text == NULL)
+					{
+						text = "(null)";
+					}
+					length = strlen(text) + 1;
+					if(count + length < size)
+					{
+						memcpy(&buffer[count], text, length);
+					}
+					count += length;
+					break;
+
+				case '%':
+					break;
+
+				default:
+					success = false;
+					break;
+			}
+			fmt++;
+		}
+	}
+
+	//the length has to fit in its byte
+	success = success && (count <= MESSAGE_RECORD_LENGTH_MAX);
+	if(success && (count < size))
+	{
+		buffer[0] = MESSAGE_RECORD_START;
+		buffer[1] = count - 2;
+		message_Put32(&buffer[2], (uint32_t)(uintptr_t)format);
+		message_Put32(&buffer[6], systime_Get());
+	}
+	return success ? (int)count : -1;
+}
+
+/**
+ * @brief Format a message into a buffer
+ *
+ * A small replacement for vsnprintf covering only the conversions used by
+ * the messages: %i, %d, %u, %x, %X, %s, %c and %%, with an optional '0'
+ * flag and field width. Hex is generated by shifting nibbles and decimal
+ * by repeated division, so neither floating point nor locale support is
+ * pulled in. Any other conversion stops formatting with an error, which
+ * `make format-check` catches before it reaches a build.
+ *
+ * Like vsnprintf, a message that doesn't fit is still measured, only the
+ * part up to the first conversion that didn't fit is written.
+ *
+ * @param[out] buffer The buffer to format into, always terminated
+ * @param size The size of the buffer
+ * @param fmt The format string
+ * @param args The arguments for the format string
+ * @return The length of the formatted message, size or more if it did not
+ * fit, or -1 if it used an unsupported conversion
+ */
+static int message_Format(char *buffer, unsigned int size, const char *fmt, va_list args)
+{
+	char digits[MESSAGE_DIGITS_MAX];
+	const char *text;
+	const char *hex;
+	unsigned int length;
+	unsigned int count;
+	unsigned int written;
+	unsigned int total;
+	unsigned int width;
+	unsigned int value;
+	int number;
+	char pad;
+	char sign;
+	bool success;
+
+	count = 0;
+	written = 0;
+	success = true;
+	while(success && (*fmt != '\0'))
+	{
+		sign = '\0';
+		pad = ' ';
+		width = 0;
+		text = digits;
+		length = 0;
+		if(*fmt != '%')
+		{
+			//plain text, output as it is
+			text = fmt;
+			length = 1;
+		}
+		else
+		{
+			fmt++;
+
+			//flags and width
+			if(*fmt == '0')
+			{
+				pad = '0';
+				fmt++;
+			}
+			while((*fmt >= '0') && (*fmt <= '9'))
+			{
+				width = (width * 10) + (*fmt - '0');
+				fmt++;
+			}
+
+			//conversion, leaving the characters to output in text/length
+			switch(*fmt)
+			{
+				case 'i':
+				case 'd':
+					number = va_arg(args, int);
+					value = (unsigned int)number;
+					if(number < 0)
+					{
+						sign = '-';
+						value = 0 - value;
+					}
+					do
+					{
+						digits[MESSAGE_DIGITS_MAX - ++length] = '0' + (value % 10);
+						value /= 10;
+					}while(value != 0);
+					text = &digits[MESSAGE_DIGITS_MAX - length];
+					break;
+
+				case 'u':
+					value = va_arg(args, unsigned int);
+					do
+					{
+						digits[MESSAGE_DIGITS_MAX - ++length] = '0' + (value % 10);
+						value /= 10;
+					}while(value != 0);
+					text = &digits[MESSAGE_DIGITS_MAX - length];
+					break;
+
+				case 'X':
+				case 'x':
+					hex = (*fmt == 'X') ? message_HexDigits : message_HexDigitsLower;
+					value = va_arg(args, unsigned int);
+					do
+					{
+						digits[MESSAGE_DIGITS_MAX - ++length] = hex[value & 0x0F];
+						value >>= 4;
+					}while(value != 0);
+					text = &digits[MESSAGE_DIGITS_MAX - length];
+					break;
+
+				case 's':
+					text = va_arg(args, const char *);
+					if(text == NULL)
+					{
+						text = "(null)";
+					}
+					length = strlen(text);
+					break;
+
+				case 'c':
+					digits[0] = (char)va_arg(args, int);
+					length = 1;
+					break;
+
+				case '%':
+					digits[0] = '%';
+					length = 1;
+					break;
+
+				default:
+					success = false;
+					break;
+			}
+		}
+		fmt++;
+
+		if(success)
+		{
+			//sign, padding then the text
+			if(sign != '\0')
+			{
+				width = (width > 0) ? (width - 1) : 0;
+			}
+			total = ((sign != '\0') ? 1 : 0) + ((width > length) ? width : length);
+			if((written == count) && (count + total < size))
+			{
+				if((sign != '\0') && (pad == '0'))
+				{
+					buffer[written++] = sign;
+				}
+				while(width > length)
+				{
+					buffer[written++] = pad;
+					width--;
+				}
+				if((sign != '\0') && (pad != '0'))
+				{
+					buffer[written++] = sign;
+				}
+				memcpy(&buffer[written], text, length);
+				written += length;
+			}
+			count += total;
+		}
+	}
+	if(size > 0)
+	{
+		buffer[written] = '\0';
+	}
+	return success ? (int)count : -1;
+}
+
+/**
+ * @brief Format a message, or pack it as a record, for the output format
+ *
+ * @return The length of the message, size or more if it did not fit, or
+ * -1 on an error
+ */
+static int message_Build(char *buffer, unsigned int size, const char *fmt, va_list args)
+{
+	int n;
+
+	if(message_OutputFormat == MESSAGE_FORMAT_BINARY)
+	{
+		n = message_Record(buffer, size, fmt, args);
+	}
+	else
+	{
+#if defined(MESSAGE_USE_VSNPRINTF)
+		n = vsnprintf(buffer, size, fmt, args);
+#else
+		n = message_Format(buffer, size, fmt, args);
+#endif
+	}
+	return n;
+}
+
 /**
  * @brief Format and display a message
  *
  * The message should only be displayed to the user if the message level
- * is less than or equal to the current message level.
+ * is less than or equal to the current message level. It is formatted,
+ * or packed as a record in MESSAGE_FORMAT_BINARY, straight into space
+ * reserved in the serial transmit ring. The reservation takes what is
+ * free up to the end of the ring, a message that turns out longer is
+ * built again in a reservation of the length measured.
  *
  * @param level The message level
  * @param fmt A format string for the level
+ * @note Calls go through the message_Write() macro, which drops those
+ * above @ref MESSAGE_BUILD_LEVEL at compile time.
+ *
  * @return The number of bytes written or -1 if an error occured,
  * -2 for incorrect level
  */
-int message_Write(message_Levels level, const char *fmt, ...)
+int (message_Write)(message_Levels level, const char *fmt, ...)
 {
-	char buffer[MESSAGE_WRITE_BUFFER];
+	unsigned int size;
 	int n;
 	va_list args;
 	if(level <= message_Level)
 	{
+		size = serial_Space();
+		if(size < MESSAGE_WRITE_MIN)
+		{
+			size = MESSAGE_WRITE_MIN;
+		}
+		else if(size > MESSAGE_WRITE_BUFFER)
+		{
+			size = MESSAGE_WRITE_BUFFER;
+		}
 		va_start(args, fmt);
-		n = vsnprintf(buffer, MESSAGE_WRITE_BUFFER, fmt, args);
-		if((n > 0) && (n < MESSAGE_WRITE_BUFFER))
+		n = message_Build(serial_Reserve(size), size, fmt, args);
+		va_end(args);
+
+		if((n >= (int)size) && (n < MESSAGE_WRITE_BUFFER))
 		{
-			serial_Send(buffer, n);
+			//didn't fit what was free, wait or wrap for the length needed
+			serial_Abort();
+			size = n + 1;
+			va_start(args, fmt);
+			n = message_Build(serial_Reserve(size), size, fmt, args);
+			va_end(args);
+		}
+
+		if((n > 0) && (n < (int)size))
+		{
+			serial_Commit(n);
 		}
 		else
 		{
+			serial_Abort();
 			n = -1;
 		}
-		va_end(args);
 	}
 	else
 	{
 		n = -2;
 	}
+	return n;
 }
@@ -32,10 +32,66 @@ typedef enum message_eLevels
 	MESSAGE_LEVEL_MAX		///< Maximum level number
 }message_Levels;
 
+/**
+ * @brief Available output formats
+ */
+typedef enum message_eFormats
+{
+	MESSAGE_FORMAT_TEXT = 0,	///< Messages are formatted on the device
+	MESSAGE_FORMAT_BINARY,		///< Messages are sent as records for tools/logdecode
+	MESSAGE_FORMAT_MAX		///< Maximum format number
+}message_Formats;
+
+extern const char * const message_FormatNames[MESSAGE_FORMAT_MAX];
+
+/**
+ * @brief Binary message record layout
+ *
+ * A record is sent in place of each message in MESSAGE_FORMAT_BINARY:
+ *
+ *     start(1) length(1) format(4) time(4) arguments...
+ *
+ * length counts the bytes after it. format is the flash address of the
+ * format string and time the systime_Get() milliseconds, both little endian.
+ * Each integer or character conversion adds its 32 bit value, little endian,
+ * and each %s the string with its terminator. Anything outside a record,
+ * such as echoed commands, is plain text.
+ */
+#define MESSAGE_RECORD_START	0x1E	///< Marks the start of a record, never sent in text
+#define MESSAGE_RECORD_HEADER	10	///< Bytes in a record before the arguments
+
 //Message functions
 
 extern void message_Init();
 extern void message_SetLevel(message_Levels level);
 extern message_Levels message_GetLevel();
-extern int message_Write(message_Levels level, const char *fmt, ...);
+extern void message_SetFormat(message_Formats format);
+extern message_Formats message_GetFormat();
+extern int message_Write(message_Levels level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief The most detailed message level built in
+ *
+ * Calls to message_Write() for levels above this are compiled out, along
+ * with the evaluation of their arguments. The runtime level still filters
+ * the levels up to it. Set with `make MESSAGE_LEVEL=n`.
+ */
+#if !defined(MESSAGE_BUILD_LEVEL)
+#define MESSAGE_BUILD_LEVEL	MESSAGE_LEVEL_DEBUG
+#endif
+
+/**
+ * @brief Format and display a message, if built in
+ *
+ * The level is normally a constant, so the comparison is resolved by the
+ * compiler and calls above @ref MESSAGE_BUILD_LEVEL leave no code behind.
+ */
+#define message_Write(level, ...)	({							\
+	int message_n = -2;									\
+	if((level) <= MESSAGE_BUILD_LEVEL)							\
+	{											\
+		message_n = message_Write((level), __VA_ARGS__);				\
+	}											\
+	message_n;										\
+})
 #endif
@@ -0,0 +1,124 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "results.h"
+#include <stddef.h>
+
+static results_Hit results_Hits[RESULTS_MAX];	///< Hits found so far
+static unsigned int results_Used;		///< Number of entries in results_Hits
+
+/**
+ * @brief Initialize the results module, forgetting all hits
+ */
+void results_Init()
+{
+	results_Used = 0;
+}
+
+/**
+ * @brief Find a hit by its pins
+ *
+ * @return The index of the hit, or -1 if it isn't known.
+ */
+int results_Find(unsigned int tck, unsigned int tms, unsigned int tdi, unsigned int tdo)
+{
+	int retval = -1;
+	unsigned int index;
+
+	for(index = 0; index < results_Used; ++index)
+	{
+		const results_Hit *hit = &results_Hits[index];
+		if((hit->tck == tck) && (hit->tms == tms) && (hit->tdi == tdi) && (hit->tdo == tdo))
+		{
+			retval = index;
+			break;
+		}
+	}
+	return retval;
+}
+
+/**
+ * @brief Record a scan hit
+ *
+ * If the pins are already known the existing hit is updated: the modes are
+ * merged, the clocks are added, the best score is kept and the devices are
+ * taken from the hit with the best score.
+ *
+ * @param[in] hit The hit to record. seen is ignored.
+ * @retval true This is a new hit.
+ * @retval false The hit was already known, or the table is full.
+ */
+bool results_Add(const results_Hit *hit)
+{
+	bool added = false;
+	int index = results_Find(hit->tck, hit->tms, hit->tdi, hit->tdo);
+
+	if(index >= 0)
+	{
+		results_Hit *old = &results_Hits[index];
+
+		old->modes |= hit->modes;
+		old->clocks += hit->clocks;
+		if(old->seen < 0xFF)
+		{
+			++old->seen;
+		}
+		if(hit->score > old->score)
+		{
+			unsigned int id;
+
+			old->score = hit->score;
+			old->devices = hit->devices;
+			for(id = 0; id < RESULTS_MAX_IDCODES; ++id)
+			{
+				old->idcodes[id] = hit->idcodes[id];
+			}
+		}
+	}
+	else if(results_Used < RESULTS_MAX)
+	{
+		results_Hits[results_Used] = *hit;
+		results_Hits[results_Used].seen = 1;
+		++results_Used;
+		added = true;
+	}
+	return added;
+}
+
+/**
+ * @brief Get the number of hits recorded
+ */
+unsigned int results_Count()
+{
+	return results_Used;
+}
+
+/**
+ * @brief Get a recorded hit
+ *
+ * @param[in] index The hit to get, 0 to results_Count() - 1.
+ * @return The hit, or NULL if index is out of range.
+ */
+const results_Hit *results_Get(unsigned int index)
+{
+	const results_Hit *hit = NULL;
+	if(index < results_Used)
+	{
+		hit = &results_Hits[index];
+	}
+	return hit;
+}
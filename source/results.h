@@ -0,0 +1,58 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_RESULTS_H_)
+#define _RESULTS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RESULTS_MAX		(16)	///< Maximum number of scan hits kept
+#define RESULTS_MAX_IDCODES	(4)	///< Maximum number of ID Codes kept per hit
+
+#define RESULTS_PIN_NONE	(0xFF)	///< Pin number of a signal a hit doesn't use
+
+#define RESULTS_SCORE_CONFIRMED	(100)	///< Score of a hit that chain_Detect() found devices on
+#define RESULTS_SCORE_POTENTIAL	(50)	///< Score of a hit that only passed the scan itself
+
+/**
+ * @brief A potential JTAG chain found by a scan
+ *
+ * Pins are 0 based. A hit is identified by its pins, seeing the same pins
+ * again updates the existing hit. A SWD port has SWCLK in tck, SWDIO in tms,
+ * no tdi/tdo and its DP IDR as the only ID Code.
+ */
+typedef struct results_sHit {
+	uint8_t tck;		///< Pin TCK is on
+	uint8_t tms;		///< Pin TMS is on
+	uint8_t tdi;		///< Pin TDI is on
+	uint8_t tdo;		///< Pin TDO is on
+	uint8_t modes;		///< Bitmask of the scan modes that found it, 1 << knock_Mode
+	uint8_t score;		///< Confidence score, 0 - 100
+	uint8_t seen;		///< Number of times the hit was reported, saturates
+	uint8_t devices;	///< Number of devices found on the chain
+	uint32_t clocks;	///< Number of TCK clocks spent on its TCK/TMS pair, added up over the scans that found it
+	uint32_t idcodes[RESULTS_MAX_IDCODES];	///< ID Codes of the first devices, 0 for BYPASS
+} results_Hit;
+
+extern void results_Init();
+extern bool results_Add(const results_Hit *hit);
+extern int results_Find(unsigned int tck, unsigned int tms, unsigned int tdi, unsigned int tdo);
+extern unsigned int results_Count();
+extern const results_Hit *results_Get(unsigned int index);
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "scanlog.h"
+#include <stddef.h>
+
+static unsigned int scanlog_FindEvent(const scanlog_Log *log, unsigned int first, unsigned int group);
+
+/**
+ * @brief Find the event of a group among the events of the last sample
+ *
+ * @param[in] log The log to search
+ * @param[in] first Index of the first event of the last sample
+ * @param[in] group The pin group
+ * @returns The index of the event, log->count if there isn't one.
+ */
+static unsigned int scanlog_FindEvent(const scanlog_Log *log, unsigned int first, unsigned int group)
+{
+	unsigned int index = first;
+
+	while((index < log->count) && (log->events[index].group != group))
+	{
+		++index;
+	}
+	return index;
+}
+
+/**
+ * @brief Start an empty log
+ *
+ * @param[out] log The log to initialize
+ * @param[in] events Storage for the changes
+ * @param[in] size Number of entries in events
+ */
+void scanlog_Init(scanlog_Log *log, scanlog_Event *events, unsigned int size)
+{
+	log->events = events;
+	log->size = size;
+	log->count = 0;
+	log->samples = 0;
+	log->initial = 0;
+	log->last = 0;
+	log->changed = 0;
+}
+
+/**
+ * @brief Add the next sample to the log
+ *
+ * @param[in,out] log The log to add to
+ * @param[in] data The pin states
+ * @retval true The sample was logged
+ * @retval false The log is full, the sample was dropped
+ */
+bool scanlog_Record(scanlog_Log *log, scanlog_Mask data)
+{
+	bool success = false;
+
+	if(log->samples == 0)
+	{
+		log->initial = data;
+		log->last = data;
+		success = true;
+	}
+	else if(log->samples < SCANLOG_MAX_SAMPLES)
+	{
+		success = (data == log->last) || scanlog_AddEvent(log, log->samples, data ^ log->last);
+	}
+
+	if(success)
+	{
+		++log->samples;
+	}
+	return success;
+}
+
+/**
+ * @brief Log a change of the pins
+ *
+ * Used when the changes are captured as edges rather than by sampling every
+ * clock. Changes at the same sample are merged, so a glitch that is back to
+ * its old state by the next sample is dropped. The number of samples isn't
+ * updated, see scanlog_SetSamples().
+ *
+ * The change takes an event for each group of pins it involves, it is only
+ * logged if there is room for all of them.
+ *
+ * @param[in,out] log The log to add to, has to hold the initial sample
+ * @param[in] sample Index of the first sample showing the change, can't be
+ * before the last change
+ * @param[in] changed Bitmask of the pins that changed
+ * @retval true The change was logged
+ * @retval false The log is full or the sample is out of order
+ */
+bool scanlog_AddEvent(scanlog_Log *log, unsigned int sample, scanlog_Mask changed)
+{
+	bool success = false;
+	unsigned int first = log->count;
+	unsigned int needed = 0;
+	unsigned int group, index;
+	uint8_t bits;
+
+	if((sample == 0) || (sample >= SCANLOG_MAX_SAMPLES) || ((log->count > 0) && (sample < log->events[log->count - 1].sample)))
+	{
+		//can't be logged
+	}
+	else
+	{
+		//the events already logged at this sample are the last ones
+		while((first > 0) && (log->events[first - 1].sample == sample))
+		{
+			--first;
+		}
+
+		for(group = 0; group < SCANLOG_GROUPS; ++group)
+		{
+			bits = (uint8_t)(changed >> (group * SCANLOG_GROUP_PINS));
+			if((bits != 0) && (scanlog_FindEvent(log, first, group) == log->count))
+			{
+				++needed;
+			}
+		}
+
+		success = (log->count + needed <= log->size);
+		for(group = 0; success && (group < SCANLOG_GROUPS); ++group)
+		{
+			bits = (uint8_t)(changed >> (group * SCANLOG_GROUP_PINS));
+			index = scanlog_FindEvent(log, first, group);
+			if(bits == 0)
+			{
+				//the group didn't change
+			}
+			else if(index == log->count)
+			{
+				log->events[index].sample = sample;
+				log->events[index].group = group;
+				log->events[index].changed = bits;
+				++log->count;
+			}
+			else if((log->events[index].changed ^= bits) == 0)
+			{
+				//changed back, nothing happened, the last event takes its place
+				--log->count;
+				log->events[index].group = log->events[log->count].group;
+				log->events[index].changed = log->events[log->count].changed;
+			}
+		}
+	}
+
+	if(success)
+	{
+		log->changed |= changed;
+		log->last ^= changed;
+	}
+	return success;
+}
+
+/**
+ * @brief Extend the log with unchanged samples
+ *
+ * @param[in,out] log The log to extend
+ * @param[in] samples The number of samples the log now covers, the log never
+ * gets shorter
+ */
+void scanlog_SetSamples(scanlog_Log *log, unsigned int samples)
+{
+	if(samples > SCANLOG_MAX_SAMPLES)
+	{
+		samples = SCANLOG_MAX_SAMPLES;
+	}
+	if(samples > log->samples)
+	{
+		log->samples = samples;
+	}
+}
+
+/**
+ * @brief Get the number of samples in the log
+ */
+unsigned int scanlog_GetSamples(const scanlog_Log *log)
+{
+	return log->samples;
+}
+
+/**
+ * @brief Get the pin states of the last sample
+ */
+scanlog_Mask scanlog_GetLast(const scanlog_Log *log)
+{
+	return log->last;
+}
+
+/**
+ * @brief Get a bitmask of every pin that changed at some point
+ */
+scanlog_Mask scanlog_GetChanged(const scanlog_Log *log)
+{
+	return log->changed;
+}
+
+/**
+ * @brief Get the number of samples since the pins last changed
+ *
+ * The first sample isn't counted.
+ */
+unsigned int scanlog_GetUnchanged(const scanlog_Log *log)
+{
+	unsigned int since = 0;
+
+	if(log->count > 0)
+	{
+		since = log->events[log->count - 1].sample;
+	}
+	return (log->samples > 0) ? (log->samples - 1 - since) : 0;
+}
+
+/**
+ * @brief Find where some pins stopped changing
+ *
+ * @param[in] log The log to search
+ * @param[in] mask Bitmask of the pins of interest
+ * @returns The index of the first sample from which the pins keep their
+ * last state, 0 if they never changed.
+ */
+unsigned int scanlog_GetSettled(const scanlog_Log *log, scanlog_Mask mask)
+{
+	unsigned int settled = 0;
+	unsigned int index = log->count;
+
+	while(index > 0)
+	{
+		--index;
+		if(((mask >> (log->events[index].group * SCANLOG_GROUP_PINS)) & log->events[index].changed) != 0)
+		{
+			settled = log->events[index].sample;
+			break;
+		}
+	}
+	return settled;
+}
+
+/**
+ * @brief Start reading a log from the first sample
+ */
+void scanlog_Begin(scanlog_Reader *reader, const scanlog_Log *log)
+{
+	reader->log = log;
+	reader->event = 0;
+	reader->sample = 0;
+	reader->value = log->initial;
+}
+
+/**
+ * @brief Get the next sample from a log
+ *
+ * Reading past the end keeps returning the last sample.
+ *
+ * @param[in,out] reader The position in the log
+ * @returns The pin states of the sample.
+ */
+scanlog_Mask scanlog_Next(scanlog_Reader *reader)
+{
+	const scanlog_Log *log = reader->log;
+
+	while((reader->event < log->count) && (log->events[reader->event].sample == reader->sample))
+	{
+		reader->value ^= (scanlog_Mask)log->events[reader->event].changed << (log->events[reader->event].group * SCANLOG_GROUP_PINS);
+		++reader->event;
+	}
+	++reader->sample;
+	return reader->value;
+}
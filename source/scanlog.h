@@ -0,0 +1,88 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_SCANLOG_H_)
+#define _SCANLOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCANLOG_MAX_SAMPLES	(0xFFFF)	///< Maximum number of samples a log can cover
+#define SCANLOG_GROUP_PINS	(8)		///< Number of pins an event covers
+
+typedef uint64_t scanlog_Mask;		///< Pin states, bit n is pin n
+
+#define SCANLOG_GROUPS	((sizeof(scanlog_Mask) * 8) / SCANLOG_GROUP_PINS)	///< Number of pin groups in a scanlog_Mask
+
+/**
+ * @brief A change in the pin states of a group of pins
+ *
+ * A change on pins in several groups takes an event for each group, so an
+ * event stays 4 bytes however many pins are scanned. Changes usually only
+ * involve a pin or two.
+ */
+typedef struct scanlog_sEvent {
+	uint16_t sample;	///< Index of the first sample with the new states
+	uint8_t group;		///< The event covers pins group * SCANLOG_GROUP_PINS and up
+	uint8_t changed;	///< Bitmask of the pins of the group that changed
+} scanlog_Event;
+
+/**
+ * @brief Run length compressed record of the pin states, one sample per clock
+ *
+ * Only the first sample and the changes after it are stored, so a log takes
+ * up space for the number of times the pins changed rather than the number
+ * of clocks.
+ *
+ * The edge capture interrupt adds to a log while the scan reads it, so the
+ * fields it changes are volatile. Reading more than one of them in the main
+ * loop needs the interrupt masked, see capture_Update().
+ */
+typedef struct scanlog_sLog {
+	volatile scanlog_Event *events;	///< Storage for the changes
+	unsigned int size;		///< Number of entries in events
+	volatile unsigned int count;	///< Number of entries used in events
+	volatile unsigned int samples;	///< Number of samples covered by the log
+	scanlog_Mask initial;		///< Pin states of the first sample
+	volatile scanlog_Mask last;	///< Pin states of the last sample
+	volatile scanlog_Mask changed;	///< Bitmask of every pin that changed at some point
+} scanlog_Log;
+
+/**
+ * @brief Position when walking through a log sample by sample
+ */
+typedef struct scanlog_sReader {
+	const scanlog_Log *log;	///< The log being read
+	unsigned int event;	///< Next event to apply
+	unsigned int sample;	///< Index of the next sample
+	scanlog_Mask value;	///< Pin states of the previous sample
+} scanlog_Reader;
+
+extern void scanlog_Init(scanlog_Log *log, scanlog_Event *events, unsigned int size);
+extern bool scanlog_Record(scanlog_Log *log, scanlog_Mask data);
+extern bool scanlog_AddEvent(scanlog_Log *log, unsigned int sample, scanlog_Mask changed);
+extern void scanlog_SetSamples(scanlog_Log *log, unsigned int samples);
+extern unsigned int scanlog_GetSamples(const scanlog_Log *log);
+extern scanlog_Mask scanlog_GetLast(const scanlog_Log *log);
+extern scanlog_Mask scanlog_GetChanged(const scanlog_Log *log);
+extern unsigned int scanlog_GetUnchanged(const scanlog_Log *log);
+extern unsigned int scanlog_GetSettled(const scanlog_Log *log, scanlog_Mask mask);
+
+extern void scanlog_Begin(scanlog_Reader *reader, const scanlog_Log *log);
+extern scanlog_Mask scanlog_Next(scanlog_Reader *reader);
+
+#endif
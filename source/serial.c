@@ -18,8 +18,45 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
 #include "serial.h"
+#include <stddef.h>
+#include <string.h>
 
+#define SERIAL_RX_DMA		DMA_CHANNEL6	///< DMA1 channel of the USART2_RX request
+#define SERIAL_TX_DMA		DMA_CHANNEL7	///< DMA1 channel of the USART2_TX request
+
+//Received bytes are written into serial_RxBuffer by DMA, round and round.
+//The interrupts (half way, wrap and line idle) and the reader keep a running
+//count of the bytes written so the reader can tell if it has been lapped.
+static char serial_RxBuffer[SERIAL_RX_BUFFER];	///< Receive ring, filled by DMA
+static unsigned int serial_RxTail;		///< Next byte of serial_RxBuffer to be read
+static uint32_t serial_RxRead;			///< Count of the bytes read
+static volatile uint32_t serial_RxWritten;	///< Count of the bytes written, as of the last update
+static volatile unsigned int serial_RxHead;	///< DMA write position as of the last update
+static bool serial_RxOverflow;			///< Received data was lost
+
+//Bytes to send are written into serial_TxBuffer and sent by DMA, one
+//contiguous run at a time. The transfer complete interrupt moves on to the
+//next run. Space is handed out contiguously, when a reservation doesn't
+//fit before the end of the ring it starts at the beginning instead and the
+//data ends early, at serial_TxWrap.
+static char serial_TxBuffer[SERIAL_TX_BUFFER];	///< Transmit ring, emptied by DMA
+static volatile unsigned int serial_TxHead;	///< Next free byte of serial_TxBuffer
+static volatile unsigned int serial_TxTail;	///< First byte of serial_TxBuffer still to be sent
+static volatile unsigned int serial_TxWrap;	///< End of the data when it carries on from the start
+static volatile unsigned int serial_TxLength;	///< Bytes in the running DMA transfer, 0 when idle
+static bool serial_TxWrapped;			///< The current reservation is at the start of the ring
+
+static unsigned int serial_RxPosition();
+static void serial_RxUpdate();
+static void serial_TxStart();
+static void serial_TxKick();
+
+/**
+ * @brief Set up USART2 for the command console
+ */
 void serial_Init()
 {
 	//UART on PA2 (TX) and PA3 (RX) @ 115200,8,N,1
@@ -33,18 +70,346 @@ void serial_Init()
 	usart_set_databits(USART2, 8);
 	usart_set_stopbits(USART2, USART_STOPBITS_1);
 	usart_set_parity(USART2, USART_PARITY_NONE);
-	usart_set_mode(USART2, USART_MODE_TX);
+	usart_set_mode(USART2, USART_MODE_TX_RX);
 	usart_set_flow_control(USART2, USART_FLOWCONTROL_NONE);
+
+	//receive into the ring by DMA
+	serial_RxTail = 0;
+	serial_RxRead = 0;
+	serial_RxWritten = 0;
+	serial_RxHead = 0;
+	serial_RxOverflow = false;
+
+	rcc_periph_clock_enable(RCC_DMA1);
+	dma_channel_reset(DMA1, SERIAL_RX_DMA);
+	dma_set_peripheral_address(DMA1, SERIAL_RX_DMA, (uint32_t)&USART_RDR(USART2));
+	dma_set_memory_address(DMA1, SERIAL_RX_DMA, (uint32_t)serial_RxBuffer);
+	dma_set_number_of_data(DMA1, SERIAL_RX_DMA, SERIAL_RX_BUFFER);
+	dma_set_read_from_peripheral(DMA1, SERIAL_RX_DMA);
+	dma_enable_memory_increment_mode(DMA1, SERIAL_RX_DMA);
+	dma_set_memory_size(DMA1, SERIAL_RX_DMA, DMA_CCR_MSIZE_8BIT);
+	dma_set_peripheral_size(DMA1, SERIAL_RX_DMA, DMA_CCR_PSIZE_8BIT);
+	dma_enable_circular_mode(DMA1, SERIAL_RX_DMA);
+	dma_set_priority(DMA1, SERIAL_RX_DMA, DMA_CCR_PL_HIGH);
+	dma_enable_half_transfer_interrupt(DMA1, SERIAL_RX_DMA);
+	dma_enable_transfer_complete_interrupt(DMA1, SERIAL_RX_DMA);
+	dma_enable_channel(DMA1, SERIAL_RX_DMA);
+	usart_enable_rx_dma(USART2);
+
+	//and send from the other ring
+	serial_TxHead = 0;
+	serial_TxTail = 0;
+	serial_TxWrap = SERIAL_TX_BUFFER;
+	serial_TxLength = 0;
+	serial_TxWrapped = false;
+
+	dma_channel_reset(DMA1, SERIAL_TX_DMA);
+	dma_set_peripheral_address(DMA1, SERIAL_TX_DMA, (uint32_t)&USART_TDR(USART2));
+	dma_set_read_from_memory(DMA1, SERIAL_TX_DMA);
+	dma_enable_memory_increment_mode(DMA1, SERIAL_TX_DMA);
+	dma_set_memory_size(DMA1, SERIAL_TX_DMA, DMA_CCR_MSIZE_8BIT);
+	dma_set_peripheral_size(DMA1, SERIAL_TX_DMA, DMA_CCR_PSIZE_8BIT);
+	dma_set_priority(DMA1, SERIAL_TX_DMA, DMA_CCR_PL_MEDIUM);
+	dma_enable_transfer_complete_interrupt(DMA1, SERIAL_TX_DMA);
+	usart_enable_tx_dma(USART2);
+
+	USART_CR1(USART2) |= USART_CR1_IDLEIE;
+	nvic_enable_irq(NVIC_DMA1_CHANNEL6_IRQ);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL7_IRQ);
+	nvic_enable_irq(NVIC_USART2_EXTI26_IRQ);
+
 	usart_enable(USART2);
 }
 
+/**
+ * @brief Send a buffer out of the serial port
+ *
+ * The data is copied into the transmit ring and sent in the background.
+ * Only blocks while the ring is full.
+ *
+ * @param[in] buffer The data to send.
+ * @param[in] len The number of bytes in buffer.
+ */
 void serial_Send(const char *buffer, const unsigned int len)
 {
+	unsigned int count = 0;
+	unsigned int chunk;
+	char *space;
+
+	while(count < len)
+	{
+		chunk = ((len - count) > SERIAL_TX_CHUNK) ? SERIAL_TX_CHUNK : (len - count);
+		space = serial_Reserve(chunk);
+		memcpy(space, &buffer[count], chunk);
+		serial_Commit(chunk);
+		count += chunk;
+	}
+}
+
+/**
+ * @brief Reserve contiguous space in the transmit ring
+ *
+ * Blocks until the space is free. The data is written straight into the
+ * ring and sent once serial_Commit() is called, or dropped with
+ * serial_Abort(). Only one reservation can be open at a time.
+ *
+ * @param[in] size The number of bytes needed, up to SERIAL_TX_RESERVE_MAX
+ * @returns Where to write the data.
+ */
+char *serial_Reserve(unsigned int size)
+{
+	char *space = NULL;
+	unsigned int head = serial_TxHead;
+	unsigned int tail;
+
+	serial_TxWrapped = false;
+	while(space == NULL)
+	{
+		tail = serial_TxTail;
+
+		if(serial_Space() >= size)
+		{
+			space = &serial_TxBuffer[head];
+		}
+		else if((head >= tail) && (tail > size))
+		{
+			space = serial_TxBuffer;
+			serial_TxWrapped = true;
+		}
+
+		if(space == NULL)
+		{
+			//wait for some of it to go
+			serial_TxKick();
+		}
+	}
+	return space;
+}
+
+/**
+ * @brief Get the space serial_Reserve() can hand out without waiting
+ *
+ * Only counts the free space from the head up to the end of the ring, a
+ * reservation this size neither waits nor wraps.
+ *
+ * @returns The number of bytes free.
+ */
+unsigned int serial_Space()
+{
+	unsigned int head = serial_TxHead;
+	unsigned int tail = serial_TxTail;
+	unsigned int space;
+
+	//one byte is always left free, so a full ring doesn't look empty
+	if(head >= tail)
+	{
+		space = SERIAL_TX_BUFFER - head - ((tail == 0) ? 1 : 0);
+	}
+	else
+	{
+		space = tail - head - 1;
+	}
+	return space;
+}
+
+/**
+ * @brief Send data written into a serial_Reserve() reservation
+ *
+ * @param[in] len The number of bytes written, up to the size reserved
+ */
+void serial_Commit(unsigned int len)
+{
+	if(len > 0)
+	{
+		nvic_disable_irq(NVIC_DMA1_CHANNEL7_IRQ);
+		if(serial_TxWrapped)
+		{
+			serial_TxWrap = serial_TxHead;
+			serial_TxHead = len;
+		}
+		else
+		{
+			serial_TxHead += len;
+			if(serial_TxHead == SERIAL_TX_BUFFER)
+			{
+				serial_TxWrap = SERIAL_TX_BUFFER;
+				serial_TxHead = 0;
+			}
+		}
+		serial_TxStart();
+		nvic_enable_irq(NVIC_DMA1_CHANNEL7_IRQ);
+	}
+	serial_TxWrapped = false;
+}
+
+/**
+ * @brief Drop a serial_Reserve() reservation without sending anything
+ */
+void serial_Abort()
+{
+	serial_TxWrapped = false;
+}
+
+/**
+ * @brief Start sending the next run of the transmit ring, if idle
+ *
+ * Has to be called with the transmit interrupt blocked.
+ */
+static void serial_TxStart()
+{
+	unsigned int head = serial_TxHead;
+	unsigned int tail = serial_TxTail;
+
+	if((serial_TxLength == 0) && (head != tail))
+	{
+		if((head < tail) && (tail == serial_TxWrap))
+		{
+			//everything up to the wrap has gone, carry on from the start
+			tail = 0;
+			serial_TxTail = 0;
+		}
+
+		if(head != tail)
+		{
+			serial_TxLength = (head > tail) ? (head - tail) : (serial_TxWrap - tail);
+			dma_disable_channel(DMA1, SERIAL_TX_DMA);
+			dma_set_memory_address(DMA1, SERIAL_TX_DMA, (uint32_t)&serial_TxBuffer[tail]);
+			dma_set_number_of_data(DMA1, SERIAL_TX_DMA, serial_TxLength);
+			dma_enable_channel(DMA1, SERIAL_TX_DMA);
+		}
+	}
+}
+
+/**
+ * @brief Start sending from outside the interrupt
+ */
+static void serial_TxKick()
+{
+	nvic_disable_irq(NVIC_DMA1_CHANNEL7_IRQ);
+	serial_TxStart();
+	nvic_enable_irq(NVIC_DMA1_CHANNEL7_IRQ);
+}
+
+/**
+ * @brief Transmit DMA complete interrupt
+ */
+void dma1_channel7_isr()
+{
+	dma_clear_interrupt_flags(DMA1, SERIAL_TX_DMA, DMA_TCIF);
+	serial_TxTail += serial_TxLength;
+	serial_TxLength = 0;
+	serial_TxStart();
+}
+
+/**
+ * @brief Get the received bytes that haven't been read yet
+ *
+ * Doesn't wait for data. The bytes are left in the receive ring, so only
+ * the contiguous part up to the end of the ring is returned, the rest comes
+ * on the next call. Call serial_Release() once they have been used.
+ *
+ * @param[out] data Set to the first unread byte.
+ * @return The number of bytes available at data.
+ */
+unsigned int serial_Peek(const char **data)
+{
+	unsigned int head;
 	unsigned int count;
-	const char *p = buffer;
-	for(count = 0; count < len; ++count)
+
+	//bring the count up to the DMA position, so it can't fall behind the
+	//bytes read from it
+	nvic_disable_irq(NVIC_DMA1_CHANNEL6_IRQ);
+	nvic_disable_irq(NVIC_USART2_EXTI26_IRQ);
+	serial_RxUpdate();
+	head = serial_RxHead;
+	nvic_enable_irq(NVIC_USART2_EXTI26_IRQ);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL6_IRQ);
+
+	if((serial_RxWritten - serial_RxRead) > SERIAL_RX_BUFFER)
+	{
+		//lapped by the DMA, whatever is in the ring is a mix of old and new
+		serial_RxOverflow = true;
+		serial_RxTail = head;
+		serial_RxRead = serial_RxWritten;
+	}
+
+	//a full ring leaves the head back at the tail, the counters tell it from empty
+	if((head > serial_RxTail) || ((head == serial_RxTail) && (serial_RxWritten == serial_RxRead)))
+	{
+		count = head - serial_RxTail;
+	}
+	else
 	{
-		usart_send_blocking(USART2, *p++);
+		count = SERIAL_RX_BUFFER - serial_RxTail;
 	}
+	*data = &serial_RxBuffer[serial_RxTail];
+	return count;
 }
 
+/**
+ * @brief Mark bytes returned by serial_Peek() as read
+ *
+ * @param[in] len The number of bytes used, up to the count serial_Peek()
+ * returned.
+ */
+void serial_Release(unsigned int len)
+{
+	serial_RxTail = (serial_RxTail + len) % SERIAL_RX_BUFFER;
+	serial_RxRead += len;
+}
+
+/**
+ * @brief Check if received data was lost, clearing the flag
+ *
+ * @retval true The receive ring overflowed since the last call
+ */
+bool serial_Overflowed()
+{
+	bool overflow = serial_RxOverflow;
+
+	serial_RxOverflow = false;
+	return overflow;
+}
+
+/**
+ * @brief Get the position the DMA will write the next byte to
+ */
+static unsigned int serial_RxPosition()
+{
+	return (SERIAL_RX_BUFFER - dma_get_number_of_data(DMA1, SERIAL_RX_DMA)) % SERIAL_RX_BUFFER;
+}
+
+/**
+ * @brief Count the bytes written by the DMA since the last update
+ *
+ * Called from the interrupts, which come at least twice per trip round the
+ * ring, and from serial_Peek() with them masked.
+ */
+static void serial_RxUpdate()
+{
+	unsigned int head = serial_RxPosition();
+
+	serial_RxWritten += (head + SERIAL_RX_BUFFER - serial_RxHead) % SERIAL_RX_BUFFER;
+	serial_RxHead = head;
+}
+
+/**
+ * @brief Receive DMA half way and wrap interrupt
+ */
+void dma1_channel6_isr()
+{
+	dma_clear_interrupt_flags(DMA1, SERIAL_RX_DMA, DMA_HTIF | DMA_TCIF);
+	serial_RxUpdate();
+}
+
+/**
+ * @brief USART2 interrupt, the receive line has gone idle
+ */
+void usart2_exti26_isr()
+{
+	if((USART_ISR(USART2) & USART_ISR_IDLE) != 0)
+	{
+		USART_ICR(USART2) = USART_ICR_IDLECF;
+		serial_RxUpdate();
+	}
+}
@@ -18,7 +18,21 @@
 #if !defined(_SERIAL_H_)
 #define _SERIAL_H_
 
+#include <stdbool.h>
+
+#define SERIAL_RX_BUFFER	(256)	///< Size of the receive ring
+#define SERIAL_TX_BUFFER	(1024)	///< Size of the transmit ring
+#define SERIAL_TX_RESERVE_MAX	(SERIAL_TX_BUFFER / 2)	///< Largest transmit reservation that can always be met
+#define SERIAL_TX_CHUNK		(64)	///< Bytes serial_Send() copies per reservation
+
 void serial_Init();
 void serial_Send(const char *buffer, unsigned int len);
+char *serial_Reserve(unsigned int size);
+unsigned int serial_Space();
+void serial_Commit(unsigned int len);
+void serial_Abort();
+unsigned int serial_Peek(const char **data);
+void serial_Release(unsigned int len);
+bool serial_Overflowed();
 
 #endif
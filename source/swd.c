@@ -0,0 +1,146 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "swd.h"
+#include "jtag.h"
+#include <stdbool.h>
+
+#define SWD_RESET_CLOCKS	(56)		///< Clocks with SWDIO high for a line reset, at least 50
+#define SWD_JTAG_TO_SWD		(0xE79E)	///< Switching sequence from JTAG to SWD, sent LSB first
+#define SWD_REQUEST_DPIDR	(0xA5)		///< Request to read the DP IDR: start, DP, read, address 0, parity, stop, park
+
+static void swd_Write(uint32_t data, unsigned int bits);
+static uint32_t swd_Read(unsigned int bits);
+static void swd_Turnaround(bool output);
+
+//SWCLK is carried on the TCK signal and SWDIO on the TMS signal. The target
+//samples SWDIO on the rising edge of SWCLK and changes it after the rising
+//edge, jtag_Clock() leaves SWCLK low so SWDIO is set or read just before
+//each clock.
+
+/**
+ * @brief Send bits on SWDIO, LSB first
+ */
+static void swd_Write(uint32_t data, unsigned int bits)
+{
+	while(bits-- > 0)
+	{
+		jtag_Set(JTAG_SIGNAL_TMS, (data & 0x01) != 0);
+		jtag_Clock();
+		data >>= 1;
+	}
+}
+
+/**
+ * @brief Read bits from SWDIO, LSB first
+ */
+static uint32_t swd_Read(unsigned int bits)
+{
+	uint32_t data = 0;
+	unsigned int bit;
+
+	for(bit = 0; bit < bits; ++bit)
+	{
+		if(jtag_Get(JTAG_SIGNAL_TMS))
+		{
+			data |= (1 << bit);
+		}
+		jtag_Clock();
+	}
+	return data;
+}
+
+/**
+ * @brief Hand SWDIO over between the host and the target
+ *
+ * @param[in] output true when the host takes SWDIO back
+ */
+static void swd_Turnaround(bool output)
+{
+	if(!output)
+	{
+		jtag_SetDirection(JTAG_SIGNAL_TMS, false);
+	}
+	jtag_Clock();
+	if(output)
+	{
+		jtag_SetDirection(JTAG_SIGNAL_TMS, true);
+	}
+}
+
+/**
+ * @brief Reset the SWD line
+ *
+ * A DP read of the IDR has to follow before any other request.
+ */
+void swd_LineReset()
+{
+	swd_Write(0xFFFFFFFF, 32);
+	swd_Write(0xFFFFFFFF, SWD_RESET_CLOCKS - 32);
+}
+
+/**
+ * @brief Move a SWJ-DP from JTAG over to SWD
+ *
+ * Sends a line reset, the JTAG to SWD sequence, a second line reset and a
+ * couple of idle clocks. A JTAG TAP sees the sequence as a TAP reset.
+ */
+void swd_SwitchFromJTAG()
+{
+	swd_LineReset();
+	swd_Write(SWD_JTAG_TO_SWD, 16);
+	swd_LineReset();
+	swd_Write(0, 2);
+}
+
+/**
+ * @brief Read the DP IDR
+ *
+ * @param[out] dpidr The DP IDR, only valid for #SWD_ACK_OK
+ * @returns The ACK given by the target, SWD_ACK_xxx. Anything else means
+ * there was no valid reply.
+ */
+unsigned int swd_ReadDPIDR(uint32_t *dpidr)
+{
+	unsigned int ack;
+
+	swd_Write(SWD_REQUEST_DPIDR, 8);
+	swd_Turnaround(false);
+	ack = swd_Read(3);
+	if(ack == SWD_ACK_OK)
+	{
+		uint32_t data = swd_Read(32);
+		uint32_t parity = swd_Read(1);
+		uint32_t check = data;
+
+		//fold the data down to its parity bit
+		check ^= check >> 16;
+		check ^= check >> 8;
+		check ^= check >> 4;
+		check ^= check >> 2;
+		check ^= check >> 1;
+		if((check & 0x01) != parity)
+		{
+			ack = SWD_ACK_PARITY;
+		}
+		*dpidr = data;
+	}
+	swd_Turnaround(true);
+	swd_Write(0, 2);	//idle
+
+	return ack;
+}
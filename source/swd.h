@@ -0,0 +1,32 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_SWD_H_)
+#define _SWD_H_
+
+#include <stdint.h>
+
+#define SWD_ACK_OK		(0x01)	///< The request was accepted
+#define SWD_ACK_WAIT		(0x02)	///< The target is busy, try again
+#define SWD_ACK_FAULT		(0x04)	///< The target had an error
+#define SWD_ACK_PARITY		(0x08)	///< The request was accepted, but the data failed the parity check
+
+extern void swd_LineReset();
+extern void swd_SwitchFromJTAG();
+extern unsigned int swd_ReadDPIDR(uint32_t *dpidr);
+
+#endif
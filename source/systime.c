@@ -0,0 +1,57 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <libopencm3/cm3/systick.h>
+#include "systime.h"
+
+#define SYSTIME_AHB_FREQUENCY	(64000000)	///< Core clock set up by main()
+
+static volatile uint32_t systime_Milliseconds;	///< Milliseconds since systime_Init()
+
+/**
+ * @brief Start the millisecond system tick
+ *
+ * SysTick is run from the AHB clock and interrupts once every millisecond.
+ */
+void systime_Init()
+{
+	systime_Milliseconds = 0;
+
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload((SYSTIME_AHB_FREQUENCY / 1000) - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
+}
+
+/**
+ * @brief Get the number of milliseconds since systime_Init()
+ *
+ * Wraps after roughly 49 days, unsigned subtraction of two readings still
+ * gives the right interval.
+ */
+uint32_t systime_Get()
+{
+	return systime_Milliseconds;
+}
+
+/**
+ * @brief SysTick interrupt handler
+ */
+void sys_tick_handler()
+{
+	++systime_Milliseconds;
+}
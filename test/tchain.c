@@ -23,6 +23,10 @@
 #define jtag_Set		chain_Mock_jtag_Set
 #define jtag_Get		chain_Mock_jtag_Get
 #define jtag_Clock		chain_Mock_jtag_Clock
+#define jtag_Shift		chain_Mock_jtag_Shift
+#define jtag_GetClockDelay	chain_Mock_jtag_GetClockDelay
+#define jtag_SetSamplePhase	chain_Mock_jtag_SetSamplePhase
+#define jtag_GetSamplePhase	chain_Mock_jtag_GetSamplePhase
 #define jtagTAP_SetState	chain_Mock_jtagTAP_SetState
 #define serial_Write		chain_Mock_serial_Write		//get rid of a unnneded function
 
@@ -41,6 +45,9 @@ static bool TDO;			///< Fake chain TDO state
 static bool TDI;			///< Fake chain TDI state
 static bool chain_reset;		///< Was the chain reset
 static int usage_error;			///< did a usage error occur?
+static unsigned int chain_phase;	///< Fake sample phase
+static unsigned int chain_phase_min;	///< First sample phase that reads TDO correctly
+static unsigned int chain_phase_max = ~0U;	///< Last sample phase that reads TDO correctly
 
 /**
  * @brief Test the fake chain implementation
@@ -283,6 +290,50 @@ void chain_Mock_jtag_Set(jtag_Signal sig, bool state)
 	}
 }
 
+/**
+ * @brief Shift bits through the fake chain
+ */
+uint32_t chain_Mock_jtag_Shift(uint32_t tdi, unsigned int bits)
+{
+	uint32_t tdo = 0;
+	unsigned int bit;
+
+	for(bit = 0; bit < bits; ++bit)
+	{
+		bool bad_phase = (chain_phase < chain_phase_min) || (chain_phase > chain_phase_max);
+
+		tdo |= ((chain_Mock_jtag_Get(JTAG_SIGNAL_TDO) != bad_phase) ? 1U : 0U) << bit;
+		chain_Mock_jtag_Set(JTAG_SIGNAL_TDI, ((tdi >> bit) & 0x01) != 0);
+		chain_Mock_jtag_Clock();
+	}
+	return tdo;
+}
+
+/**
+ * @brief Fake clock delay
+ */
+unsigned int chain_Mock_jtag_GetClockDelay()
+{
+	return 150;
+}
+
+/**
+ * @brief Fake sample phase, shifts read incorrectly outside of a window
+ */
+bool chain_Mock_jtag_SetSamplePhase(unsigned int phase)
+{
+	chain_phase = phase;
+	return true;
+}
+
+/**
+ * @brief Get the fake sample phase
+ */
+unsigned int chain_Mock_jtag_GetSamplePhase()
+{
+	return chain_phase;
+}
+
 /**
  * @brief Test the device counting algorithm
  *
@@ -431,6 +482,47 @@ bool chain_TestResetDRIDCodes()
 	return true;
 }
 
+/**
+ * @brief Test the sample phase calibration
+ *
+ * With a clock delay of 150, the phases tried are 0, 10, ... 150. The middle
+ * of the phases that read correctly should be chosen, and nothing chosen if
+ * none do.
+ */
+bool chain_TestCalibrate()
+{
+	char ir[] = { 0xFF };
+	char dr[] = { 0x00 };
+
+	chain_ir = ir;
+	chain_ir_len = 4;
+	chain_dr = dr;
+	chain_dr_len = 2;	//two devices in BYPASS
+	chain_IRLength = 4;
+	chain_Devices = 2;
+	usage_error = 0;
+
+	chain_phase_min = 40;
+	chain_phase_max = 100;
+	chain_phase = 150;
+	ASSERT(chain_Calibrate(), "Calibration failed");
+	ASSERT(chain_phase == 70, "Phase set to %i, should be %i", chain_phase, 70);
+
+	chain_phase_min = 200;
+	chain_phase_max = 200;
+	chain_phase = 150;
+	ASSERT(!chain_Calibrate(), "Calibration passed with no working phase");
+	ASSERT(chain_phase == 150, "Phase changed to %i", chain_phase);
+
+	chain_Devices = 0;
+	ASSERT(!chain_Calibrate(), "Calibration passed without a chain");
+	ASSERT(usage_error == 0, "Usage Error: %i", usage_error);
+
+	chain_phase_min = 0;
+	chain_phase_max = ~0U;
+	return true;
+}
+
 /**
  * NULL function to get rid of serial_Write linking
  */
@@ -25,5 +25,6 @@ extern bool chain_TestChainIRLength();
 extern bool chain_TestResetDRIDCode();
 extern bool chain_TestDetect();
 extern bool chain_TestResetDRIDCodes();
+extern bool chain_TestCalibrate();
 
 #endif
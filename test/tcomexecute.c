@@ -0,0 +1,344 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tcomexecute.h"
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+//Mock out the modules that aren't otherwise part of the tests.
+#define burst_Start		comexec_Mock_burst_Start
+#define burst_IsRunning		comexec_Mock_burst_IsRunning
+#define knock_Start		comexec_Mock_knock_Start
+#define knock_Resume		comexec_Mock_knock_Resume
+#define knock_Incremental	comexec_Mock_knock_Incremental
+#define knock_Abort		comexec_Mock_knock_Abort
+#define knock_IsRunning		comexec_Mock_knock_IsRunning
+#define knock_Status		comexec_Mock_knock_Status
+#define knock_ModeNames		comexec_Mock_knock_ModeNames
+#define serial_Reserve		comexec_Mock_serial_Reserve
+#define serial_Commit		comexec_Mock_serial_Commit
+#define jtag_Shift		comexec_Mock_jtag_Shift
+
+#include "../source/comexecute.c"
+
+static unsigned int comexec_BurstCalls;		///< Number of burst_Start() calls
+static uint32_t comexec_BurstCount;		///< Count given to the last burst_Start()
+static char comexec_Sent[COMEXEC_SHIFT_NIBBLES];	///< Space handed out by the serial_Reserve() mock
+static char comexec_TDO[64];			///< Hex committed by the serial_Commit() mock
+static char comexec_TDI[64];			///< TDI given to the jtag_Shift() mock, as hex in shift order
+static unsigned int comexec_ShiftCalls;		///< Number of jtag_Shift() calls
+
+const char * const comexec_Mock_knock_ModeNames[KNOCK_MODE_MAX] = {
+	[KNOCK_MODE_RESET] = "reset",
+	[KNOCK_MODE_BYPASS] = "bypass",
+	[KNOCK_MODE_SWD] = "swd",
+};
+
+/**
+ * @brief Look a command up by a name that isn't terminated where the token ends
+ */
+static const comexec_Command *comexec_TestFind(const char *Name)
+{
+	comexec_Token token = {.Text = Name, .Length = strcspn(Name, " ")};
+
+	return comexec_Find(&token);
+}
+
+/**
+ * @brief Test the command table
+ *
+ * The table has to stay sorted for comexec_Find(), which has to find every
+ * command and nothing else.
+ */
+bool comexec_TestCommandTable()
+{
+	unsigned int index;
+
+	for(index = 0; index < COMEXEC_COMMANDS; ++index)
+	{
+		if(index > 0)
+		{
+			ASSERT(strcmp(comexec_Commands[index - 1].Name, comexec_Commands[index].Name) < 0, "Table not sorted at %s", comexec_Commands[index].Name);
+		}
+		ASSERT(comexec_TestFind(comexec_Commands[index].Name) == &comexec_Commands[index], "%s not found", comexec_Commands[index].Name);
+		ASSERT(comexec_Commands[index].MaxArgs <= COMEXEC_ARGS_MAX, "%s takes too many arguments", comexec_Commands[index].Name);
+	}
+
+	ASSERT(comexec_TestFind("") == NULL, "Empty command found");
+	ASSERT(comexec_TestFind("a") == NULL, "Command before the table found");
+	ASSERT(comexec_TestFind("zzz") == NULL, "Command after the table found");
+	ASSERT(comexec_TestFind("sca") == NULL, "Partial command found");
+	ASSERT((comexec_TestFind("SCAN 2") != NULL) && (comexec_TestFind("SCAN 2") == comexec_TestFind("scan")), "Command not found by its token");
+
+	return true;
+}
+
+/**
+ * @brief Split a command on spaces and execute it, as the command processor would
+ */
+static void comexec_TestExecute(const char *Line)
+{
+	comexec_Token tokens[COMEXEC_TOKENS_MAX];
+	unsigned int count = 0;
+	unsigned int index;
+
+	while(*Line != '\0')
+	{
+		if(*Line == ' ')
+		{
+			++Line;
+			continue;
+		}
+		if(count < COMEXEC_TOKENS_MAX)
+		{
+			tokens[count].Text = Line;
+			tokens[count].Length = strcspn(Line, " ");
+			tokens[count].Number = (strspn(Line, "0123456789") == tokens[count].Length);
+			tokens[count].Value = 0;
+			for(index = 0; tokens[count].Number && (index < tokens[count].Length); ++index)
+			{
+				tokens[count].Value = (tokens[count].Value * 10) + (Line[index] - '0');
+			}
+		}
+		Line += strcspn(Line, " ");
+		++count;
+	}
+	comexec_Execute(tokens, count);
+}
+
+/**
+ * @brief Test commands are dispatched with their arguments checked
+ */
+bool comexec_TestDispatch()
+{
+	comexec_BurstCalls = 0;
+
+	comexec_TestExecute("clock 25");
+	ASSERT((comexec_BurstCalls == 1) && (comexec_BurstCount == 25), "clock not executed: %i calls", comexec_BurstCalls);
+
+	//bad number, too many and too few arguments, unknown command
+	comexec_TestExecute("clock 2x");
+	comexec_TestExecute("clock 1 2");
+	comexec_TestExecute("clock");
+	comexec_TestExecute("clocks 1");
+	comexec_TestExecute("clo 1");
+	ASSERT(comexec_BurstCalls == 1, "Invalid clock executed: %i calls", comexec_BurstCalls);
+
+	//more tokens than any command takes
+	comexec_TestExecute("clock 1 2 3 4 5 6 7 8 9 10 11");
+	ASSERT(comexec_BurstCalls == 1, "Long command executed");
+
+	//keywords are matched regardless of case
+	comexec_TestExecute("CLOCK 3");
+	ASSERT((comexec_BurstCalls == 2) && (comexec_BurstCount == 3), "upper case clock not executed: %i calls", comexec_BurstCalls);
+
+	return true;
+}
+
+/**
+ * @brief Start shift mode without a TAP to check
+ */
+static void comexec_TestShiftStart()
+{
+	comexec_Shifting = true;
+	comexec_ShiftLF = false;
+	comexec_TDO[0] = '\0';
+	comexec_TDI[0] = '\0';
+	comexec_ShiftCalls = 0;
+}
+
+/**
+ * @brief Test the hex lookup table
+ *
+ * Both cases of hex digit are decoded, everything else is invalid.
+ */
+bool comexec_TestHexNibbles()
+{
+	const char *digits = "0123456789abcdef";
+	unsigned int index;
+	uint8_t expected;
+
+	for(index = 0; index < 256; ++index)
+	{
+		expected = COMEXEC_HEX_INVALID;
+		if((index != 0) && (strchr(digits, tolower(index)) != NULL))
+		{
+			expected = strchr(digits, tolower(index)) - digits;
+		}
+		ASSERT(comexec_HexNibbles[index] == expected, "Character %02X decoded as %02X, should be %02X", index, comexec_HexNibbles[index], expected);
+	}
+	return true;
+}
+
+/**
+ * @brief Test shifting hex input
+ *
+ * Hex is shifted COMEXEC_SHIFT_NIBBLES at a time and whatever is left at
+ * the end of each piece of input straight away, whether or not it is a
+ * whole byte. TDO comes back as hex in the same order. The mock chain
+ * returns TDI inverted.
+ */
+bool comexec_TestShift()
+{
+	const char *split[] = {"012", "3456789a", "B"};
+	unsigned int used;
+	unsigned int index;
+
+	//data split across calls, including an odd number of nibbles
+	comexec_TestShiftStart();
+	for(index = 0; index < 3; ++index)
+	{
+		used = comexec_Shift(split[index], strlen(split[index]));
+		ASSERT(used == strlen(split[index]), "Only %i of \"%s\" used", used, split[index]);
+		ASSERT(comexec_IsShifting(), "Shift mode ended by \"%s\"", split[index]);
+	}
+	ASSERT(strcmp(comexec_TDI, "0123456789AB") == 0, "TDI incorrect: %s", comexec_TDI);
+	ASSERT(strcmp(comexec_TDO, "FEDCBA987654") == 0, "TDO incorrect: %s", comexec_TDO);
+	ASSERT(comexec_ShiftCalls == 3, "%i shifts, should be 3", comexec_ShiftCalls);
+
+	//a character that isn't hex ends it, and is consumed
+	used = comexec_Shift("5g12", 4);
+	ASSERT(used == 2, "%i bytes used, should be 2", used);
+	ASSERT(!comexec_IsShifting(), "Shift mode not ended by an invalid character");
+	ASSERT(strcmp(comexec_TDI, "0123456789AB5") == 0, "TDI incorrect after the end: %s", comexec_TDI);
+
+	//a CRLF is consumed whole
+	comexec_TestShiftStart();
+	used = comexec_Shift("F0\r\n", 4);
+	ASSERT((used == 4) && !comexec_IsShifting(), "CRLF not consumed: %i bytes used", used);
+	ASSERT(strcmp(comexec_TDO, "0F") == 0, "TDO incorrect before CRLF: %s", comexec_TDO);
+
+	//even when the LF comes separately
+	comexec_TestShiftStart();
+	used = comexec_Shift("F0\r", 3);
+	ASSERT((used == 3) && comexec_IsShifting(), "LF not waited for after CR");
+	used = comexec_Shift("\nhelp\n", 6);
+	ASSERT((used == 1) && !comexec_IsShifting(), "Separate LF not consumed: %i bytes used", used);
+
+	//but a CR on its own doesn't eat the next command
+	comexec_TestShiftStart();
+	comexec_Shift("1\r", 2);
+	used = comexec_Shift("help\n", 5);
+	ASSERT((used == 0) && !comexec_IsShifting(), "Command after CR consumed: %i bytes used", used);
+
+	//a LF terminator doesn't wait for anything
+	comexec_TestShiftStart();
+	used = comexec_Shift("1\n", 2);
+	ASSERT((used == 2) && !comexec_IsShifting(), "LF terminator not handled");
+	ASSERT(comexec_ShiftCalls == 1, "%i shifts, should be 1", comexec_ShiftCalls);
+
+	return true;
+}
+
+/**
+ * @brief Mock burst_Start
+ */
+bool comexec_Mock_burst_Start(uint32_t count)
+{
+	++comexec_BurstCalls;
+	comexec_BurstCount = count;
+	return true;
+}
+
+/**
+ * @brief Mock burst_IsRunning, bursts finish straight away
+ */
+bool comexec_Mock_burst_IsRunning()
+{
+	return false;
+}
+
+/**
+ * @brief Mock knock_Start
+ */
+void comexec_Mock_knock_Start(knock_Mode mode, unsigned int Pins, unsigned int Options)
+{
+}
+
+/**
+ * @brief Mock knock_Resume
+ */
+bool comexec_Mock_knock_Resume()
+{
+	return false;
+}
+
+/**
+ * @brief Mock knock_Incremental
+ */
+bool comexec_Mock_knock_Incremental()
+{
+	return false;
+}
+
+/**
+ * @brief Mock knock_Abort
+ */
+bool comexec_Mock_knock_Abort()
+{
+	return false;
+}
+
+/**
+ * @brief Mock knock_IsRunning
+ */
+bool comexec_Mock_knock_IsRunning()
+{
+	return false;
+}
+
+/**
+ * @brief Mock knock_Status
+ */
+void comexec_Mock_knock_Status()
+{
+}
+
+/**
+ * @brief Mock serial_Reserve
+ */
+char *comexec_Mock_serial_Reserve(unsigned int size)
+{
+	return comexec_Sent;
+}
+
+/**
+ * @brief Mock serial_Commit
+ */
+void comexec_Mock_serial_Commit(unsigned int len)
+{
+	strncat(comexec_TDO, comexec_Sent, len);
+}
+
+/**
+ * @brief Mock jtag_Shift, records TDI and returns it inverted
+ */
+uint32_t comexec_Mock_jtag_Shift(uint32_t tdi, unsigned int bits)
+{
+	unsigned int index;
+	char *text = &comexec_TDI[strlen(comexec_TDI)];
+
+	++comexec_ShiftCalls;
+	for(index = 0; index < bits; index += 4)
+	{
+		*text++ = comexec_HexDigits[(tdi >> index) & 0x0F];
+	}
+	*text = '\0';
+	return ~tdi;
+}
@@ -0,0 +1,446 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tcomframe.h"
+#include <stdint.h>
+#include <string.h>
+
+//Mock out the functions used by the packets under test.
+#define serial_Reserve		comframe_Mock_serial_Reserve
+#define serial_Commit		comframe_Mock_serial_Commit
+#define comproc_Execute		comframe_Mock_comproc_Execute
+#define jtag_IsAllocated	comframe_Mock_jtag_IsAllocated
+#define jtag_Shift		comframe_Mock_jtag_Shift
+#define burst_Start		comframe_Mock_burst_Start
+#define burst_IsRunning		comframe_Mock_burst_IsRunning
+#define knock_IsRunning		comframe_Mock_knock_IsRunning
+#define knock_Start		comframe_Mock_knock_Start
+#define knock_Abort		comframe_Mock_knock_Abort
+#define knock_GetProgress	comframe_Mock_knock_GetProgress
+#define results_Count		comframe_Mock_results_Count
+#define results_Get		comframe_Mock_results_Get
+#define jtag_SetClockRate	comframe_Mock_jtag_SetClockRate
+#define jtag_GetClockRate	comframe_Mock_jtag_GetClockRate
+#define jtag_SetOversample	comframe_Mock_jtag_SetOversample
+#define jtag_GetOversample	comframe_Mock_jtag_GetOversample
+
+#include "../source/comframe.c"
+
+static uint8_t comframe_Sent[COMFRAME_ENCODED_MAX];	///< Space handed out by the serial_Reserve() mock
+static unsigned int comframe_SentLength;		///< Length of the last committed reply
+static unsigned int comframe_ShiftCalls;		///< Number of jtag_Shift() calls
+static unsigned int comframe_ShiftBits;			///< Total bits given to jtag_Shift()
+static bool comframe_ExecuteResult;			///< Result the comproc_Execute() mock returns
+static bool comframe_Scanning;				///< A scan has been started by the knock_Start() mock
+static unsigned int comframe_ScanPins;			///< Pins given to the knock_Start() mock
+static unsigned int comframe_ClockRate;			///< Rate held by the jtag_SetClockRate() mock
+static unsigned int comframe_Oversample;		///< Samples held by the jtag_SetOversample() mock
+
+/**
+ * @brief The hit returned by the results_Get() mock, a two device chain
+ */
+static const results_Hit comframe_Hit = {
+	.tck = 0, .tms = 1, .tdi = 2, .tdo = 3, .modes = 1 << KNOCK_MODE_RESET, .score = RESULTS_SCORE_CONFIRMED,
+	.seen = 2, .devices = 2, .clocks = 0x00012345, .idcodes = {0x4BA00477, 0x06414041},
+};
+
+/**
+ * @brief Encode and receive a request packet
+ *
+ * @param crcError Corrupt the CRC
+ * @retval true The packet was accepted as a whole, ending at its delimiter.
+ */
+static bool comframe_TestRequest(uint8_t id, uint8_t sequence, const uint8_t *data, unsigned int length, bool crcError)
+{
+	uint8_t packet[COMFRAME_PACKET_MAX];
+	uint8_t encoded[COMFRAME_ENCODED_MAX];
+	unsigned int count;
+	unsigned int index;
+	uint16_t crc;
+	bool more = true;
+
+	packet[0] = id;
+	packet[1] = sequence;
+	packet[2] = length;
+	memcpy(&packet[COMFRAME_HEADER], data, length);
+	crc = comframe_CRC(packet, COMFRAME_HEADER + length) ^ (crcError ? 1 : 0);
+	packet[COMFRAME_HEADER + length] = crc & 0xFF;
+	packet[COMFRAME_HEADER + length + 1] = crc >> 8;
+	count = comframe_Encode(packet, COMFRAME_HEADER + length + COMFRAME_CRC_SIZE, encoded);
+	encoded[count++] = 0x00;
+
+	comframe_SentLength = 0;
+	comframe_Start();
+	for(index = 0; (index < count) && more; ++index)
+	{
+		more = comframe_Receive(encoded[index]);
+	}
+	return !more && (index == count);
+}
+
+/**
+ * @brief Decode the last reply sent
+ *
+ * @param[out] packet The decoded packet, CRC included
+ * @return The length of the packet or 0 if it was malformed or its CRC wrong
+ */
+static unsigned int comframe_TestReply(uint8_t *packet)
+{
+	unsigned int count = 0;
+	unsigned int index = 1;
+	unsigned int block;
+	uint8_t code;
+
+	if((comframe_SentLength < 3) || (comframe_Sent[0] != COMFRAME_MAGIC) || (comframe_Sent[comframe_SentLength - 1] != 0x00))
+	{
+		return 0;
+	}
+	while(index < comframe_SentLength - 1)
+	{
+		code = comframe_Sent[index++];
+		for(block = 1; block < code; ++block)
+		{
+			packet[count++] = comframe_Sent[index++];
+		}
+		if((code != 0xFF) && (index < comframe_SentLength - 1))
+		{
+			packet[count++] = 0x00;
+		}
+	}
+	if((count < COMFRAME_HEADER + 1 + COMFRAME_CRC_SIZE) || (packet[2] != count - COMFRAME_HEADER - COMFRAME_CRC_SIZE) ||
+		(comframe_CRC(packet, count - COMFRAME_CRC_SIZE) != (packet[count - 2] | (packet[count - 1] << 8))))
+	{
+		return 0;
+	}
+	return count;
+}
+
+/**
+ * @brief Test the CRC against the CRC-16/CCITT-FALSE check value
+ */
+bool comframe_TestCRC()
+{
+	const uint8_t check[] = "123456789";
+	uint16_t crc = comframe_CRC(check, 9);
+	ASSERT(crc == 0x29B1, "CRC incorrect: %04X should be 29B1", crc);
+	return true;
+}
+
+/**
+ * @brief Test a packet makes it through COBS both ways
+ *
+ * A ping with zeros in its data is echoed back with the same sequence
+ * number and an OK status.
+ */
+bool comframe_TestPing()
+{
+	const uint8_t data[] = {0x00, 0x11, 0x00, 0x00, 0x22};
+	uint8_t reply[COMFRAME_PACKET_MAX];
+	unsigned int length;
+
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_PING, 0x5A, data, sizeof(data), false), "Packet not received");
+	length = comframe_TestReply(reply);
+	ASSERT(length == COMFRAME_HEADER + 1 + sizeof(data) + COMFRAME_CRC_SIZE, "Reply length incorrect: %i", length);
+	ASSERT((reply[0] == (COMFRAME_CMD_PING | COMFRAME_REPLY)) && (reply[1] == 0x5A), "Reply id or sequence incorrect");
+	ASSERT(reply[COMFRAME_HEADER] == COMFRAME_STATUS_OK, "Reply status incorrect: %i", reply[COMFRAME_HEADER]);
+	ASSERT(memcmp(&reply[COMFRAME_HEADER + 1], data, sizeof(data)) == 0, "Reply data incorrect");
+
+	return true;
+}
+
+/**
+ * @brief Test bad packets are reported rather than executed
+ */
+bool comframe_TestErrors()
+{
+	uint8_t reply[COMFRAME_PACKET_MAX];
+
+	//CRC error
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_PING, 1, NULL, 0, true), "Packet not received");
+	ASSERT(comframe_TestReply(reply) != 0, "No reply");
+	ASSERT((reply[0] == (COMFRAME_CMD_INVALID | COMFRAME_REPLY)) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_CRC), "CRC error not reported");
+
+	//unknown command
+	ASSERT(comframe_TestRequest(0x42, 2, NULL, 0, false), "Packet not received");
+	ASSERT(comframe_TestReply(reply) != 0, "No reply");
+	ASSERT((reply[0] == (0x42 | COMFRAME_REPLY)) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_COMMAND), "Unknown command not reported");
+
+	//truncated packet
+	comframe_SentLength = 0;
+	comframe_Start();
+	comframe_Receive(0x05);
+	comframe_Receive(COMFRAME_CMD_PING);
+	ASSERT(!comframe_Receive(0x00), "Packet not ended");
+	ASSERT((comframe_TestReply(reply) != 0) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_LENGTH), "Short packet not reported");
+
+	return true;
+}
+
+/**
+ * @brief Test bulk shifts
+ *
+ * The bits are shifted 32 at a time and TDO comes back packed the same way
+ * as TDI. The mock chain returns TDI inverted.
+ */
+bool comframe_TestShift()
+{
+	const uint8_t data[] = {40, 0, 0x01, 0x23, 0x45, 0x67, 0x89};
+	const uint8_t expected[] = {0xFE, 0xDC, 0xBA, 0x98, 0x76};
+	uint8_t reply[COMFRAME_PACKET_MAX];
+	unsigned int length;
+
+	comframe_ShiftCalls = 0;
+	comframe_ShiftBits = 0;
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_SHIFT, 3, data, sizeof(data), false), "Packet not received");
+	length = comframe_TestReply(reply);
+	ASSERT(length == COMFRAME_HEADER + 1 + sizeof(expected) + COMFRAME_CRC_SIZE, "Reply length incorrect: %i", length);
+	ASSERT(reply[COMFRAME_HEADER] == COMFRAME_STATUS_OK, "Reply status incorrect: %i", reply[COMFRAME_HEADER]);
+	ASSERT(memcmp(&reply[COMFRAME_HEADER + 1], expected, sizeof(expected)) == 0, "TDO incorrect");
+	ASSERT((comframe_ShiftCalls == 2) && (comframe_ShiftBits == 40), "Shift calls incorrect: %i calls %i bits", comframe_ShiftCalls, comframe_ShiftBits);
+
+	//the bit count has to match the data
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_SHIFT, 4, data, sizeof(data) - 1, false), "Packet not received");
+	ASSERT((comframe_TestReply(reply) != 0) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_LENGTH), "Bad length not reported");
+
+	return true;
+}
+
+/**
+ * @brief Test a text command's result is the reply status
+ */
+bool comframe_TestExecute()
+{
+	const uint8_t command[] = "tap reset";
+	uint8_t reply[COMFRAME_PACKET_MAX];
+
+	comframe_ExecuteResult = true;
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_EXECUTE, 5, command, sizeof(command) - 1, false), "Packet not received");
+	ASSERT((comframe_TestReply(reply) != 0) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_OK), "OK command not reported");
+
+	comframe_ExecuteResult = false;
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_EXECUTE, 6, command, sizeof(command) - 1, false), "Packet not received");
+	ASSERT((comframe_TestReply(reply) != 0) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_FAILED), "Failed command not reported");
+
+	return true;
+}
+
+/**
+ * @brief Test the scan, results and clock configuration packets
+ */
+bool comframe_TestQueries()
+{
+	const uint8_t start[] = {16, KNOCK_MODE_BYPASS, KNOCK_OPTION_FIRST};
+	const uint8_t badMode[] = {16, KNOCK_MODE_MAX, 0};
+	const uint8_t abort[] = {COMFRAME_SCAN_ABORT};
+	const uint8_t progress[] = {COMFRAME_SCAN_RUNNING, 3, 0, 240, 0, 1, 0x2C, 0x01};
+	const uint8_t hit[] = {1, 2, 3, 4, 1 << KNOCK_MODE_RESET, RESULTS_SCORE_CONFIRMED, 2, 2,
+		0x45, 0x23, 0x01, 0x00, 0x77, 0x04, 0xA0, 0x4B, 0x41, 0x40, 0x41, 0x06};
+	const uint8_t index = 0;
+	const uint8_t badIndex = 1;
+	const uint8_t clock[] = {0xE8, 0x03, 0, 0, 3};
+	const uint8_t clockReply[] = {0xE8, 0x03, 0, 0, 3};
+	uint8_t reply[COMFRAME_PACKET_MAX];
+	unsigned int length;
+
+	//scan start, its progress and abort
+	comframe_Scanning = false;
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_SCAN, 7, badMode, sizeof(badMode), false), "Packet not received");
+	ASSERT((comframe_TestReply(reply) != 0) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_PARAMETER), "Bad mode not reported");
+	ASSERT(!comframe_Scanning, "Scan started with a bad mode");
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_SCAN, 8, start, sizeof(start), false), "Packet not received");
+	length = comframe_TestReply(reply);
+	ASSERT(length == COMFRAME_HEADER + 1 + sizeof(progress) + COMFRAME_CRC_SIZE, "Scan reply length incorrect: %i", length);
+	ASSERT(reply[COMFRAME_HEADER] == COMFRAME_STATUS_OK, "Scan not started: %i", reply[COMFRAME_HEADER]);
+	ASSERT(comframe_Scanning && (comframe_ScanPins == 16), "Scan started incorrectly");
+	ASSERT(memcmp(&reply[COMFRAME_HEADER + 1], progress, sizeof(progress)) == 0, "Scan progress incorrect");
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_SCAN, 9, abort, sizeof(abort), false), "Packet not received");
+	ASSERT((comframe_TestReply(reply) != 0) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_OK), "Abort failed");
+	ASSERT(reply[COMFRAME_HEADER + 1] == COMFRAME_SCAN_ABORTED, "Scan state incorrect after abort: %i", reply[COMFRAME_HEADER + 1]);
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_SCAN, 10, abort, sizeof(abort), false), "Packet not received");
+	ASSERT((comframe_TestReply(reply) != 0) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_FAILED), "Second abort not reported");
+
+	//results count, a hit and a hit that isn't there
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_RESULTS, 11, NULL, 0, false), "Packet not received");
+	length = comframe_TestReply(reply);
+	ASSERT((length == COMFRAME_HEADER + 2 + COMFRAME_CRC_SIZE) && (reply[COMFRAME_HEADER + 1] == 1), "Results count incorrect");
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_RESULTS, 12, &index, 1, false), "Packet not received");
+	length = comframe_TestReply(reply);
+	ASSERT(length == COMFRAME_HEADER + 2 + sizeof(hit) + COMFRAME_CRC_SIZE, "Hit length incorrect: %i", length);
+	ASSERT(memcmp(&reply[COMFRAME_HEADER + 2], hit, sizeof(hit)) == 0, "Hit incorrect");
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_RESULTS, 13, &badIndex, 1, false), "Packet not received");
+	ASSERT((comframe_TestReply(reply) != 0) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_PARAMETER), "Bad index not reported");
+
+	//clock configuration
+	comframe_ClockRate = 500;
+	comframe_Oversample = 1;
+	ASSERT(comframe_TestRequest(COMFRAME_CMD_CLOCK_CONFIG, 14, clock, sizeof(clock), false), "Packet not received");
+	length = comframe_TestReply(reply);
+	ASSERT((length == COMFRAME_HEADER + 1 + sizeof(clockReply) + COMFRAME_CRC_SIZE) && (reply[COMFRAME_HEADER] == COMFRAME_STATUS_OK), "Clock not set");
+	ASSERT(memcmp(&reply[COMFRAME_HEADER + 1], clockReply, sizeof(clockReply)) == 0, "Clock reply incorrect");
+
+	return true;
+}
+
+/**
+ * @brief Mock serial_Reserve
+ */
+char *comframe_Mock_serial_Reserve(unsigned int size)
+{
+	return (char *)comframe_Sent;
+}
+
+/**
+ * @brief Mock serial_Commit
+ */
+void comframe_Mock_serial_Commit(unsigned int len)
+{
+	comframe_SentLength = len;
+}
+
+/**
+ * @brief Mock comproc_Execute
+ */
+bool comframe_Mock_comproc_Execute(const char *Line, unsigned int Length)
+{
+	return comframe_ExecuteResult;
+}
+
+/**
+ * @brief Mock jtag_IsAllocated, every signal is assigned
+ */
+bool comframe_Mock_jtag_IsAllocated(jtag_Signal sig)
+{
+	return true;
+}
+
+/**
+ * @brief Mock jtag_Shift, returns TDI inverted
+ */
+uint32_t comframe_Mock_jtag_Shift(uint32_t tdi, unsigned int bits)
+{
+	++comframe_ShiftCalls;
+	comframe_ShiftBits += bits;
+	return (bits < 32) ? (~tdi & ((1UL << bits) - 1)) : ~tdi;
+}
+
+/**
+ * @brief Mock burst_Start
+ */
+bool comframe_Mock_burst_Start(uint32_t count)
+{
+	return true;
+}
+
+/**
+ * @brief Mock burst_IsRunning
+ */
+bool comframe_Mock_burst_IsRunning()
+{
+	return false;
+}
+
+/**
+ * @brief Mock knock_IsRunning
+ */
+bool comframe_Mock_knock_IsRunning()
+{
+	return false;
+}
+
+/**
+ * @brief Mock knock_Start
+ */
+void comframe_Mock_knock_Start(knock_Mode mode, unsigned int Pins, unsigned int Options)
+{
+	comframe_Scanning = true;
+	comframe_ScanPins = Pins;
+}
+
+/**
+ * @brief Mock knock_Abort
+ */
+bool comframe_Mock_knock_Abort()
+{
+	bool running = comframe_Scanning;
+
+	comframe_Scanning = false;
+	return running;
+}
+
+/**
+ * @brief Mock knock_GetProgress, a 16 pin scan 3 pairs in
+ */
+void comframe_Mock_knock_GetProgress(knock_Progress *progress)
+{
+	progress->done = 3;
+	progress->total = 240;
+	progress->hits = 1;
+	progress->eta = 300;
+	progress->running = comframe_Scanning;
+	progress->resumable = !comframe_Scanning;
+}
+
+/**
+ * @brief Mock results_Count, one hit
+ */
+unsigned int comframe_Mock_results_Count()
+{
+	return 1;
+}
+
+/**
+ * @brief Mock results_Get
+ */
+const results_Hit *comframe_Mock_results_Get(unsigned int index)
+{
+	return &comframe_Hit;
+}
+
+/**
+ * @brief Mock jtag_SetClockRate
+ */
+bool comframe_Mock_jtag_SetClockRate(unsigned int khz)
+{
+	comframe_ClockRate = khz;
+	return true;
+}
+
+/**
+ * @brief Mock jtag_GetClockRate
+ */
+unsigned int comframe_Mock_jtag_GetClockRate()
+{
+	return comframe_ClockRate;
+}
+
+/**
+ * @brief Mock jtag_SetOversample
+ */
+bool comframe_Mock_jtag_SetOversample(unsigned int reads)
+{
+	comframe_Oversample = reads;
+	return true;
+}
+
+/**
+ * @brief Mock jtag_GetOversample
+ */
+unsigned int comframe_Mock_jtag_GetOversample()
+{
+	return comframe_Oversample;
+}
@@ -19,43 +19,77 @@
 #include "tcomprocessor.h"
 
 #define comexec_Execute		comproc_Mock_comexec_Execute
+#define comexec_IsShifting	comproc_Mock_comexec_IsShifting
+#define comexec_Shift		comproc_Mock_comexec_Shift
+#define comframe_Init		comproc_Mock_comframe_Init
+#define comframe_Start		comproc_Mock_comframe_Start
+#define comframe_Receive	comproc_Mock_comframe_Receive
 
 #include "../source/comprocessor.c"
 
 /**
- * A pointer to what should be received by the mock execute function
+ * A pointer to the tokens that should be received by the mock execute
+ * function, separated by single spaces
  */
 static char *expected_Execute;
 /**
- * The expected length of the buffer passed for execution
+ * The expected number of tokens passed for execution
  */
 static unsigned int expected_ExecuteLen;
 
 /**
- * -2 wrong length was passed
+ * -2 wrong number of tokens was passed
  * -1 if the wrong data was passed
  * 0 if not called
  * 1 if correct
  */
 static int result_Execute;
 
+/**
+ * The number of times execute was called
+ */
+static unsigned int count_Execute;
+
+/**
+ * The tokens passed for execution
+ */
+static comexec_Token result_Tokens[COMEXEC_TOKENS_MAX];
+
 /**
  * @brief Test that execute is being called with the expected values
+ *
+ * Commands starting with fail report a failure.
  */
-void comproc_Mock_comexec_Execute(char *buffer, unsigned int length)
+bool comproc_Mock_comexec_Execute(const comexec_Token *Tokens, unsigned int Count)
 {
-	if(strncmp(buffer, expected_Execute, length) == 0)
+	char line[COMPROC_BUFFER_LENGTH + COMEXEC_TOKENS_MAX] = "";
+	unsigned int index;
+
+	++count_Execute;
+
+	for(index = 0; (index < Count) && (index < COMEXEC_TOKENS_MAX); ++index)
 	{
-		result_Execute = 1;
+		result_Tokens[index] = Tokens[index];
+		if(index > 0)
+		{
+			strcat(line, " ");
+		}
+		strncat(line, Tokens[index].Text, Tokens[index].Length);
 	}
-	else if(length != expected_ExecuteLen)
+
+	if(Count != expected_ExecuteLen)
 	{
 		result_Execute = -2;
 	}
+	else if(strcmp(line, expected_Execute) == 0)
+	{
+		result_Execute = 1;
+	}
 	else
 	{
 		result_Execute = -1;
 	}
+	return (strncmp(line, "fail", 4) != 0);
 }
 
 /**
@@ -83,18 +117,16 @@ bool comproc_TestProcess()
 {
 	//test CRLF terminator
 	comproc_Init();
-	expected_Execute = "test one\r\n";
-	expected_ExecuteLen = 10;
+	expected_Execute = "test one";
+	expected_ExecuteLen = 2;
 	result_Execute = 0;
 
 	comproc_Process("test one\r\n", 10);
 	ASSERT(result_Execute == 1, "execute failed: %i", result_Execute);
 	ASSERT(comproc_BufferLength == 0, "buffer length not reset");
 
-	//test CR terminator
+	//test LF terminator
 	comproc_Init();
-	expected_Execute = "test one\n";
-	expected_ExecuteLen = 10;
 	result_Execute = 0;
 
 	comproc_Process("test one\n", 9);
@@ -104,19 +136,27 @@ bool comproc_TestProcess()
 }
 
 /**
- * @brief Test the command processor converts bytes to lower case
+ * @brief Test the command processor tokenizes commands in place
  *
- * The command processor should convert uppercase characters to lowercase
+ * A whole command should be split into tokens that point into the incoming
+ * buffer, leaving the case alone and converting the numbers.
  */
-bool comproc_TestProcessToLower()
+bool comproc_TestProcessTokens()
 {
+	const char *command = "tEst  ONe 2 4294967296 THREE\r\n";
+
 	comproc_Init();
-	expected_Execute = "test one 2 three\r\n";
-	expected_ExecuteLen = 18;
+	expected_Execute = "tEst ONe 2 4294967296 THREE";
+	expected_ExecuteLen = 5;
 	result_Execute = 0;
 
-	comproc_Process("tEst ONe 2 THREE\r\n", 18);
+	comproc_Process(command, strlen(command));
 	ASSERT(result_Execute == 1, "execute failed: %i", result_Execute);
+	ASSERT(result_Tokens[0].Text == command, "command was copied");
+	ASSERT(!result_Tokens[1].Number, "ONe is a number");
+	ASSERT(result_Tokens[2].Number && (result_Tokens[2].Value == 2), "2 not converted");
+	ASSERT(!result_Tokens[3].Number, "too big a number converted");
+	ASSERT(comproc_BufferLength == 0, "buffer length not reset");
 
 	return true;
 }
@@ -132,8 +172,8 @@ bool comproc_TestProcessBSDel()
 {
 	//test backspace and delete
 	comproc_Init();
-	expected_Execute = "test one 2 three\r\n";
-	expected_ExecuteLen = 18;
+	expected_Execute = "tEst ONe 2 THREE";
+	expected_ExecuteLen = 4;
 	result_Execute = 0;
 
 	comproc_Process("tEstc6\b\b Op\x7FNe 2 THREE\r\n", 24);
@@ -155,8 +195,8 @@ bool comproc_TestProcessBSDel()
 bool comproc_TestProcessSmallPackets()
 {
 	comproc_Init();
-	expected_Execute = "test one 2 three\r\n";
-	expected_ExecuteLen = 18;
+	expected_Execute = "test one 2 three";
+	expected_ExecuteLen = 4;
 	result_Execute = 0;
 
 	comproc_Process("t", 1);
@@ -180,8 +220,8 @@ bool comproc_TestProcessSmallPackets()
 bool comproc_TestProcessMultiCommands()
 {
 	comproc_Init();
-	expected_Execute = "test one 2 three\r\n";
-	expected_ExecuteLen = 18;
+	expected_Execute = "test one 2 three";
+	expected_ExecuteLen = 4;
 	result_Execute = 0;
 
 	comproc_Process("test one 2 three\r\n", 18);
@@ -228,3 +268,72 @@ bool comproc_TestProcessHugePacket()
 
 	return true;
 }
+
+/**
+ * @brief Test executing commands from a packet
+ *
+ * Every line should be executed in turn, the last one without a terminator,
+ * and a failure of any of them should be reported.
+ */
+bool comproc_TestExecute()
+{
+	expected_Execute = "test one";
+	expected_ExecuteLen = 2;
+	result_Execute = 0;
+	count_Execute = 0;
+
+	ASSERT(comproc_Execute("test one", 8), "single command failed");
+	ASSERT((result_Execute == 1) && (count_Execute == 1), "execute failed: %i, %i calls", result_Execute, count_Execute);
+
+	result_Execute = 0;
+	count_Execute = 0;
+	ASSERT(comproc_Execute("tap\r\ntest one\n", 14), "two commands failed");
+	ASSERT((result_Execute == 1) && (count_Execute == 2), "execute failed: %i, %i calls", result_Execute, count_Execute);
+
+	result_Execute = 0;
+	count_Execute = 0;
+	ASSERT(!comproc_Execute("fail\ntest one", 13), "failed command not reported");
+	ASSERT((result_Execute == 1) && (count_Execute == 2), "execute failed: %i, %i calls", result_Execute, count_Execute);
+
+	return true;
+}
+
+/**
+ * @brief Mock comframe_Init
+ */
+void comproc_Mock_comframe_Init()
+{
+}
+
+/**
+ * @brief Mock comframe_Start
+ */
+void comproc_Mock_comframe_Start()
+{
+}
+
+/**
+ * @brief Mock comframe_Receive
+ *
+ * Packets end at their zero delimiter.
+ */
+bool comproc_Mock_comframe_Receive(uint8_t data)
+{
+	return (data != 0x00);
+}
+
+/**
+ * @brief Mock comexec_IsShifting, shift mode is never entered
+ */
+bool comproc_Mock_comexec_IsShifting()
+{
+	return false;
+}
+
+/**
+ * @brief Mock comexec_Shift
+ */
+unsigned int comproc_Mock_comexec_Shift(const char *Buffer, unsigned int Len)
+{
+	return Len;
+}
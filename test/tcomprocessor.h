@@ -22,10 +22,11 @@
 
 extern bool comproc_TestInitialization();
 extern bool comproc_TestProcess();
-extern bool comproc_TestProcessToLower();
+extern bool comproc_TestProcessTokens();
 extern bool comproc_TestProcessBSDel();
 extern bool comproc_TestProcessSmallPackets();
 extern bool comproc_TestProcessMultiCommands();
 extern bool comproc_TestProcessHugePacket();
+extern bool comproc_TestExecute();
 
 #endif
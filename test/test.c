@@ -29,6 +29,13 @@
 #include "tchain.h"
 #include "tmessage.h"
 #include "tcomprocessor.h"
+#include "tcomframe.h"
+#include "tcomexecute.h"
+#include "tresults.h"
+#include "tscanlog.h"
+#include "tswd.h"
+#include "tknock.h"
+#include "tserial.h"
 
 #define MESSAGE_WRITE_BUFFER	128
 
@@ -52,6 +59,12 @@ static const test_tFunc test_Functions[] =
 	jtag_TestGet,
 	jtag_TestGetUnallocated,
 	jtag_TestIsAllocated,
+	jtag_TestSamplePins,
+	jtag_TestSetDirection,
+	jtag_TestReadPins,
+	jtag_TestCfgAll,
+	jtag_TestShift,
+	jtag_TestGetSignalPort,
 
 	//JTAG TAP tests
 	jtagTAP_TestInitilization,
@@ -64,20 +77,73 @@ static const test_tFunc test_Functions[] =
 	chain_TestChainIRLength,
 	chain_TestResetDRIDCode,
 	chain_TestResetDRIDCodes,
+	chain_TestCalibrate,
 
 	//Message tests
 	message_TestInitialization,
 	message_TestSetLevel,
 	message_TestMessages,
+	message_TestBuildLevel,
+	message_TestRecord,
+	message_TestFormat,
+	message_TestReserve,
+	message_TestFormatSpeed,
 
 	//Command processor tests
 	comproc_TestInitialization,
 	comproc_TestProcess,
-	comproc_TestProcessToLower,
+	comproc_TestProcessTokens,
 	comproc_TestProcessBSDel,
 	comproc_TestProcessSmallPackets,
 	comproc_TestProcessMultiCommands,
 	comproc_TestProcessHugePacket,
+	comproc_TestExecute,
+
+	//Command execution tests
+	comexec_TestCommandTable,
+	comexec_TestDispatch,
+	comexec_TestHexNibbles,
+	comexec_TestShift,
+
+	//Framed protocol tests
+	comframe_TestCRC,
+	comframe_TestPing,
+	comframe_TestErrors,
+	comframe_TestShift,
+	comframe_TestExecute,
+	comframe_TestQueries,
+
+	//Results tests
+	results_TestInitialization,
+	results_TestAdd,
+	results_TestDuplicate,
+	results_TestFull,
+
+	//Scan log tests
+	scanlog_TestRecord,
+	scanlog_TestSettled,
+	scanlog_TestFull,
+	scanlog_TestEdges,
+	scanlog_TestGroups,
+
+	//SWD tests
+	swd_TestSwitchFromJTAG,
+	swd_TestReadDPIDR,
+
+	//Scan tests
+	knock_TestConfirmTDI,
+	knock_TestScoreTDI,
+	knock_TestScoreConfirmed,
+	knock_TestResume,
+	knock_TestPairOrder,
+	knock_TestIncremental,
+	knock_TestResetPins,
+
+	//Serial tests
+	serial_TestPeek,
+	serial_TestPeekWrap,
+	serial_TestOverflow,
+	serial_TestReserve,
 };
 
 #define TESTS (sizeof(test_Functions)/sizeof(test_tFunc))	///< Number of functions in the test
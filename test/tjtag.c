@@ -24,16 +24,41 @@
 #define LIBOPENCM3_GPIO_H
 #define LIBOPENCM3_RCC_H
 
-//define the registers that we are interested in
-static uint32_t GPIOD_MODER;	///< GPIO D Mode Register. p143 STM32F302xx Reference Manual.
-static uint32_t GPIOD_OTYPER;	///< GPIO D Output type Register. p143 STM32F302xx Reference Manual.
-static uint32_t GPIOD_OSPEEDR;	///< GPIO D Output speed Register. p144 STM32F302xx Reference Manual.
-static uint32_t GPIOD_PUPDR;	///< GPIO D Pull up/down Register. p144 STM32F302xx Reference Manual.
-static uint32_t GPIOD_IDR;	///< GPIO D Input Data Register. p145 STM32F302xx Reference Manual.
-static uint32_t GPIOD_ODR;	///< GPIO D Output Data Register. p145 STM32F302xx Reference Manual.
-static uint32_t GPIOD_BSRR;	///< GPIO D Bit Set/Reset Register. p146 STM32F302xx Reference Manual.
+//define the ports, as indexes into the register arrays
+#define GPIOA	(0)
+#define GPIOB	(1)
+#define GPIOC	(2)
+#define GPIOD	(3)
+#define GPIOE	(4)
+#define GPIOF	(5)
+#define TJTAG_PORTS	(6)
+
+//define the registers that we are interested in, for every port
+static uint32_t GPIO_MODER_Regs[TJTAG_PORTS];	///< GPIO Mode Register. p143 STM32F302xx Reference Manual.
+static uint32_t GPIO_OTYPER_Regs[TJTAG_PORTS];	///< GPIO Output type Register. p143 STM32F302xx Reference Manual.
+static uint32_t GPIO_OSPEEDR_Regs[TJTAG_PORTS];	///< GPIO Output speed Register. p144 STM32F302xx Reference Manual.
+static uint32_t GPIO_PUPDR_Regs[TJTAG_PORTS];	///< GPIO Pull up/down Register. p144 STM32F302xx Reference Manual.
+static uint32_t GPIO_IDR_Regs[TJTAG_PORTS];	///< GPIO Input Data Register. p145 STM32F302xx Reference Manual.
+static uint32_t GPIO_ODR_Regs[TJTAG_PORTS];	///< GPIO Output Data Register. p145 STM32F302xx Reference Manual.
+static uint32_t GPIO_BSRR_Regs[TJTAG_PORTS];	///< GPIO Bit Set/Reset Register. p146 STM32F302xx Reference Manual.
 static uint32_t RCC_AHBENR;	///< RCC AHB Enable Register. p116 STM32F302xx Reference Manual.
 
+#define GPIO_MODER(port)	GPIO_MODER_Regs[port]
+#define GPIO_OTYPER(port)	GPIO_OTYPER_Regs[port]
+#define GPIO_OSPEEDR(port)	GPIO_OSPEEDR_Regs[port]
+#define GPIO_PUPDR(port)	GPIO_PUPDR_Regs[port]
+#define GPIO_IDR(port)		GPIO_IDR_Regs[port]
+#define GPIO_ODR(port)		GPIO_ODR_Regs[port]
+#define GPIO_BSRR(port)		GPIO_BSRR_Regs[port]
+
+#define GPIOD_MODER	GPIO_MODER(GPIOD)
+#define GPIOD_OTYPER	GPIO_OTYPER(GPIOD)
+#define GPIOD_OSPEEDR	GPIO_OSPEEDR(GPIOD)
+#define GPIOD_PUPDR	GPIO_PUPDR(GPIOD)
+#define GPIOD_IDR	GPIO_IDR(GPIOD)
+#define GPIOD_ODR	GPIO_ODR(GPIOD)
+#define GPIOD_BSRR	GPIO_BSRR(GPIOD)
+
 //include the file *source*
 #include "../source/jtag.c"
 
@@ -135,8 +160,9 @@ bool jtag_TestInitRegisterSetup()
 	ASSERT(((GPIOD_ODR == 0x00000000) || (GPIOD_BSRR == 0xFFFF0000)), "GPIO output state set incorrectly: ODR: %08X  BSRR: %08X.", GPIOD_ODR, GPIOD_BSRR);
 
 	//RCC_AHBENR enables the clocks for various peripherals
-	//we need to turn on bit 20 and not disturb the state of the other bits
-	ASSERT((RCC_AHBENR == (1<<20)), "RCC clock wasn't enabled correctly. Was %08X, should be %08X.", RCC_AHBENR, (1<<20));
+	//we need to turn on bits 18, 19, 20 and 22 for ports B, C, D and F and
+	//not disturb the state of the other bits
+	ASSERT((RCC_AHBENR == 0x005C0000), "RCC clock wasn't enabled correctly. Was %08X, should be %08X.", RCC_AHBENR, 0x005C0000);
 	RCC_AHBENR = 0xFFFFFFFF;
 	jtag_Init();
 	ASSERT((RCC_AHBENR == 0xFFFFFFFF), "RCC clock set disturbed other bits. Was %08X, should be %08X.", RCC_AHBENR, 0xFFFFFFFF);
@@ -219,11 +245,11 @@ bool jtag_TestSignalConfigSetInput()
  * @brief Test that an invalid pin is handled correctly
  *
  * Nothing should change when the provided pin for a signal is outside of the
- * allowed range. Which currently is pins 0 - 15.
+ * allowed range. Which currently is pins 0 - JTAG_PIN_MAX - 1.
  */
 bool jtag_TestSignalConfigSetInvalid()
 {
-	const unsigned int pin_num = 22;
+	const unsigned int pin_num = JTAG_PIN_MAX;
 	unsigned int old_PinUsage;
 	uint32_t old_MODER;
 	bool val;
@@ -532,3 +558,180 @@ bool jtag_TestIsAllocated()
 
 	return true;
 }
+
+/**
+ * @brief Test jtag_SamplePins()
+ *
+ * The port should be read and the pull ups/downs removed again afterwards.
+ */
+bool jtag_TestSamplePins()
+{
+	jtag_PinMask val;
+	jtag_Init();
+
+	GPIOD_IDR = 0x1234;
+	GPIO_IDR(GPIOC) = 0;
+	GPIO_IDR(GPIOB) = 0;
+	GPIO_IDR(GPIOF) = 0;
+	GPIOD_PUPDR = 0xABCD1234;
+	val = jtag_SamplePins(JTAG_PULL_UP);
+	ASSERT((val == 0x1234), "Pins read incorrectly: %04X, should be %04X.", (unsigned int)val, 0x1234);
+	ASSERT((GPIOD_PUPDR == 0x00000000), "GPIO pull up/down left set: %08X, should be %08X.", GPIOD_PUPDR, 0);
+
+	//a pin on each port, the other bits of the ports aren't scan pins
+	GPIOD_IDR = 0x8000;			//PD15, pin 15
+	GPIO_IDR(GPIOC) = 0xE020;		//PC5, pin 21
+	GPIO_IDR(GPIOB) = 0x100C;		//PB12, pin 31
+	GPIO_IDR(GPIOF) = 0x0208;		//PF9, pin 39
+	GPIO_PUPDR(GPIOB) = 0x00000030;		//PB2 isn't a scan pin
+	val = jtag_SamplePins(JTAG_PULL_DOWN);
+	ASSERT((val == (JTAG_PIN(15) | JTAG_PIN(21) | JTAG_PIN(31) | JTAG_PIN(39))), "Pins read incorrectly: %08X%08X", (unsigned int)(val >> 32), (unsigned int)val);
+	ASSERT((GPIO_PUPDR(GPIOB) == 0x00000030), "GPIOB pull up/down changed: %08X, should be %08X.", GPIO_PUPDR(GPIOB), 0x00000030);
+	ASSERT((GPIO_PUPDR(GPIOC) == 0) && (GPIO_PUPDR(GPIOF) == 0), "GPIO pull up/down left set");
+
+	return true;
+}
+
+/**
+ * @brief Test jtag_SetDirection()
+ *
+ * Only the mode bits of the signal's pin should change.
+ */
+bool jtag_TestSetDirection()
+{
+	jtag_Init();
+
+	jtag_SetDirection(JTAG_SIGNAL_TMS, false);
+	ASSERT((GPIOD_MODER == 0x00000011), "Mode register incorrect: %08X, should be %08X.", GPIOD_MODER, 0x00000011);
+	jtag_SetDirection(JTAG_SIGNAL_TMS, true);
+	ASSERT((GPIOD_MODER == 0x00000015), "Mode register incorrect: %08X, should be %08X.", GPIOD_MODER, 0x00000015);
+
+	return true;
+}
+
+/**
+ * @brief Test jtag_ReadPins() and signals on other ports
+ *
+ * The ports should be mapped onto the logical pins in order, PD0 - PD15,
+ * PC0 - PC12, PB10 - PB15, PB0 - PB1, PF2, PF4 and PF9. Signals on the other
+ * ports should use their own registers.
+ */
+bool jtag_TestReadPins()
+{
+	jtag_PinMask val;
+	jtag_Init();
+
+	GPIO_IDR(GPIOD) = 0x00008001;
+	GPIO_IDR(GPIOC) = 0x0000F001;	//PC13 - PC15 aren't pins
+	GPIO_IDR(GPIOB) = 0x00008402;
+	GPIO_IDR(GPIOF) = 0x00000214;
+	val = jtag_ReadPins();
+	ASSERT((val == 0xF430018001ULL), "Pins read incorrectly: %08X%08X", (unsigned int)(val >> 32), (unsigned int)val);
+
+	GPIO_BSRR(GPIOF) = 0;
+	ASSERT(jtag_Cfg(JTAG_SIGNAL_TRST, 39), "Configuration failed");
+	ASSERT((GPIO_MODER(GPIOF) & (3 << 18)) == (1 << 18), "Mode set incorrectly: %08X", GPIO_MODER(GPIOF));
+	jtag_Set(JTAG_SIGNAL_TRST, true);
+	ASSERT((GPIO_BSRR(GPIOF) == (1 << 9)), "Pin wasn't set correctly. BSRR: %08X should be %08x", GPIO_BSRR(GPIOF), 1 << 9);
+	ASSERT(jtag_Get(JTAG_SIGNAL_TRST), "Signal not active.");
+
+	return true;
+}
+
+/**
+ * @brief Test jtag_CfgAll()
+ *
+ * A whole map should be applied at once, with the pins no longer used going
+ * back to inputs. An invalid map shouldn't change anything.
+ */
+bool jtag_TestCfgAll()
+{
+	int map[JTAG_SIGNAL_MAX] = {
+		[JTAG_SIGNAL_TCK] = 4,
+		[JTAG_SIGNAL_TMS] = 1,
+		[JTAG_SIGNAL_TDI] = 16,
+		[JTAG_SIGNAL_TDO] = 5,
+		[JTAG_SIGNAL_TRST] = JTAG_SIGNAL_NOT_ALLOCATED,
+		[JTAG_SIGNAL_SRST] = JTAG_SIGNAL_NOT_ALLOCATED,
+		[JTAG_SIGNAL_RTCK] = JTAG_SIGNAL_NOT_ALLOCATED,
+	};
+
+	GPIO_MODER(GPIOD) = 0;
+	GPIO_MODER(GPIOC) = 0;
+	jtag_Init();	//TCK, TMS, TDI and TDO on pins 0 - 3
+
+	ASSERT(jtag_CfgAll(map), "Configuration failed");
+	ASSERT((GPIO_MODER(GPIOD) == 0x00000104), "Port D mode set incorrectly: %08X should be %08X", GPIO_MODER(GPIOD), 0x00000104);
+	ASSERT((GPIO_MODER(GPIOC) == 0x00000001), "Port C mode set incorrectly: %08X should be %08X", GPIO_MODER(GPIOC), 0x00000001);
+	ASSERT((jtag_GetCfg(JTAG_SIGNAL_TDI) == 16), "TDI allocated to %i", jtag_GetCfg(JTAG_SIGNAL_TDI));
+
+	//pin 1 used twice
+	map[JTAG_SIGNAL_TDI] = 1;
+	ASSERT(!jtag_CfgAll(map), "Configuration with a pin used twice succeeded");
+	map[JTAG_SIGNAL_TDI] = JTAG_PIN_MAX;
+	ASSERT(!jtag_CfgAll(map), "Configuration with an invalid pin succeeded");
+	ASSERT((GPIO_MODER(GPIOD) == 0x00000104), "Port D mode changed: %08X", GPIO_MODER(GPIOD));
+	ASSERT((jtag_GetCfg(JTAG_SIGNAL_TDI) == 16), "TDI allocation changed to %i", jtag_GetCfg(JTAG_SIGNAL_TDI));
+
+	//and releasing everything
+	map[JTAG_SIGNAL_TCK] = JTAG_SIGNAL_NOT_ALLOCATED;
+	map[JTAG_SIGNAL_TMS] = JTAG_SIGNAL_NOT_ALLOCATED;
+	map[JTAG_SIGNAL_TDI] = JTAG_SIGNAL_NOT_ALLOCATED;
+	map[JTAG_SIGNAL_TDO] = JTAG_SIGNAL_NOT_ALLOCATED;
+	ASSERT(jtag_CfgAll(map), "Release failed");
+	ASSERT((GPIO_MODER(GPIOD) == 0) && (GPIO_MODER(GPIOC) == 0), "Pins not released: %08X %08X", GPIO_MODER(GPIOD), GPIO_MODER(GPIOC));
+	ASSERT(jtag_Cfg(JTAG_SIGNAL_TCK, 1), "Released pin can't be used");
+
+	return true;
+}
+
+/**
+ * @brief Test jtag_Shift() with oversampling
+ *
+ * Every bit of TDI should be set, TDO read and a clock given for each bit.
+ */
+bool jtag_TestShift()
+{
+	uint32_t tdo;
+	uint32_t clocks;
+
+	jtag_Init();
+	ASSERT(!jtag_SetOversample(2), "Even oversampling accepted");
+	ASSERT(!jtag_SetOversample(JTAG_OVERSAMPLE_MAX + 2), "Too much oversampling accepted");
+	ASSERT(jtag_SetOversample(3), "Oversampling not set");
+	ASSERT(jtag_SetClockRate(JTAG_CLOCK_KHZ_MAX), "Clock rate not set");
+	ASSERT(jtag_GetClockRate() == JTAG_CLOCK_KHZ_MAX, "Clock rate read back as %i", jtag_GetClockRate());
+
+	GPIOD_IDR = 0x0008;	//TDO, pin 3, high
+	clocks = jtag_GetClockCount();
+	tdo = jtag_Shift(0x00000002, 8);
+	ASSERT((tdo == 0x000000FF), "TDO read incorrectly: %08X should be %08X", tdo, 0x000000FF);
+	ASSERT((jtag_GetClockCount() - clocks) == 8, "Clocked %i times, should be %i", jtag_GetClockCount() - clocks, 8);
+	//TCK, pin 0, left low
+	ASSERT((GPIOD_BSRR == (0x0001 << 16)), "BSRR incorrect: %08X", GPIOD_BSRR);
+
+	GPIOD_IDR = 0x0000;
+	tdo = jtag_Shift(0xFFFFFFFF, 32);
+	ASSERT((tdo == 0), "TDO read incorrectly: %08X should be %08X", tdo, 0);
+	return true;
+}
+
+/**
+ * @brief Test jtag_GetSignalPort() and jtag_AddClocks()
+ */
+bool jtag_TestGetSignalPort()
+{
+	uint32_t port, clocks;
+	uint16_t bit;
+
+	jtag_Init();
+	ASSERT(jtag_Cfg(JTAG_SIGNAL_TCK, 30), "Configuration failed");
+	ASSERT(jtag_GetSignalPort(JTAG_SIGNAL_TCK, &port, &bit), "TCK not allocated");
+	ASSERT((port == GPIOB) && (bit == (1 << 11)), "TCK on port %i bit %04X, should be port %i bit %04X", port, bit, GPIOB, 1 << 11);
+	ASSERT(!jtag_GetSignalPort(JTAG_SIGNAL_TRST, &port, &bit), "TRST allocated");
+
+	clocks = jtag_GetClockCount();
+	jtag_AddClocks(100000);
+	ASSERT((jtag_GetClockCount() - clocks) == 100000, "Clock count incorrect");
+	return true;
+}
@@ -36,5 +36,11 @@ extern bool jtag_TestSetInput();
 extern bool jtag_TestGet();
 extern bool jtag_TestGetUnallocated();
 extern bool jtag_TestIsAllocated();
+extern bool jtag_TestSamplePins();
+extern bool jtag_TestSetDirection();
+extern bool jtag_TestReadPins();
+extern bool jtag_TestCfgAll();
+extern bool jtag_TestShift();
+extern bool jtag_TestGetSignalPort();
 
 #endif
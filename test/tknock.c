@@ -0,0 +1,662 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tknock.h"
+#include <stdint.h>
+
+//Mock out the pins and the TAP, the target replays a canned reset scan
+#define jtag_ReadPins		knock_Mock_jtag_ReadPins
+#define jtag_Clock		knock_Mock_jtag_Clock
+#define jtag_Set		knock_Mock_jtag_Set
+#define jtag_Cfg		knock_Mock_jtag_Cfg
+#define jtag_CfgAll		knock_Mock_jtag_CfgAll
+#define jtag_Shift		knock_Mock_jtag_Shift
+#define jtag_SamplePins		knock_Mock_jtag_SamplePins
+#define jtag_GetClockCount	knock_Mock_jtag_GetClockCount
+#define swd_SwitchFromJTAG	knock_Mock_swd_SwitchFromJTAG
+#define swd_ReadDPIDR		knock_Mock_swd_ReadDPIDR
+#define results_Add		knock_Mock_results_Add
+#define jtagTAP_SetState	knock_Mock_jtagTAP_SetState
+#define results_Find		knock_Mock_results_Find
+#define results_Get		knock_Mock_results_Get
+#define systime_Get		knock_Mock_systime_Get
+#define capture_Start		knock_Mock_capture_Start
+#define capture_Update		knock_Mock_capture_Update
+#define capture_IsFull		knock_Mock_capture_IsFull
+#define capture_Stop		knock_Mock_capture_Stop
+
+#include "../source/jtag.h"
+#include "../source/jtagtap.h"
+#include "../source/results.h"
+#include "../source/swd.h"
+#include "../source/knock.c"
+
+#define TKNOCK_TDO		(3)	///< Pin the fake TDO is on
+#define TKNOCK_MARKER		(6)	///< Clock the toggled TDI comes out on TDO
+#define TKNOCK_EARLY		(1)	///< Clock a change that can't be the marker comes out on TDO
+#define TKNOCK_SETTLED		(3)	///< Clock TDO settles at in the recorded scan
+#define TKNOCK_SIGNATURE	(0x4BA00477)	///< What the fake chain reads back from Shift-DR
+
+/**
+ * TDO in the recorded reset scan, it settles at sample 3
+ */
+static const uint8_t knock_Recorded[] = { 0, 1, 0, 1, 1, 1, 1, 1, 1, 1 };
+
+static const char *knock_Bursts;	///< What each burst shows: 'P' the marker, 'F' nothing, 'E' an early change, 'S' a change as TDO settles
+static unsigned int knock_BurstCount;	///< Number of bursts run
+static unsigned int knock_Replay;	///< Clock of the current burst
+static results_Hit knock_KnownHit;	///< The hit results_Find() finds
+static bool knock_HitKnown;		///< The hit is in the results
+
+static int knock_Signals[JTAG_SIGNAL_MAX];	///< Pin each signal is assigned to
+static int knock_PortTCK;		///< SWCLK of the fake SWD port, -1 for none
+static int knock_PortTMS;		///< SWDIO of the fake SWD port
+static unsigned int knock_Scans[JTAG_PIN_MAX * JTAG_PIN_MAX];	///< Times each TCK/TMS pair was scanned
+static unsigned int knock_ScanOrder[JTAG_PIN_MAX * JTAG_PIN_MAX];	///< The pairs in the order they were scanned, tck * JTAG_PIN_MAX + tms
+static unsigned int knock_ScanCount;	///< Number of pairs scanned
+static jtag_PinMask knock_PinLevels[JTAG_PULL_DOWN + 1];	///< What the pins read with each pull
+static uint32_t knock_Time;		///< The mocked system time
+static uint32_t knock_TimeStep;		///< Milliseconds that pass with each systime_Get()
+static bool knock_Levels[JTAG_SIGNAL_MAX];	///< Level each signal was set to
+static jtagTAP_TAPState knock_TAP;	///< State of the fake chain's TAP
+static int knock_TargetTRST;		///< Pin that resets the fake chain's TAP, -1 for none
+static int knock_TargetSRST;		///< Pin that holds the fake chain in reset, -1 for none
+
+/**
+ * @brief TAP state after a clock, for TMS low and high
+ */
+static const jtagTAP_TAPState knock_TAPNext[JTAGTAP_STATE_MAX][2] = {
+	[JTAGTAP_STATE_UNKNOWN] = { JTAGTAP_STATE_UNKNOWN, JTAGTAP_STATE_RESET },
+	[JTAGTAP_STATE_RESET] = { JTAGTAP_STATE_IDLE, JTAGTAP_STATE_RESET },
+	[JTAGTAP_STATE_IDLE] = { JTAGTAP_STATE_IDLE, JTAGTAP_STATE_DR_SCAN },
+	[JTAGTAP_STATE_DR_SCAN] = { JTAGTAP_STATE_DR_CAPTURE, JTAGTAP_STATE_IR_SCAN },
+	[JTAGTAP_STATE_DR_CAPTURE] = { JTAGTAP_STATE_DR_SHIFT, JTAGTAP_STATE_DR_EXIT1 },
+	[JTAGTAP_STATE_DR_SHIFT] = { JTAGTAP_STATE_DR_SHIFT, JTAGTAP_STATE_DR_EXIT1 },
+	[JTAGTAP_STATE_DR_EXIT1] = { JTAGTAP_STATE_DR_PAUSE, JTAGTAP_STATE_DR_UPDATE },
+	[JTAGTAP_STATE_DR_PAUSE] = { JTAGTAP_STATE_DR_PAUSE, JTAGTAP_STATE_DR_EXIT2 },
+	[JTAGTAP_STATE_DR_EXIT2] = { JTAGTAP_STATE_DR_SHIFT, JTAGTAP_STATE_DR_UPDATE },
+	[JTAGTAP_STATE_DR_UPDATE] = { JTAGTAP_STATE_IDLE, JTAGTAP_STATE_DR_SCAN },
+	[JTAGTAP_STATE_IR_SCAN] = { JTAGTAP_STATE_IR_CAPTURE, JTAGTAP_STATE_RESET },
+	[JTAGTAP_STATE_IR_CAPTURE] = { JTAGTAP_STATE_IR_SHIFT, JTAGTAP_STATE_IR_EXIT1 },
+	[JTAGTAP_STATE_IR_SHIFT] = { JTAGTAP_STATE_IR_SHIFT, JTAGTAP_STATE_IR_EXIT1 },
+	[JTAGTAP_STATE_IR_EXIT1] = { JTAGTAP_STATE_IR_PAUSE, JTAGTAP_STATE_IR_UPDATE },
+	[JTAGTAP_STATE_IR_PAUSE] = { JTAGTAP_STATE_IR_PAUSE, JTAGTAP_STATE_IR_EXIT2 },
+	[JTAGTAP_STATE_IR_EXIT2] = { JTAGTAP_STATE_IR_SHIFT, JTAGTAP_STATE_IR_UPDATE },
+	[JTAGTAP_STATE_IR_UPDATE] = { JTAGTAP_STATE_IDLE, JTAGTAP_STATE_DR_SCAN },
+};
+
+/**
+ * @brief Record the fake reset scan and set up the bursts
+ *
+ * @param[in] bursts What each burst shows, see knock_Bursts.
+ * @param[in] score Score of the hit already in the results, 0 for none.
+ */
+static void knock_TestStart(const char *bursts, unsigned int score)
+{
+	unsigned int index;
+
+	scanlog_Init(&knock_Log, knock_Events, KNOCK_EVENTS);
+	for(index = 0; index < sizeof(knock_Recorded); ++index)
+	{
+		scanlog_Record(&knock_Log, (jtag_PinMask)knock_Recorded[index] << TKNOCK_TDO);
+	}
+	knock_Bursts = bursts;
+	knock_BurstCount = 0;
+	knock_Replay = 0;
+	knock_KnownHit.score = score;
+	knock_HitKnown = (score > 0);
+}
+
+/**
+ * @brief Set up a target for whole scans
+ *
+ * The target is a SWD port, which is the cheapest scan to fake.
+ *
+ * @param[in] tck SWCLK of the port, -1 for no port.
+ * @param[in] tms SWDIO of the port.
+ */
+static void knock_TestScan(int tck, int tms)
+{
+	unsigned int index;
+
+	for(index = 0; index < JTAG_PIN_MAX * JTAG_PIN_MAX; ++index)
+	{
+		knock_Scans[index] = 0;
+	}
+	knock_ScanCount = 0;
+	knock_PortTCK = tck;
+	knock_PortTMS = tms;
+	knock_HitKnown = false;
+	knock_TargetTRST = -1;
+	knock_TargetSRST = -1;
+	knock_Time = 0;
+	knock_TimeStep = 1000;
+	knock_PinLevels[JTAG_PULL_NONE] = 0;
+	knock_PinLevels[JTAG_PULL_UP] = ~(jtag_PinMask)0;
+	knock_PinLevels[JTAG_PULL_DOWN] = 0;
+}
+
+/**
+ * @brief Run a scan until it stops
+ *
+ * @param[in] ticks Most calls to knock_Task().
+ */
+static void knock_TestRun(unsigned int ticks)
+{
+	while((ticks-- > 0) && knock_IsRunning())
+	{
+		knock_Task();
+	}
+}
+
+/**
+ * @brief Check every TCK/TMS pair of a full scan was scanned exactly once
+ */
+static bool knock_TestScannedOnce(unsigned int pins)
+{
+	unsigned int tck, tms;
+
+	for(tck = 0; tck < pins; ++tck)
+	{
+		for(tms = 0; tms < pins; ++tms)
+		{
+			unsigned int expected = (tck != tms) ? 1 : 0;
+			ASSERT(knock_Scans[(tck * JTAG_PIN_MAX) + tms] == expected, "TCK: %i TMS: %i scanned %i times", tck, tms, knock_Scans[(tck * JTAG_PIN_MAX) + tms]);
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Test aborting and resuming a scan
+ *
+ * The scan is done a pair per knock_Task(), an abort keeps its position
+ * and resuming carries on from there without repeating or skipping a pair.
+ * The progress adds up along the way.
+ */
+bool knock_TestResume()
+{
+	knock_Progress progress;
+
+	knock_TestScan(5, 2);
+	knock_Start(KNOCK_MODE_SWD, 8, 0);
+	knock_TestRun(10);
+	ASSERT(knock_ScanCount == 10, "%i pairs scanned in 10 ticks", knock_ScanCount);
+	ASSERT(knock_Abort(), "Scan not aborted");
+	knock_Task();
+
+	knock_GetProgress(&progress);
+	ASSERT(!progress.running && progress.resumable, "Aborted scan running: %i resumable: %i", progress.running, progress.resumable);
+	ASSERT((progress.done == 10) && (progress.total == 56) && (knock_ScanCount == 10), "Aborted after %i/%i pairs, %i scanned",
+		progress.done, progress.total, knock_ScanCount);
+	ASSERT(progress.eta == 46, "ETA %is at a second per pair, should be 46s", progress.eta);
+
+	ASSERT(knock_Resume(), "Scan not resumed");
+	knock_TestRun(100);
+
+	knock_GetProgress(&progress);
+	ASSERT(!progress.running && !progress.resumable, "Finished scan running: %i resumable: %i", progress.running, progress.resumable);
+	ASSERT((progress.done == 56) && (progress.total == 56) && (progress.eta == 0), "Finished with %i/%i pairs, ETA %is", progress.done, progress.total, progress.eta);
+	ASSERT(progress.hits == 1, "%i hits, should be 1", progress.hits);
+	ASSERT(knock_TestScannedOnce(8), "Pairs not scanned once");
+	ASSERT(!knock_Resume(), "Finished scan resumed");
+
+	return true;
+}
+
+/**
+ * @brief Test the order the pairs are scanned in
+ *
+ * The pairs of the common header layouts come first and aren't repeated by
+ * the exhaustive pass, which covers every other pair. Stopping at the first
+ * chain ends the scan on the pair it was found on.
+ */
+bool knock_TestPairOrder()
+{
+	static const unsigned int layouts[] = { (8 * JTAG_PIN_MAX) + 6, (3 * JTAG_PIN_MAX) + 1, (10 * JTAG_PIN_MAX) + 0, (0 * JTAG_PIN_MAX) + 4 };
+	unsigned int index;
+
+	knock_TestScan(-1, -1);
+	knock_Start(KNOCK_MODE_SWD, 12, 0);
+	knock_TestRun(1000);
+	for(index = 0; index < sizeof(layouts) / sizeof(layouts[0]); ++index)
+	{
+		ASSERT(knock_ScanOrder[index] == layouts[index], "Pair %i scanned was TCK: %i TMS: %i", index,
+			knock_ScanOrder[index] / JTAG_PIN_MAX, knock_ScanOrder[index] % JTAG_PIN_MAX);
+	}
+	ASSERT(knock_ScanCount == 132, "%i pairs scanned, should be 132", knock_ScanCount);
+	ASSERT(knock_TestScannedOnce(12), "Pairs not scanned once");
+
+	//a port on a header layout is found straight away
+	knock_TestScan(3, 1);
+	knock_Start(KNOCK_MODE_SWD, 12, KNOCK_OPTION_FIRST);
+	knock_TestRun(1000);
+	ASSERT(!knock_IsRunning() && (knock_ScanCount == 2), "Scan stopped after %i pairs, should be 2", knock_ScanCount);
+
+	//the layouts, 10 pairs with TCK 0, 11 with TCK 1 and 5 with TCK 2
+	knock_TestScan(2, 5);
+	knock_Start(KNOCK_MODE_SWD, 12, KNOCK_OPTION_FIRST);
+	knock_TestRun(1000);
+	ASSERT(!knock_IsRunning() && (knock_ScanCount == 30), "Scan stopped after %i pairs, should be 30", knock_ScanCount);
+	ASSERT(knock_ScanOrder[knock_ScanCount - 1] == (2 * JTAG_PIN_MAX) + 5, "Scan didn't stop on the port");
+
+	return true;
+}
+
+/**
+ * @brief Set up a chain and start the search for its reset pins
+ *
+ * The chain is on pins 0 - 3 of 8 and has been confirmed by the scan.
+ *
+ * @param[in] trst Pin that resets the TAP, -1 for none.
+ * @param[in] srst Pin that holds the target in reset, -1 for none.
+ */
+static void knock_TestResetStart(int trst, int srst)
+{
+	knock_TestScan(-1, -1);
+	knock_TargetTRST = trst;
+	knock_TargetSRST = srst;
+	knock_TAP = JTAGTAP_STATE_UNKNOWN;
+
+	knock_PinCount = 8;
+	knock_ScanMode = KNOCK_MODE_RESET;
+	knock_Best.tck = 0;
+	knock_Best.tms = 1;
+	knock_Best.tdi = 2;
+	knock_Best.tdo = 3;
+	knock_Best.score = RESULTS_SCORE_CONFIRMED;
+	knock_BestFound = true;
+	knock_Running = true;
+	knock_Finish();
+}
+
+/**
+ * @brief Test the search for the reset pins of a chain
+ *
+ * A pin that puts the TAP back into Test-Logic-Reset is assigned to TRST, a
+ * pin that silences the target while it is held low is assigned to SRST
+ * and a pin that does neither is left unassigned.
+ */
+bool knock_TestResetPins()
+{
+	//pin 4 is neither
+	knock_TestResetStart(5, 6);
+	ASSERT(knock_IsRunning() && (knock_State == KNOCK_STEP_PIN), "Reset pin search not started");
+	ASSERT(knock_TRSTTestable, "TRST can't be tested");
+	knock_TestRun(100);
+	ASSERT(!knock_IsRunning(), "Reset pin search still running");
+	ASSERT(knock_Signals[JTAG_SIGNAL_TRST] == 5, "TRST on %i, should be 5", knock_Signals[JTAG_SIGNAL_TRST]);
+	ASSERT(knock_Signals[JTAG_SIGNAL_SRST] == 6, "SRST on %i, should be 6", knock_Signals[JTAG_SIGNAL_SRST]);
+
+	//pins 5 and 6 are neither
+	knock_TestResetStart(7, 4);
+	knock_TestRun(100);
+	ASSERT(knock_Signals[JTAG_SIGNAL_TRST] == 7, "TRST on %i, should be 7", knock_Signals[JTAG_SIGNAL_TRST]);
+	ASSERT(knock_Signals[JTAG_SIGNAL_SRST] == 4, "SRST on %i, should be 4", knock_Signals[JTAG_SIGNAL_SRST]);
+
+	//no pin is either
+	knock_TestResetStart(-1, -1);
+	knock_TestRun(100);
+	ASSERT(!knock_IsRunning(), "Reset pin search still running");
+	ASSERT(knock_Signals[JTAG_SIGNAL_TRST] == JTAG_SIGNAL_NOT_ALLOCATED, "TRST assigned to %i", knock_Signals[JTAG_SIGNAL_TRST]);
+	ASSERT(knock_Signals[JTAG_SIGNAL_SRST] == JTAG_SIGNAL_NOT_ALLOCATED, "SRST assigned to %i", knock_Signals[JTAG_SIGNAL_SRST]);
+
+	return true;
+}
+
+/**
+ * @brief Set every TCK/TMS pair to the same state
+ */
+static void knock_TestSetPairs(unsigned int pins, knock_PairState state)
+{
+	unsigned int tck, tms;
+
+	for(tck = 0; tck < pins; ++tck)
+	{
+		for(tms = 0; tms < pins; ++tms)
+		{
+			knock_SetPairState(tck, tms, state);
+		}
+	}
+}
+
+/**
+ * @brief Test which pairs an incremental scan re-tests
+ *
+ * An excluded pair is skipped while its pins' fingerprints are unchanged, a
+ * changed pin re-tests every pair that uses it and a hit is always
+ * re-tested.
+ */
+bool knock_TestIncremental()
+{
+	jtag_PinMask changed;
+	unsigned int tck, tms;
+
+	knock_TestScan(-1, -1);
+	knock_PinCount = 6;
+	knock_Fingerprint(false);
+
+	//nothing changed
+	knock_TestSetPairs(6, KNOCK_PAIR_EXCLUDED);
+	knock_SetPairState(1, 0, KNOCK_PAIR_INCONCLUSIVE);
+	knock_SetPairState(4, 5, KNOCK_PAIR_HIT);
+	changed = knock_Fingerprint(true);
+	ASSERT(changed == 0, "Fingerprints changed: %llX", (unsigned long long)changed);
+	ASSERT(knock_GetPairState(0, 1) == KNOCK_PAIR_EXCLUDED, "Excluded pair re-tested");
+	ASSERT(knock_GetPairState(1, 0) == KNOCK_PAIR_INCONCLUSIVE, "Inconclusive pair re-tested");
+	ASSERT(knock_GetPairState(4, 5) == KNOCK_PAIR_UNTESTED, "Hit not re-tested");
+	ASSERT(knock_PairsTotal == 1, "%i pairs to re-test, should be 1", knock_PairsTotal);
+
+	//pin 2 floats high now
+	knock_TestSetPairs(6, KNOCK_PAIR_EXCLUDED);
+	knock_SetPairState(4, 5, KNOCK_PAIR_HIT);
+	knock_PinLevels[JTAG_PULL_NONE] = JTAG_PIN(2);
+	changed = knock_Fingerprint(true);
+	ASSERT(changed == JTAG_PIN(2), "Fingerprints changed: %llX, should be pin 2", (unsigned long long)changed);
+	for(tck = 0; tck < 6; ++tck)
+	{
+		for(tms = 0; tms < 6; ++tms)
+		{
+			bool retest = (tck == 2) || (tms == 2) || ((tck == 4) && (tms == 5));
+			ASSERT((tck == tms) || ((knock_GetPairState(tck, tms) == KNOCK_PAIR_UNTESTED) == retest), "TCK: %i TMS: %i state %i", tck, tms, knock_GetPairState(tck, tms));
+		}
+	}
+	ASSERT(knock_PairsTotal == 11, "%i pairs to re-test, should be 11", knock_PairsTotal);
+
+	return true;
+}
+
+/**
+ * @brief Test a single confirmation burst
+ *
+ * The walk stops at the first difference on TDO, which confirms TDI if TDO
+ * had settled in the recorded scan by then. Without a difference the whole
+ * recording is walked.
+ */
+bool knock_TestConfirmTDI()
+{
+	bool found;
+
+	knock_TestStart("P", 0);
+	ASSERT(scanlog_GetSettled(&knock_Log, JTAG_PIN(TKNOCK_TDO)) == TKNOCK_SETTLED, "Recorded scan doesn't settle at %i", TKNOCK_SETTLED);
+	found = knock_ScanResetConfirmTDI(TKNOCK_TDO);
+	ASSERT(found && (knock_Replay == TKNOCK_MARKER), "Marker found: %i, stopped at clock %i", found, knock_Replay);
+
+	knock_TestStart("S", 0);
+	found = knock_ScanResetConfirmTDI(TKNOCK_TDO);
+	ASSERT(found && (knock_Replay == TKNOCK_SETTLED), "Change as TDO settled found: %i, stopped at clock %i", found, knock_Replay);
+
+	knock_TestStart("E", 0);
+	found = knock_ScanResetConfirmTDI(TKNOCK_TDO);
+	ASSERT(!found && (knock_Replay == TKNOCK_EARLY), "Early change found: %i, stopped at clock %i", found, knock_Replay);
+
+	knock_TestStart("F", 0);
+	found = knock_ScanResetConfirmTDI(TKNOCK_TDO);
+	ASSERT(!found && (knock_Replay == sizeof(knock_Recorded)), "No change found: %i, stopped at clock %i", found, knock_Replay);
+
+	return true;
+}
+
+/**
+ * @brief Test scoring a potential TDI over repeated bursts
+ *
+ * A clean TDI is accepted after KNOCK_CONFIRM_PASSES bursts, a flaky one
+ * takes more bursts and scores lower and a dead one is rejected as soon as
+ * it can't pass any more. A TDO change before TDO settled in the recorded
+ * scan isn't the marker.
+ */
+bool knock_TestScoreTDI()
+{
+	unsigned int score;
+
+	knock_TestStart("PPPPP", 0);
+	score = knock_ScanResetScoreTDI(0, 1, 2, TKNOCK_TDO, true);
+	ASSERT((score == 100) && (knock_BurstCount == KNOCK_CONFIRM_PASSES), "Clean TDI scored %i after %i bursts", score, knock_BurstCount);
+
+	knock_TestStart("FPPFP", 0);
+	score = knock_ScanResetScoreTDI(0, 1, 2, TKNOCK_TDO, true);
+	ASSERT((score == 60) && (knock_BurstCount == 5), "Flaky TDI scored %i after %i bursts", score, knock_BurstCount);
+
+	knock_TestStart("FFFPP", 0);
+	score = knock_ScanResetScoreTDI(0, 1, 2, TKNOCK_TDO, true);
+	ASSERT((score == 0) && (knock_BurstCount == 3), "Dead TDI scored %i after %i bursts", score, knock_BurstCount);
+
+	knock_TestStart("PEPEE", 0);
+	score = knock_ScanResetScoreTDI(0, 1, 2, TKNOCK_TDO, true);
+	ASSERT((score == 0) && (knock_BurstCount == 5), "Early changes accepted, scored %i after %i bursts", score, knock_BurstCount);
+
+	return true;
+}
+
+/**
+ * @brief Test a hit confirmed by chain detection only needs one burst
+ */
+bool knock_TestScoreConfirmed()
+{
+	unsigned int score;
+
+	knock_TestStart("PFFFF", RESULTS_SCORE_CONFIRMED);
+	score = knock_ScanResetScoreTDI(0, 1, 2, TKNOCK_TDO, true);
+	ASSERT((score == 100) && (knock_BurstCount == 1), "Confirmed TDI scored %i after %i bursts", score, knock_BurstCount);
+
+	knock_TestStart("FPPPP", RESULTS_SCORE_CONFIRMED);
+	score = knock_ScanResetScoreTDI(0, 1, 2, TKNOCK_TDO, true);
+	ASSERT((score == 0) && (knock_BurstCount == 1), "Confirmed TDI scored %i after %i bursts", score, knock_BurstCount);
+
+	//potential hits still need the full confirmation
+	knock_TestStart("PFPFP", RESULTS_SCORE_POTENTIAL);
+	score = knock_ScanResetScoreTDI(0, 1, 2, TKNOCK_TDO, true);
+	ASSERT((score == 60) && (knock_BurstCount == 5), "Potential TDI scored %i after %i bursts", score, knock_BurstCount);
+
+	return true;
+}
+
+/**
+ * @brief Mock jtag_ReadPins, TDO replays the recorded scan
+ *
+ * The burst's marker, or early change, inverts TDO from its clock on.
+ */
+jtag_PinMask knock_Mock_jtag_ReadPins()
+{
+	char burst = knock_Bursts[knock_BurstCount - 1];
+	unsigned int clock = (knock_Replay < sizeof(knock_Recorded)) ? knock_Replay : (sizeof(knock_Recorded) - 1);
+	jtag_PinMask tdo = knock_Recorded[clock];
+
+	if(((burst == 'P') && (knock_Replay >= TKNOCK_MARKER)) || ((burst == 'E') && (knock_Replay >= TKNOCK_EARLY))
+		|| ((burst == 'S') && (knock_Replay >= TKNOCK_SETTLED)))
+	{
+		tdo ^= 1;
+	}
+	return tdo << TKNOCK_TDO;
+}
+
+/**
+ * @brief Mock jtag_Clock, the fake TAP follows TMS
+ */
+void knock_Mock_jtag_Clock()
+{
+	++knock_Replay;
+	knock_TAP = knock_TAPNext[knock_TAP][knock_Levels[JTAG_SIGNAL_TMS] ? 1 : 0];
+}
+
+/**
+ * @brief Mock jtag_Set, TDI is toggled around each burst
+ *
+ * TRST low on the fake TRST pin resets the TAP.
+ */
+void knock_Mock_jtag_Set(jtag_Signal sig, bool val)
+{
+	knock_Levels[sig] = val;
+	if((sig == JTAG_SIGNAL_TRST) && !val && (knock_TargetTRST >= 0) && (knock_Signals[JTAG_SIGNAL_TRST] == knock_TargetTRST))
+	{
+		knock_TAP = JTAGTAP_STATE_RESET;
+	}
+}
+
+/**
+ * @brief Mock jtag_Cfg
+ */
+bool knock_Mock_jtag_Cfg(jtag_Signal sig, int num)
+{
+	knock_Signals[sig] = num;
+	return true;
+}
+
+/**
+ * @brief Mock jtag_Shift, the fake chain
+ *
+ * The signature comes out of Shift-DR, unless the target is held in reset.
+ * TDO isn't driven otherwise and reads high.
+ */
+uint32_t knock_Mock_jtag_Shift(uint32_t tdi, unsigned int bits)
+{
+	bool held = (knock_TargetSRST >= 0) && (knock_Signals[JTAG_SIGNAL_SRST] == knock_TargetSRST) && !knock_Levels[JTAG_SIGNAL_SRST];
+
+	return ((knock_TAP == JTAGTAP_STATE_DR_SHIFT) && !held) ? TKNOCK_SIGNATURE : 0xFFFFFFFF;
+}
+
+/**
+ * @brief Mock jtagTAP_SetState, each TAP reset starts a burst
+ */
+void knock_Mock_jtagTAP_SetState(jtagTAP_TAPState target)
+{
+	if(target == JTAGTAP_STATE_RESET)
+	{
+		++knock_BurstCount;
+		knock_Replay = 0;
+	}
+}
+
+/**
+ * @brief Mock results_Find
+ */
+int knock_Mock_results_Find(unsigned int tck, unsigned int tms, unsigned int tdi, unsigned int tdo)
+{
+	return knock_HitKnown ? 0 : -1;
+}
+
+/**
+ * @brief Mock results_Get
+ */
+const results_Hit *knock_Mock_results_Get(unsigned int index)
+{
+	return &knock_KnownHit;
+}
+
+/**
+ * @brief Mock systime_Get, time moves on with each call
+ */
+uint32_t knock_Mock_systime_Get()
+{
+	knock_Time += knock_TimeStep;
+	return knock_Time;
+}
+
+/**
+ * @brief Mock jtag_CfgAll
+ */
+bool knock_Mock_jtag_CfgAll(const int map[JTAG_SIGNAL_MAX])
+{
+	jtag_Signal sig;
+
+	for(sig = JTAG_SIGNAL_TCK; sig < JTAG_SIGNAL_MAX; ++sig)
+	{
+		knock_Signals[sig] = map[sig];
+	}
+	return true;
+}
+
+/**
+ * @brief Mock jtag_SamplePins
+ */
+jtag_PinMask knock_Mock_jtag_SamplePins(jtag_Pull pull)
+{
+	return knock_PinLevels[pull];
+}
+
+/**
+ * @brief Mock jtag_GetClockCount
+ */
+uint32_t knock_Mock_jtag_GetClockCount()
+{
+	return 0;
+}
+
+/**
+ * @brief Mock swd_SwitchFromJTAG, a SWD scan of the pair starts here
+ */
+void knock_Mock_swd_SwitchFromJTAG()
+{
+	unsigned int pair = (knock_Signals[JTAG_SIGNAL_TCK] * JTAG_PIN_MAX) + knock_Signals[JTAG_SIGNAL_TMS];
+
+	++knock_Scans[pair];
+	knock_ScanOrder[knock_ScanCount++] = pair;
+}
+
+/**
+ * @brief Mock swd_ReadDPIDR, only the fake port answers
+ */
+unsigned int knock_Mock_swd_ReadDPIDR(uint32_t *dpidr)
+{
+	unsigned int ack = 0x07;
+
+	if((knock_Signals[JTAG_SIGNAL_TCK] == knock_PortTCK) && (knock_Signals[JTAG_SIGNAL_TMS] == knock_PortTMS))
+	{
+		*dpidr = 0x2BA01477;
+		ack = SWD_ACK_OK;
+	}
+	return ack;
+}
+
+/**
+ * @brief Mock results_Add
+ */
+bool knock_Mock_results_Add(const results_Hit *hit)
+{
+	return true;
+}
+
+/**
+ * @brief Mock capture_Start, edge capture isn't tested here
+ */
+void knock_Mock_capture_Start(scanlog_Log *log, scanlog_Mask pins)
+{
+}
+
+/**
+ * @brief Mock capture_Update
+ */
+unsigned int knock_Mock_capture_Update()
+{
+	return 0;
+}
+
+/**
+ * @brief Mock capture_IsFull
+ */
+bool knock_Mock_capture_IsFull()
+{
+	return true;
+}
+
+/**
+ * @brief Mock capture_Stop
+ */
+void knock_Mock_capture_Stop()
+{
+}
@@ -0,0 +1,30 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_TKNOCK_H_)
+#define _TKNOCK_H_
+#include <stdbool.h>
+
+extern bool knock_TestConfirmTDI();
+extern bool knock_TestScoreTDI();
+extern bool knock_TestScoreConfirmed();
+extern bool knock_TestResume();
+extern bool knock_TestPairOrder();
+extern bool knock_TestIncremental();
+extern bool knock_TestResetPins();
+
+#endif
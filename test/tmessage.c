@@ -17,11 +17,58 @@
  */
 #include "test.h"
 #include "tmessage.h"
+#include <string.h>
+#include <stdio.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scs.h>
 
-#define serial_Send	message_Mock_serial_Send
+#define serial_Reserve	message_Mock_serial_Reserve
+#define serial_Commit	message_Mock_serial_Commit
+#define serial_Abort	message_Mock_serial_Abort
+#define serial_Space	message_Mock_serial_Space
+#define systime_Get	message_Mock_systime_Get
 #include "../source/message.c"
 
 static unsigned int callCount_Send;
+static char message_Sent[MESSAGE_WRITE_BUFFER];	///< Space handed out by the serial_Reserve() mock
+static unsigned int message_SentLength;		///< Length of the last committed message
+static unsigned int message_Space;		///< Space the serial_Space() mock reports
+static unsigned int message_Reserved[2];	///< Sizes asked of the serial_Reserve() mock
+static unsigned int message_Reserves;		///< Number of calls to the serial_Reserve() mock
+static unsigned int message_Aborts;		///< Number of calls to the serial_Abort() mock
+
+#define MESSAGE_TEST_TIME	0x00012345	///< Time returned by the systime_Get() mock
+
+#define MESSAGE_BENCH_RUNS	100	///< Number of times each formatter is run in the benchmark
+
+/**
+ * @brief Call message_Format with a variable argument list
+ */
+static int message_Formatf(char *buffer, unsigned int size, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+	va_start(args, fmt);
+	n = message_Format(buffer, size, fmt, args);
+	va_end(args);
+	return n;
+}
+
+/**
+ * @brief Call vsnprintf with a variable argument list
+ *
+ * Kept separate from snprintf so both formatters pay the same call overhead
+ * in the benchmark.
+ */
+static int message_TestVsnprintf(char *buffer, unsigned int size, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+	va_start(args, fmt);
+	n = vsnprintf(buffer, size, fmt, args);
+	va_end(args);
+	return n;
+}
 
 /**
  * @brief Test that the message module initializes correctly
@@ -84,16 +131,244 @@ bool message_TestMessages()
 	message_Write(MESSAGE_LEVEL_REQUIRED, "Required Message");
 	ASSERT(callCount_Send == 2, "Call count incorrect: %i should be %i", callCount_Send, 2);
 
+	//formatted straight into the reserved space
+	ASSERT(message_Write(MESSAGE_LEVEL_REQUIRED, "%i-%08X", 12, 0xAB) == 11, "Incorrect length returned");
+	ASSERT((message_SentLength == 11) && (memcmp(message_Sent, "12-000000AB", 11) == 0), "Incorrect message sent: %s", message_Sent);
+
+	return true;
+}
+
+/**
+ * @brief Test binary records
+ *
+ * In MESSAGE_FORMAT_BINARY a message is sent as the address of its format,
+ * the time and its raw arguments instead of the formatted text.
+ */
+bool message_TestRecord()
+{
+	static const char format[] = "[+] Device %2i - ID Code %08X %s %%\r\n";
+	char expected[] = {
+		MESSAGE_RECORD_START, 20,
+		0, 0, 0, 0,
+		0x45, 0x23, 0x01, 0x00,
+		0xFE, 0xFF, 0xFF, 0xFF,
+		0x77, 0x04, 0xA0, 0x4B,
+		'A', 'R', 'M', '\0'
+	};
+	char text[MESSAGE_WRITE_BUFFER];
+
+	//records refer to the format by its address
+	message_Put32(&expected[2], (uint32_t)(uintptr_t)format);
+	message_Level = MESSAGE_LEVEL_GENERAL;
+	message_SetFormat(MESSAGE_FORMAT_BINARY);
+	ASSERT(message_GetFormat() == MESSAGE_FORMAT_BINARY, "Format not set");
+
+	ASSERT(message_Write(MESSAGE_LEVEL_GENERAL, format, -2, 0x4BA00477, "ARM") == sizeof(expected), "Incorrect record length");
+	ASSERT((message_SentLength == sizeof(expected)) && (memcmp(message_Sent, expected, sizeof(expected)) == 0), "Incorrect record sent");
+
+	//records that don't fit are dropped
+	memset(text, 'x', sizeof(text) - 1);
+	text[sizeof(text) - 1] = '\0';
+	ASSERT(message_Write(MESSAGE_LEVEL_GENERAL, "%s", &text[MESSAGE_RECORD_HEADER + 1]) == MESSAGE_WRITE_BUFFER - 1, "Record filling the buffer not sent");
+	ASSERT(message_Write(MESSAGE_LEVEL_GENERAL, "%s", &text[MESSAGE_RECORD_HEADER]) == -1, "Long record not rejected");
+
+	message_SetFormat(MESSAGE_FORMAT_TEXT);
+	return true;
+}
+
+/**
+ * @brief Test the formatter matches vsnprintf for the supported conversions
+ *
+ * Messages that don't fit return the length they need, those that use a
+ * conversion the formatter doesn't support return -1. Either way the
+ * buffer is left terminated.
+ */
+bool message_TestFormat()
+{
+	char expected[64];
+	char buffer[64];
+	int n;
+
+#define CHECK_FORMAT(fmt, ...) do{									\
+	n = message_Formatf(buffer, sizeof(buffer), fmt, __VA_ARGS__);				\
+	message_TestVsnprintf(expected, sizeof(expected), fmt, __VA_ARGS__);			\
+	ASSERT((n == (int)strlen(expected)) && (strcmp(buffer, expected) == 0),			\
+		"Format \"%s\" gave \"%s\" (%i) should be \"%s\"", fmt, buffer, n, expected);	\
+}while(0)
+
+	CHECK_FORMAT("Found %i devices", 3);
+	CHECK_FORMAT("%i %i %i", 0, -45, 2147483647);
+	CHECK_FORMAT("%i", (int)0x80000000);
+	CHECK_FORMAT("%u %u", 0u, 4294967295u);
+	CHECK_FORMAT("IDCODE: 0x%08X", 0x4BA00477);
+	CHECK_FORMAT("%08X %X %x", 0, 0xFFFFFFFF, 0xABCDu);
+	CHECK_FORMAT("[%2i] %4s|%s", 7, "TCK", "");
+	CHECK_FORMAT("%2i %05i %4i", 123, -42, -5);
+	CHECK_FORMAT("%c%c 100%%", 'O', 'K');
+
+#undef CHECK_FORMAT
+
+	//truncation, the length needed is still measured
+	n = message_Formatf(buffer, 8, "%s", "123456789");
+	ASSERT((n == 9) && (buffer[0] == '\0'), "Long message not measured: %i", n);
+	n = message_Formatf(buffer, 8, "%08X", 1);
+	ASSERT(n == 8, "Message filling the terminator not measured: %i", n);
+	n = message_Formatf(buffer, 9, "%08X", 1);
+	ASSERT((n == 8) && (strcmp(buffer, "00000001") == 0), "Exact fit rejected: %i", n);
+	n = message_Formatf(buffer, 8, "ab%s%ic", "12345", -12);
+	ASSERT((n == 11) && (strcmp(buffer, "ab12345") == 0), "Truncated message incorrect: \"%s\" (%i)", buffer, n);
+
+	//unsupported conversions
+	n = message_Formatf(buffer, sizeof(buffer), "ab%ld", 1L);
+	ASSERT((n == -1) && (strcmp(buffer, "ab") == 0), "Unsupported conversion not rejected: %i", n);
+
 	return true;
 }
 
 /**
- * @brief Mock serial_Send
+ * @brief Test the space reserved for messages
+ *
+ * What is free up to the end of the transmit ring is reserved, between
+ * MESSAGE_WRITE_MIN and MESSAGE_WRITE_BUFFER. A message longer than that is
+ * built again in a reservation of its measured length.
+ */
+bool message_TestReserve()
+{
+	char text[MESSAGE_WRITE_BUFFER + 1];
+
+	message_Level = MESSAGE_LEVEL_GENERAL;
+	memset(text, 'x', sizeof(text) - 1);
+	text[sizeof(text) - 1] = '\0';
+
+#define CHECK_RESERVE(space, length, reserves, first, second, aborts) do{					\
+	message_Space = (space);										\
+	message_Reserves = 0;											\
+	message_Aborts = 0;											\
+	callCount_Send = 0;											\
+	ASSERT(message_Write(MESSAGE_LEVEL_GENERAL, "%s", &text[sizeof(text) - 1 - (length)]) ==		\
+		(((length) < MESSAGE_WRITE_BUFFER) ? (length) : -1), "%i byte message not written", (length));	\
+	ASSERT(message_Reserves == (reserves), "%i reservations for %i bytes in %i, should be %i",		\
+		message_Reserves, (length), (space), (reserves));						\
+	ASSERT(message_Reserved[0] == (first), "Reserved %i for %i bytes in %i, should be %i",			\
+		message_Reserved[0], (length), (space), (first));						\
+	ASSERT(((reserves) < 2) || (message_Reserved[1] == (second)), "Reserved %i again, should be %i",	\
+		message_Reserved[1], (second));									\
+	ASSERT(message_Aborts == (aborts), "%i aborts, should be %i", message_Aborts, (aborts));		\
+	ASSERT(callCount_Send == (((length) < MESSAGE_WRITE_BUFFER) ? 1 : 0), "Commit count incorrect");	\
+}while(0)
+
+	//fits in what is free
+	CHECK_RESERVE(200, 20, 1, 200, 0, 0);
+	CHECK_RESERVE(1000, 20, 1, MESSAGE_WRITE_BUFFER, 0, 0);
+	CHECK_RESERVE(2, 20, 1, MESSAGE_WRITE_MIN, 0, 0);
+	CHECK_RESERVE(100, 99, 1, 100, 0, 0);
+
+	//measured then reserved again
+	CHECK_RESERVE(100, 100, 2, 100, 101, 1);
+	CHECK_RESERVE(0, 200, 2, MESSAGE_WRITE_MIN, 201, 1);
+	CHECK_RESERVE(MESSAGE_WRITE_MIN, MESSAGE_WRITE_BUFFER - 1, 2, MESSAGE_WRITE_MIN, MESSAGE_WRITE_BUFFER, 1);
+
+	//too long for any reservation
+	CHECK_RESERVE(MESSAGE_WRITE_MIN, MESSAGE_WRITE_BUFFER, 1, MESSAGE_WRITE_MIN, 0, 1);
+
+#undef CHECK_RESERVE
+
+	//records are measured the same way
+	message_SetFormat(MESSAGE_FORMAT_BINARY);
+	message_Space = MESSAGE_WRITE_MIN;
+	message_Reserves = 0;
+	ASSERT(message_Write(MESSAGE_LEVEL_GENERAL, "%s", &text[sizeof(text) - 101]) == MESSAGE_RECORD_HEADER + 101, "Long record not sent");
+	ASSERT((message_Reserves == 2) && (message_Reserved[1] == MESSAGE_RECORD_HEADER + 102), "Long record reserved %i", message_Reserved[1]);
+	ASSERT((message_Sent[0] == MESSAGE_RECORD_START) && (message_Sent[1] == MESSAGE_RECORD_HEADER + 99), "Long record header incorrect");
+	message_SetFormat(MESSAGE_FORMAT_TEXT);
+
+	message_Space = 0;
+	return true;
+}
+
+/**
+ * @brief Benchmark the formatter against vsnprintf
+ *
+ * Times a typical IDCODE report with the DWT cycle counter and reports the
+ * average cycles for each. Flash size is compared with `make size`.
+ */
+bool message_TestFormatSpeed()
+{
+	char buffer[MESSAGE_WRITE_BUFFER];
+	unsigned int index;
+	uint32_t start;
+	uint32_t formatCycles;
+	uint32_t vsnprintfCycles;
+
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+	start = DWT_CYCCNT;
+	for(index = 0; index < MESSAGE_BENCH_RUNS; ++index)
+	{
+		message_Formatf(buffer, sizeof(buffer), "[%2i] Device %i IDCODE: 0x%08X %s\r\n", 1, index, 0x4BA00477, "ARM");
+	}
+	formatCycles = (DWT_CYCCNT - start) / MESSAGE_BENCH_RUNS;
+
+	start = DWT_CYCCNT;
+	for(index = 0; index < MESSAGE_BENCH_RUNS; ++index)
+	{
+		message_TestVsnprintf(buffer, sizeof(buffer), "[%2i] Device %i IDCODE: 0x%08X %s\r\n", 1, index, 0x4BA00477, "ARM");
+	}
+	vsnprintfCycles = (DWT_CYCCNT - start) / MESSAGE_BENCH_RUNS;
+
+	test_Write("message_Format: %u cycles, vsnprintf: %u cycles\r\n", (unsigned int)formatCycles, (unsigned int)vsnprintfCycles);
+	ASSERT(formatCycles <= vsnprintfCycles, "Formatter slower than vsnprintf: %u > %u", (unsigned int)formatCycles, (unsigned int)vsnprintfCycles);
+
+	return true;
+}
+
+/**
+ * @brief Mock serial_Reserve
+ */
+char *message_Mock_serial_Reserve(unsigned int size)
+{
+	if(message_Reserves < sizeof(message_Reserved) / sizeof(message_Reserved[0]))
+	{
+		message_Reserved[message_Reserves] = size;
+	}
+	message_Reserves++;
+	return message_Sent;
+}
+
+/**
+ * @brief Mock serial_Commit
  *
  * Records the number of times it was called
  */
-void message_Mock_serial_Send(const char *buffer, unsigned int len)
+void message_Mock_serial_Commit(unsigned int len)
 {
 	callCount_Send += 1;
+	message_SentLength = len;
+}
+
+/**
+ * @brief Mock serial_Abort
+ */
+void message_Mock_serial_Abort()
+{
+	message_Aborts++;
+}
+
+/**
+ * @brief Mock serial_Space
+ */
+unsigned int message_Mock_serial_Space()
+{
+	return message_Space;
+}
+
+/**
+ * @brief Mock systime_Get
+ */
+uint32_t message_Mock_systime_Get()
+{
+	return MESSAGE_TEST_TIME;
 }
 
@@ -24,5 +24,10 @@
 extern bool message_TestInitialization();
 extern bool message_TestSetLevel();
 extern bool message_TestMessages();
+extern bool message_TestBuildLevel();
+extern bool message_TestRecord();
+extern bool message_TestFormat();
+extern bool message_TestReserve();
+extern bool message_TestFormatSpeed();
 
 #endif
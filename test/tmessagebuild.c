@@ -0,0 +1,47 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+//Built with a lower build level for the whole file, as make MESSAGE_LEVEL=n
+//does. The calls go to the message module built into tmessage.c, and its mocks.
+#define MESSAGE_BUILD_LEVEL	MESSAGE_LEVEL_GENERAL
+
+#include "test.h"
+#include "tmessage.h"
+#include "../source/message.h"
+
+/**
+ * @brief Test messages above the build level are compiled out
+ *
+ * Their arguments must not be evaluated, whatever the runtime level.
+ */
+bool message_TestBuildLevel()
+{
+	unsigned int evaluated = 0;
+	int n;
+
+	message_SetLevel(MESSAGE_LEVEL_DEBUG);
+
+	n = message_Write(MESSAGE_LEVEL_DEBUG, "%u", ++evaluated);
+	ASSERT(n == -2, "Debug message not compiled out: %i", n);
+	ASSERT(evaluated == 0, "Compiled out message was evaluated");
+	n = message_Write(MESSAGE_LEVEL_GENERAL, "%u", ++evaluated);
+	ASSERT(n == 1, "General message not sent: %i", n);
+	ASSERT(evaluated == 1, "General message not evaluated");
+
+	message_SetLevel(MESSAGE_LEVEL_GENERAL);
+	return true;
+}
@@ -0,0 +1,148 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tresults.h"
+
+#include "../source/results.c"
+
+/**
+ * @brief Fill in a hit for the tests
+ */
+static void results_TestMakeHit(results_Hit *hit, unsigned int tdi, unsigned int tdo, uint8_t score)
+{
+	unsigned int id;
+
+	hit->tck = 0;
+	hit->tms = 1;
+	hit->tdi = tdi;
+	hit->tdo = tdo;
+	hit->modes = 1;
+	hit->score = score;
+	hit->seen = 0;
+	hit->devices = 1;
+	hit->clocks = 100;
+	for(id = 0; id < RESULTS_MAX_IDCODES; ++id)
+	{
+		hit->idcodes[id] = 0;
+	}
+}
+
+/**
+ * @brief Test the results table initializes empty
+ */
+bool results_TestInitialization()
+{
+	results_Used = 5;
+	results_Init();
+	ASSERT(results_Count() == 0, "Count not reset: %i", results_Count());
+	ASSERT(results_Get(0) == NULL, "Got a hit from an empty table");
+
+	return true;
+}
+
+/**
+ * @brief Test adding a hit
+ *
+ * A new hit is stored as given, with a seen count of 1, and can be found by
+ * its pins.
+ */
+bool results_TestAdd()
+{
+	results_Hit hit;
+	const results_Hit *stored;
+
+	results_Init();
+	results_TestMakeHit(&hit, 2, 3, RESULTS_SCORE_POTENTIAL);
+	hit.idcodes[0] = 0x4BA00477;
+
+	ASSERT(results_Add(&hit), "Hit wasn't added");
+	ASSERT(results_Count() == 1, "Count incorrect: %i should be %i", results_Count(), 1);
+	ASSERT(results_Find(0, 1, 2, 3) == 0, "Hit not found");
+	ASSERT(results_Find(0, 1, 3, 2) == -1, "Found a hit that doesn't exist");
+
+	stored = results_Get(0);
+	ASSERT(stored->seen == 1, "Seen count incorrect: %i", stored->seen);
+	ASSERT(stored->idcodes[0] == 0x4BA00477, "ID Code incorrect: %08X", stored->idcodes[0]);
+
+	return true;
+}
+
+/**
+ * @brief Test that a duplicate hit updates the existing one
+ *
+ * Modes are merged, clocks are added and the details of the best scoring
+ * hit are kept.
+ */
+bool results_TestDuplicate()
+{
+	results_Hit hit;
+	const results_Hit *stored;
+
+	results_Init();
+	results_TestMakeHit(&hit, 2, 3, RESULTS_SCORE_POTENTIAL);
+	results_Add(&hit);
+
+	hit.modes = 2;
+	hit.score = RESULTS_SCORE_CONFIRMED;
+	hit.devices = 2;
+	hit.idcodes[1] = 0x020B20DD;
+	ASSERT(!results_Add(&hit), "Duplicate added as a new hit");
+	ASSERT(results_Count() == 1, "Count incorrect: %i should be %i", results_Count(), 1);
+
+	//a worse score mustn't replace the details
+	hit.score = 0;
+	hit.devices = 0;
+	results_Add(&hit);
+
+	stored = results_Get(0);
+	ASSERT(stored->modes == 3, "Modes incorrect: %i should be %i", stored->modes, 3);
+	ASSERT(stored->seen == 3, "Seen count incorrect: %i should be %i", stored->seen, 3);
+	ASSERT(stored->clocks == 300, "Clocks incorrect: %i should be %i", stored->clocks, 300);
+	ASSERT(stored->score == RESULTS_SCORE_CONFIRMED, "Score incorrect: %i", stored->score);
+	ASSERT(stored->devices == 2, "Devices incorrect: %i should be %i", stored->devices, 2);
+	ASSERT(stored->idcodes[1] == 0x020B20DD, "ID Code incorrect: %08X", stored->idcodes[1]);
+
+	return true;
+}
+
+/**
+ * @brief Test that a full table doesn't overflow
+ */
+bool results_TestFull()
+{
+	results_Hit hit;
+	unsigned int index;
+
+	results_Init();
+	for(index = 0; index < RESULTS_MAX; ++index)
+	{
+		results_TestMakeHit(&hit, index + 2, 40, RESULTS_SCORE_POTENTIAL);
+		ASSERT(results_Add(&hit), "Hit %i wasn't added", index);
+	}
+
+	results_TestMakeHit(&hit, 2, 41, RESULTS_SCORE_POTENTIAL);
+	ASSERT(!results_Add(&hit), "Hit added to a full table");
+	ASSERT(results_Count() == RESULTS_MAX, "Count incorrect: %i should be %i", results_Count(), RESULTS_MAX);
+
+	//known hits are still updated
+	results_TestMakeHit(&hit, 2, 40, RESULTS_SCORE_CONFIRMED);
+	results_Add(&hit);
+	ASSERT(results_Get(0)->score == RESULTS_SCORE_CONFIRMED, "Known hit not updated");
+
+	return true;
+}
@@ -0,0 +1,180 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tscanlog.h"
+
+#include "../source/scanlog.c"
+
+#define TSCANLOG_EVENTS	(8)	///< Size of the test logs
+
+/**
+ * @brief Test recording and reading back a log
+ *
+ * Only changes take up events, reading the log back gives every sample.
+ */
+bool scanlog_TestRecord()
+{
+	static const uint16_t samples[] = { 0x0001, 0x0001, 0x0003, 0x0003, 0x0003, 0x0002, 0x0002, 0x0002 };
+	scanlog_Event events[TSCANLOG_EVENTS];
+	scanlog_Log log;
+	scanlog_Reader reader;
+	unsigned int index;
+
+	scanlog_Init(&log, events, TSCANLOG_EVENTS);
+	for(index = 0; index < sizeof(samples)/sizeof(uint16_t); ++index)
+	{
+		ASSERT(scanlog_Record(&log, samples[index]), "Sample %i not recorded", index);
+	}
+
+	ASSERT(log.count == 2, "Event count incorrect: %i should be %i", log.count, 2);
+	ASSERT(scanlog_GetSamples(&log) == 8, "Sample count incorrect: %i should be %i", scanlog_GetSamples(&log), 8);
+	ASSERT(scanlog_GetLast(&log) == 0x0002, "Last sample incorrect: %04X", scanlog_GetLast(&log));
+	ASSERT(scanlog_GetChanged(&log) == 0x0003, "Changed pins incorrect: %04X", scanlog_GetChanged(&log));
+	ASSERT(scanlog_GetUnchanged(&log) == 2, "Unchanged count incorrect: %i should be %i", scanlog_GetUnchanged(&log), 2);
+
+	scanlog_Begin(&reader, &log);
+	for(index = 0; index < sizeof(samples)/sizeof(uint16_t); ++index)
+	{
+		uint16_t value = scanlog_Next(&reader);
+		ASSERT(value == samples[index], "Sample %i incorrect: %04X should be %04X", index, value, samples[index]);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Test finding where pins settled
+ */
+bool scanlog_TestSettled()
+{
+	static const uint16_t samples[] = { 0x0000, 0x0001, 0x0000, 0x0002, 0x0002, 0x0006, 0x0006 };
+	scanlog_Event events[TSCANLOG_EVENTS];
+	scanlog_Log log;
+	unsigned int index;
+
+	scanlog_Init(&log, events, TSCANLOG_EVENTS);
+	for(index = 0; index < sizeof(samples)/sizeof(uint16_t); ++index)
+	{
+		scanlog_Record(&log, samples[index]);
+	}
+
+	ASSERT(scanlog_GetSettled(&log, 0x0001) == 2, "Pin 0 settled at %i should be %i", scanlog_GetSettled(&log, 0x0001), 2);
+	ASSERT(scanlog_GetSettled(&log, 0x0002) == 3, "Pin 1 settled at %i should be %i", scanlog_GetSettled(&log, 0x0002), 3);
+	ASSERT(scanlog_GetSettled(&log, 0x0004) == 5, "Pin 2 settled at %i should be %i", scanlog_GetSettled(&log, 0x0004), 5);
+	ASSERT(scanlog_GetSettled(&log, 0x0008) == 0, "Pin 3 settled at %i should be %i", scanlog_GetSettled(&log, 0x0008), 0);
+
+	return true;
+}
+
+/**
+ * @brief Test a full log
+ *
+ * Changes that don't fit are refused, repeats of the last sample still fit.
+ */
+bool scanlog_TestFull()
+{
+	scanlog_Event events[2];
+	scanlog_Log log;
+
+	scanlog_Init(&log, events, 2);
+	ASSERT(scanlog_Record(&log, 0x0000), "First sample not recorded");
+	ASSERT(scanlog_Record(&log, 0x0001), "First change not recorded");
+	ASSERT(scanlog_Record(&log, 0x0000), "Second change not recorded");
+	ASSERT(!scanlog_Record(&log, 0x0001), "Change recorded in a full log");
+	ASSERT(scanlog_Record(&log, 0x0000), "Unchanged sample not recorded");
+	ASSERT(scanlog_GetSamples(&log) == 4, "Sample count incorrect: %i should be %i", scanlog_GetSamples(&log), 4);
+
+	return true;
+}
+
+/**
+ * @brief Test building a log from a stream of edges
+ *
+ * This is how the edge capture fills a log. Edges at the same sample are
+ * merged, a glitch that cancels itself out leaves no event and the log reads
+ * back the same as if every clock had been sampled.
+ */
+bool scanlog_TestEdges()
+{
+	static const uint16_t expected[] = { 0x0004, 0x0004, 0x0005, 0x0005, 0x0001, 0x0001, 0x0001, 0x0001 };
+	scanlog_Event events[TSCANLOG_EVENTS];
+	scanlog_Log log;
+	scanlog_Reader reader;
+	unsigned int index;
+
+	scanlog_Init(&log, events, TSCANLOG_EVENTS);
+	scanlog_Record(&log, 0x0004);
+	ASSERT(scanlog_AddEvent(&log, 2, 0x0001), "Rising edge not logged");
+	ASSERT(scanlog_AddEvent(&log, 3, 0x0002), "Glitch not logged");
+	ASSERT(scanlog_AddEvent(&log, 3, 0x0002), "Glitch end not logged");
+	ASSERT(scanlog_AddEvent(&log, 4, 0x0004), "Falling edge not logged");
+	ASSERT(!scanlog_AddEvent(&log, 1, 0x0001), "Out of order edge logged");
+	scanlog_SetSamples(&log, 8);
+
+	ASSERT(log.count == 2, "Event count incorrect: %i should be %i", log.count, 2);
+	ASSERT(scanlog_GetLast(&log) == 0x0001, "Last sample incorrect: %04X", scanlog_GetLast(&log));
+	ASSERT(scanlog_GetUnchanged(&log) == 3, "Unchanged count incorrect: %i should be %i", scanlog_GetUnchanged(&log), 3);
+	ASSERT(scanlog_GetSettled(&log, 0x0001) == 2, "Pin 0 settled at %i should be %i", scanlog_GetSettled(&log, 0x0001), 2);
+
+	scanlog_Begin(&reader, &log);
+	for(index = 0; index < sizeof(expected)/sizeof(uint16_t); ++index)
+	{
+		uint16_t value = scanlog_Next(&reader);
+		ASSERT(value == expected[index], "Sample %i incorrect: %04X should be %04X", index, value, expected[index]);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Test changes that span pin groups
+ *
+ * A change takes an event for each group of pins it covers and is only
+ * logged if all of them fit.
+ */
+bool scanlog_TestGroups()
+{
+	static const scanlog_Mask samples[] = { 0, 0, 0x0000000000100001ULL, 0x0000000000100001ULL, 0x0000008000100000ULL, 0x0000008000100000ULL };
+	scanlog_Event events[4];
+	scanlog_Log log;
+	scanlog_Reader reader;
+	unsigned int index;
+
+	ASSERT(sizeof(scanlog_Event) == 4, "Event takes %i bytes", (int)sizeof(scanlog_Event));
+
+	scanlog_Init(&log, events, 4);
+	for(index = 0; index < sizeof(samples)/sizeof(scanlog_Mask); ++index)
+	{
+		ASSERT(scanlog_Record(&log, samples[index]), "Sample %i not recorded", index);
+	}
+	ASSERT(log.count == 4, "Event count incorrect: %i should be %i", log.count, 4);
+	ASSERT(scanlog_GetSettled(&log, 0x0000000000100000ULL) == 2, "Pin 20 settled at %i should be %i", scanlog_GetSettled(&log, 0x0000000000100000ULL), 2);
+	ASSERT(scanlog_GetSettled(&log, 0x0000008000000001ULL) == 4, "Pins 0 and 39 settled at %i should be %i", scanlog_GetSettled(&log, 0x0000008000000001ULL), 4);
+
+	scanlog_Begin(&reader, &log);
+	for(index = 0; index < sizeof(samples)/sizeof(scanlog_Mask); ++index)
+	{
+		ASSERT(scanlog_Next(&reader) == samples[index], "Sample %i incorrect", index);
+	}
+
+	//the log is full, no part of a change over three groups is logged
+	ASSERT(!scanlog_Record(&log, 0x0000000000100101ULL), "Change recorded in a full log");
+	ASSERT(scanlog_GetLast(&log) == samples[5], "Part of a change recorded");
+
+	return true;
+}
@@ -0,0 +1,29 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_TSCANLOG_H_)
+#define _TSCANLOG_H_
+
+#include <stdbool.h>
+
+extern bool scanlog_TestRecord();
+extern bool scanlog_TestSettled();
+extern bool scanlog_TestFull();
+extern bool scanlog_TestEdges();
+extern bool scanlog_TestGroups();
+
+#endif
@@ -0,0 +1,346 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tserial.h"
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+
+//Mock out the DMA and the interrupt masking
+#define dma_get_number_of_data	serial_Mock_dma_get_number_of_data
+#define dma_set_memory_address	serial_Mock_dma_set_memory_address
+#define dma_set_number_of_data	serial_Mock_dma_set_number_of_data
+#define dma_enable_channel	serial_Mock_dma_enable_channel
+#define dma_disable_channel	serial_Mock_dma_disable_channel
+#define dma_clear_interrupt_flags	serial_Mock_dma_clear_interrupt_flags
+#define nvic_enable_irq		serial_Mock_nvic_enable_irq
+#define nvic_disable_irq	serial_Mock_nvic_disable_irq
+
+uint16_t serial_Mock_dma_get_number_of_data(uint32_t dma, uint8_t channel);
+void serial_Mock_dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address);
+void serial_Mock_dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number);
+void serial_Mock_dma_enable_channel(uint32_t dma, uint8_t channel);
+void serial_Mock_dma_disable_channel(uint32_t dma, uint8_t channel);
+void serial_Mock_dma_clear_interrupt_flags(uint32_t dma, uint8_t channel, uint32_t interrupts);
+void serial_Mock_nvic_enable_irq(uint8_t irqn);
+void serial_Mock_nvic_disable_irq(uint8_t irqn);
+
+#include "../source/serial.c"
+
+static uint32_t serial_DMAWritten;	///< Bytes the mocked DMA has written
+static int serial_Masked;		///< Receive interrupts currently masked
+static bool serial_ReadMasked;		///< The DMA position was read with the receive interrupts unmasked, outside an interrupt
+static bool serial_InInterrupt;		///< A mocked interrupt is running
+static unsigned int serial_TxStarted;		///< Offset into serial_TxBuffer of the last transmit started
+static unsigned int serial_TxSending;		///< Length of the last transmit started
+static unsigned int serial_TxStarts;		///< Number of transmits started
+
+/**
+ * @brief Start with an empty receive ring
+ */
+static void serial_TestStart()
+{
+	serial_RxTail = 0;
+	serial_RxRead = 0;
+	serial_RxWritten = 0;
+	serial_RxHead = 0;
+	serial_RxOverflow = false;
+	serial_DMAWritten = 0;
+	serial_Masked = 0;
+	serial_ReadMasked = true;
+	serial_InInterrupt = false;
+}
+
+/**
+ * @brief Have the mocked DMA receive bytes, numbered by their count
+ */
+static void serial_TestReceive(unsigned int len)
+{
+	while(len-- > 0)
+	{
+		serial_RxBuffer[serial_DMAWritten % SERIAL_RX_BUFFER] = (char)serial_DMAWritten;
+		++serial_DMAWritten;
+	}
+}
+
+/**
+ * @brief Run the receive interrupt
+ */
+static void serial_TestInterrupt()
+{
+	serial_InInterrupt = true;
+	serial_RxUpdate();
+	serial_InInterrupt = false;
+}
+
+/**
+ * @brief Test peeking and releasing between interrupts
+ *
+ * The reader sees bytes the interrupts haven't counted yet, releasing them
+ * mustn't look like the ring was lapped.
+ */
+bool serial_TestPeek()
+{
+	const char *data;
+	unsigned int count;
+
+	serial_TestStart();
+	serial_TestReceive(10);
+	count = serial_Peek(&data);
+	ASSERT(count == 10, "Peek returned %i bytes, should be 10", count);
+	ASSERT((data[0] == 0) && (data[9] == 9), "Peek data incorrect: %i..%i", data[0], data[9]);
+	serial_Release(count);
+
+	serial_TestReceive(5);
+	count = serial_Peek(&data);
+	ASSERT(count == 5, "Peek returned %i bytes, should be 5", count);
+	ASSERT(data[0] == 10, "Peek data incorrect: %i should be 10", data[0]);
+	ASSERT(!serial_Overflowed(), "Overflow reported between interrupts");
+	serial_Release(3);
+
+	serial_TestInterrupt();
+	count = serial_Peek(&data);
+	ASSERT(count == 2, "Peek returned %i bytes after the interrupt, should be 2", count);
+	ASSERT(data[0] == 13, "Peek data incorrect: %i should be 13", data[0]);
+	serial_Release(count);
+	count = serial_Peek(&data);
+	ASSERT(count == 0, "Peek returned %i bytes once all were read", count);
+	ASSERT(!serial_Overflowed(), "Overflow reported after the interrupt");
+	ASSERT(serial_ReadMasked, "DMA position read with the receive interrupts enabled");
+	ASSERT(serial_Masked == 0, "Receive interrupts left masked: %i", serial_Masked);
+
+	return true;
+}
+
+/**
+ * @brief Test reading across the end of the ring
+ *
+ * Only the part up to the end of the ring is returned, the rest comes on
+ * the next peek.
+ */
+bool serial_TestPeekWrap()
+{
+	const char *data;
+	unsigned int count;
+
+	serial_TestStart();
+	serial_TestReceive(SERIAL_RX_BUFFER - 6);
+	serial_TestInterrupt();
+	count = serial_Peek(&data);
+	serial_Release(count);
+
+	serial_TestReceive(10);
+	count = serial_Peek(&data);
+	ASSERT(count == 6, "Peek returned %i bytes up to the end, should be 6", count);
+	ASSERT(data == &serial_RxBuffer[SERIAL_RX_BUFFER - 6], "Peek data not at the tail");
+	serial_Release(count);
+	count = serial_Peek(&data);
+	ASSERT(count == 4, "Peek returned %i bytes after the wrap, should be 4", count);
+	ASSERT(data == serial_RxBuffer, "Peek data not at the start of the ring");
+	serial_Release(count);
+	ASSERT(!serial_Overflowed(), "Overflow reported reading across the wrap");
+
+	return true;
+}
+
+/**
+ * @brief Test the reader being lapped by the DMA
+ *
+ * The unread bytes are dropped and the overflow is reported once, a ring
+ * that is exactly full is still read.
+ */
+bool serial_TestOverflow()
+{
+	const char *data;
+	unsigned int count;
+	unsigned int index;
+
+	serial_TestStart();
+	for(index = 0; index < 3; ++index)
+	{
+		serial_TestReceive(SERIAL_RX_BUFFER / 2);
+		serial_TestInterrupt();
+	}
+	serial_TestReceive(4);
+	count = serial_Peek(&data);
+	ASSERT(serial_Overflowed(), "Overflow not reported");
+	ASSERT(!serial_Overflowed(), "Overflow not cleared");
+	ASSERT(count == 0, "Peek returned %i stale bytes", count);
+
+	serial_TestReceive(3);
+	count = serial_Peek(&data);
+	ASSERT(count == 3, "Peek returned %i bytes after the overflow, should be 3", count);
+	ASSERT(data[0] == (char)(3 * (SERIAL_RX_BUFFER / 2) + 4), "Peek data incorrect after the overflow");
+	serial_Release(count);
+	ASSERT(!serial_Overflowed(), "Overflow reported again");
+
+	//a ring that is exactly full hasn't lost anything
+	serial_TestStart();
+	serial_TestReceive(SERIAL_RX_BUFFER / 2);
+	serial_TestInterrupt();
+	serial_TestReceive(SERIAL_RX_BUFFER / 2);
+	serial_TestInterrupt();
+	count = serial_Peek(&data);
+	ASSERT(count == SERIAL_RX_BUFFER, "Peek returned %i bytes of a full ring, should be %i", count, SERIAL_RX_BUFFER);
+	ASSERT((data == serial_RxBuffer) && (data[SERIAL_RX_BUFFER - 1] == (char)(SERIAL_RX_BUFFER - 1)), "Peek data incorrect for a full ring");
+	ASSERT(!serial_Overflowed(), "Overflow reported for a full ring");
+	serial_Release(count);
+	count = serial_Peek(&data);
+	ASSERT(count == 0, "Peek returned %i bytes once the full ring was read", count);
+	serial_TestReceive(1);
+	count = serial_Peek(&data);
+	ASSERT((count == 1) && (data[0] == (char)SERIAL_RX_BUFFER), "Peek returned %i bytes after a full ring, should be 1", count);
+	ASSERT(!serial_Overflowed(), "Overflow reported after a full ring");
+
+	return true;
+}
+
+/**
+ * @brief Check a transmit was started
+ */
+static bool serial_TestSending(unsigned int starts, unsigned int offset, unsigned int len)
+{
+	ASSERT(serial_TxStarts == starts, "%i transmits started, should be %i", serial_TxStarts, starts);
+	ASSERT((serial_TxStarted == offset) && (serial_TxSending == len), "Sending %i bytes from %i, should be %i from %i",
+		serial_TxSending, serial_TxStarted, len, offset);
+	return true;
+}
+
+/**
+ * @brief Test reserving and committing space in the transmit ring
+ *
+ * A reservation that doesn't fit before the end of the ring starts at the
+ * beginning instead, the data before it is sent up to the wrap and then
+ * sending carries on from the start.
+ */
+bool serial_TestReserve()
+{
+	char *space;
+
+	serial_TxHead = 0;
+	serial_TxTail = 0;
+	serial_TxWrap = SERIAL_TX_BUFFER;
+	serial_TxLength = 0;
+	serial_TxWrapped = false;
+	serial_TxStarts = 0;
+	serial_Masked = 0;
+
+	ASSERT(serial_Space() == SERIAL_TX_BUFFER - 1, "Empty ring space %i", serial_Space());
+	space = serial_Reserve(600);
+	ASSERT(space == serial_TxBuffer, "First reservation not at the start");
+	serial_Commit(600);
+	ASSERT(serial_TestSending(1, 0, 600), "First transmit incorrect");
+
+	//queued behind the running transmit
+	ASSERT(serial_Space() == SERIAL_TX_BUFFER - 600 - 1, "Space %i with the start of the ring in use", serial_Space());
+	space = serial_Reserve(400);
+	ASSERT(space == &serial_TxBuffer[600], "Second reservation not after the first");
+	serial_Commit(400);
+	ASSERT(serial_TestSending(1, 0, 600), "Transmit restarted while running");
+
+	dma1_channel7_isr();
+	ASSERT(serial_TestSending(2, 600, 400), "Second transmit incorrect");
+
+	//doesn't fit before the end, wraps to the start
+	ASSERT(serial_Space() == SERIAL_TX_BUFFER - 1000, "Space %i before the end", serial_Space());
+	space = serial_Reserve(100);
+	ASSERT(space == serial_TxBuffer, "Reservation not wrapped");
+	serial_Abort();
+	space = serial_Reserve(SERIAL_TX_BUFFER - 1000);
+	ASSERT(space == &serial_TxBuffer[1000], "Aborted wrap not dropped");
+	serial_Commit(0);
+	space = serial_Reserve(100);
+	ASSERT(space == serial_TxBuffer, "Reservation not wrapped again");
+	serial_Commit(60);
+	ASSERT((serial_TxWrap == 1000) && (serial_TxHead == 60), "Wrap at %i head %i", serial_TxWrap, serial_TxHead);
+	ASSERT(serial_Space() == 600 - 60 - 1, "Space %i after the wrap", serial_Space());
+
+	dma1_channel7_isr();
+	ASSERT(serial_TestSending(3, 0, 60), "Transmit after the wrap incorrect");
+	dma1_channel7_isr();
+	ASSERT(serial_TxLength == 0, "Transmit running with nothing to send");
+	ASSERT(serial_Space() == SERIAL_TX_BUFFER - 60, "Space %i once all sent", serial_Space());
+	ASSERT(serial_Masked == 0, "Transmit interrupt left masked: %i", serial_Masked);
+
+	return true;
+}
+
+/**
+ * @brief Mock dma_get_number_of_data, the receive DMA counts down
+ */
+uint16_t serial_Mock_dma_get_number_of_data(uint32_t dma, uint8_t channel)
+{
+	if(!serial_InInterrupt && (serial_Masked != 2))
+	{
+		serial_ReadMasked = false;
+	}
+	return SERIAL_RX_BUFFER - (serial_DMAWritten % SERIAL_RX_BUFFER);
+}
+
+/**
+ * @brief Mock dma_set_memory_address, records where the transmit starts
+ */
+void serial_Mock_dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address)
+{
+	serial_TxStarted = address - (uint32_t)serial_TxBuffer;
+}
+
+/**
+ * @brief Mock dma_set_number_of_data, records the transmit length
+ */
+void serial_Mock_dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number)
+{
+	serial_TxSending = number;
+}
+
+/**
+ * @brief Mock dma_enable_channel, counts the transmits started
+ */
+void serial_Mock_dma_enable_channel(uint32_t dma, uint8_t channel)
+{
+	serial_TxStarts++;
+}
+
+/**
+ * @brief Mock dma_disable_channel
+ */
+void serial_Mock_dma_disable_channel(uint32_t dma, uint8_t channel)
+{
+}
+
+/**
+ * @brief Mock dma_clear_interrupt_flags
+ */
+void serial_Mock_dma_clear_interrupt_flags(uint32_t dma, uint8_t channel, uint32_t interrupts)
+{
+}
+
+/**
+ * @brief Mock nvic_enable_irq
+ */
+void serial_Mock_nvic_enable_irq(uint8_t irqn)
+{
+	--serial_Masked;
+}
+
+/**
+ * @brief Mock nvic_disable_irq
+ */
+void serial_Mock_nvic_disable_irq(uint8_t irqn)
+{
+	++serial_Masked;
+}
@@ -0,0 +1,191 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tswd.h"
+#include <string.h>
+
+//Mock out the pins, SWDIO is recorded one clock at a time
+#define jtag_Set		swd_Mock_jtag_Set
+#define jtag_Get		swd_Mock_jtag_Get
+#define jtag_Clock		swd_Mock_jtag_Clock
+#define jtag_SetDirection	swd_Mock_jtag_SetDirection
+
+#include "../source/jtag.h"
+#include "../source/swd.c"
+
+#define TSWD_CLOCKS	(200)	///< Most clocks recorded
+
+static char swd_Clocked[TSWD_CLOCKS + 1];	///< SWDIO at each clock, '1', '0' or '-' when the target drives it
+static unsigned int swd_Clocks;			///< Number of clocks given
+static bool swd_Output;				///< SWDIO is driven by the host
+static bool swd_SWDIO;				///< Level the host drives SWDIO to
+static const char *swd_Response;		///< Bits the target drives, one per clock it has SWDIO
+static unsigned int swd_ResponseClocks;		///< Number of clocks the target has had SWDIO
+
+/**
+ * @brief Start recording a new sequence
+ *
+ * @param[in] response What the target drives SWDIO to, from the first
+ * turnaround clock.
+ */
+static void swd_TestStart(const char *response)
+{
+	memset(swd_Clocked, 0, sizeof(swd_Clocked));
+	swd_Clocks = 0;
+	swd_Output = true;
+	swd_SWDIO = false;
+	swd_Response = response;
+	swd_ResponseClocks = 0;
+}
+
+/**
+ * @brief Add bits to an expected sequence, LSB first
+ */
+static void swd_TestExpect(char *expected, uint32_t data, unsigned int bits)
+{
+	expected += strlen(expected);
+	while(bits-- > 0)
+	{
+		*expected++ = ((data & 0x01) != 0) ? '1' : '0';
+		data >>= 1;
+	}
+	*expected = '\0';
+}
+
+/**
+ * @brief Test the switch from JTAG to SWD
+ *
+ * A line reset of at least 50 high clocks, the 0xE79E sequence, a second
+ * line reset and idle clocks.
+ */
+bool swd_TestSwitchFromJTAG()
+{
+	char expected[TSWD_CLOCKS + 1] = "";
+
+	swd_TestExpect(expected, 0xFFFFFFFF, 32);
+	swd_TestExpect(expected, 0xFFFFFFFF, SWD_RESET_CLOCKS - 32);
+	swd_TestExpect(expected, 0xE79E, 16);
+	swd_TestExpect(expected, 0xFFFFFFFF, 32);
+	swd_TestExpect(expected, 0xFFFFFFFF, SWD_RESET_CLOCKS - 32);
+	swd_TestExpect(expected, 0, 2);
+
+	swd_TestStart("");
+	swd_SwitchFromJTAG();
+	ASSERT(SWD_RESET_CLOCKS >= 50, "Line reset too short: %i clocks", SWD_RESET_CLOCKS);
+	ASSERT(strcmp(swd_Clocked, expected) == 0, "Sequence incorrect:\r\n%s\r\nshould be\r\n%s", swd_Clocked, expected);
+	ASSERT(swd_Output, "SWDIO left as an input");
+
+	return true;
+}
+
+/**
+ * @brief Test reading the DP IDR
+ *
+ * The request is clocked out, then the target has SWDIO for the turnaround,
+ * the ACK, the data and parity and the turnaround back, followed by idle
+ * clocks. A WAIT doesn't have a data phase and bad parity is reported.
+ */
+bool swd_TestReadDPIDR()
+{
+	char expected[TSWD_CLOCKS + 1] = "";
+	uint32_t dpidr = 0;
+	unsigned int ack;
+
+	//turnaround, ACK OK (LSB first), 0x2BA01477 LSB first, even parity, turnaround
+	const char *ok = "-100" "11101110" "00101000" "00000101" "11010100" "0" "-";
+	const char *badParity = "-100" "11101110" "00101000" "00000101" "11010100" "1" "-";
+	const char *wait = "-010" "-";
+
+	swd_TestExpect(expected, SWD_REQUEST_DPIDR, 8);
+	strcat(expected, "--------------------------------------");
+	swd_TestExpect(expected, 0, 2);
+
+	swd_TestStart(ok);
+	ack = swd_ReadDPIDR(&dpidr);
+	ASSERT(ack == SWD_ACK_OK, "ACK incorrect: %i should be %i", ack, SWD_ACK_OK);
+	ASSERT(dpidr == 0x2BA01477, "DP IDR incorrect: %08X", dpidr);
+	ASSERT(strcmp(swd_Clocked, expected) == 0, "Sequence incorrect:\r\n%s\r\nshould be\r\n%s", swd_Clocked, expected);
+	ASSERT(swd_Output, "SWDIO left as an input");
+
+	swd_TestStart(badParity);
+	ack = swd_ReadDPIDR(&dpidr);
+	ASSERT(ack == SWD_ACK_PARITY, "Parity error not seen: %i", ack);
+
+	expected[0] = '\0';
+	swd_TestExpect(expected, SWD_REQUEST_DPIDR, 8);
+	strcat(expected, "-----");
+	swd_TestExpect(expected, 0, 2);
+
+	swd_TestStart(wait);
+	ack = swd_ReadDPIDR(&dpidr);
+	ASSERT(ack == SWD_ACK_WAIT, "ACK incorrect: %i should be %i", ack, SWD_ACK_WAIT);
+	ASSERT(strcmp(swd_Clocked, expected) == 0, "Sequence incorrect:\r\n%s\r\nshould be\r\n%s", swd_Clocked, expected);
+
+	return true;
+}
+
+/**
+ * @brief Mock jtag_Set, only SWDIO (TMS) is expected
+ */
+void swd_Mock_jtag_Set(jtag_Signal sig, bool val)
+{
+	if(sig == JTAG_SIGNAL_TMS)
+	{
+		swd_SWDIO = val;
+	}
+}
+
+/**
+ * @brief Mock jtag_Get, SWDIO reads what the target drives this clock
+ */
+bool swd_Mock_jtag_Get(jtag_Signal sig)
+{
+	bool state = false;
+
+	if(!swd_Output && (swd_ResponseClocks < strlen(swd_Response)))
+	{
+		state = (swd_Response[swd_ResponseClocks] == '1');
+	}
+	return state;
+}
+
+/**
+ * @brief Mock jtag_Clock, records SWDIO
+ */
+void swd_Mock_jtag_Clock()
+{
+	if(swd_Clocks < TSWD_CLOCKS)
+	{
+		swd_Clocked[swd_Clocks++] = swd_Output ? (swd_SWDIO ? '1' : '0') : '-';
+	}
+	if(!swd_Output)
+	{
+		++swd_ResponseClocks;
+	}
+}
+
+/**
+ * @brief Mock jtag_SetDirection, only SWDIO (TMS) is expected
+ */
+void swd_Mock_jtag_SetDirection(jtag_Signal sig, bool output)
+{
+	if(sig == JTAG_SIGNAL_TMS)
+	{
+		swd_Output = output;
+	}
+}
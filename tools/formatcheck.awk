@@ -0,0 +1,67 @@
+#
+#  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+#  Copyright (C) 2014 Nathan Dyer
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Check every message_Write() format only uses the conversions
+# message_Format() supports: %i, %d, %u, %x, %X, %s, %c and %%, with an
+# optional '0' flag and field width.
+#
+# A call is collected up to the line ending its statement, so formats on
+# a later line or split into several literals are checked whole. Each bad
+# call is listed with the line it starts on and the exit status is 1.
+#
+# Usage: awk -f tools/formatcheck.awk source/*.c
+
+function check(call, line,	format, rest, literal)
+{
+	format = ""
+	rest = call
+	sub(/^.*message_Write\([^,]*,[ \t]*/, "", rest)
+	while(match(rest, /^"([^"\\]|\\.)*"[ \t]*/))
+	{
+		literal = substr(rest, RSTART, RLENGTH)
+		sub(/"[ \t]*$/, "", literal)
+		format = format substr(literal, 2)
+		rest = substr(rest, RLENGTH + 1)
+	}
+	gsub(/%0?[0-9]*[iduxXsc%]/, "", format)
+	if(index(format, "%") != 0)
+	{
+		print FILENAME ":" line ": " call
+		bad = 1
+	}
+}
+
+!collecting && /message_Write\(/ && !/^[ \t]*(\*|\/\/|\/\*)/ {
+	collecting = 1
+	call = ""
+	start = FNR
+}
+
+collecting {
+	line = $0
+	sub(/^[ \t]+/, "", line)
+	call = call line
+	if(line ~ /;[ \t]*$/)
+	{
+		check(call, start)
+		collecting = 0
+	}
+}
+
+END {
+	exit bad
+}
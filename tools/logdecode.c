@@ -0,0 +1,269 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file
+ * @brief Host side decoder for binary message records
+ *
+ * Reads the serial output of a JTAG Knocker in `message format binary` on
+ * stdin and writes it as text on stdout. Each record's format string is
+ * read from the firmware image at its address, then formatted with the
+ * record's arguments. Text outside records is passed straight through.
+ *
+ * Usage: logdecode jtagknocker.bin [base] < capture
+ *
+ * base is the flash address the image was loaded at, 0x08000000 by default.
+ * It has to be the image built from the same source as the running firmware.
+ */
+#include "../source/message.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGDECODE_BASE	0x08000000	///< Default flash address of the image
+#define LOGDECODE_SPEC_MAX	16	///< Longest conversion specification copied for printf
+
+static unsigned char *logdecode_Image;	///< The firmware image
+static long logdecode_ImageSize;	///< Size of the firmware image in bytes
+static uint32_t logdecode_Base;		///< Flash address of the start of the image
+static bool logdecode_LineStart = true;	///< The next output starts a line
+static uint32_t logdecode_Time;		///< Time of the last record, in milliseconds
+
+/**
+ * @brief Read a 32 bit little endian value
+ */
+static uint32_t logdecode_Get32(const unsigned char *buffer)
+{
+	return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+/**
+ * @brief Load the firmware image
+ *
+ * @retval true The image was read.
+ */
+static bool logdecode_Load(const char *path)
+{
+	FILE *file;
+	bool success = false;
+
+	file = fopen(path, "rb");
+	if(file != NULL)
+	{
+		fseek(file, 0, SEEK_END);
+		logdecode_ImageSize = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		logdecode_Image = malloc(logdecode_ImageSize + 1);
+		if((logdecode_Image != NULL) && (fread(logdecode_Image, 1, logdecode_ImageSize, file) == (size_t)logdecode_ImageSize))
+		{
+			//make sure the last string is terminated
+			logdecode_Image[logdecode_ImageSize] = '\0';
+			success = true;
+		}
+		fclose(file);
+	}
+	return success;
+}
+
+/**
+ * @brief Output decoded text
+ *
+ * Each line is prefixed with the time of the last record seen when it
+ * started.
+ */
+static void logdecode_Output(const char *text)
+{
+	for(; *text != '\0'; ++text)
+	{
+		if(logdecode_LineStart)
+		{
+			printf("[%6u.%03u] ", (unsigned int)(logdecode_Time / 1000), (unsigned int)(logdecode_Time % 1000));
+			logdecode_LineStart = false;
+		}
+		putchar(*text);
+		if(*text == '\n')
+		{
+			logdecode_LineStart = true;
+		}
+	}
+}
+
+/**
+ * @brief Decode and output a record
+ *
+ * @param record The record after its length byte
+ * @param length The number of bytes in the record after its length byte
+ * @retval true The record matched its format string.
+ */
+static bool logdecode_Record(const unsigned char *record, unsigned int length)
+{
+	char output[1024];
+	char spec[LOGDECODE_SPEC_MAX];
+	const unsigned char *args;
+	const unsigned char *end;
+	const char *fmt;
+	const char *start;
+	uint32_t address;
+	unsigned int count;
+	unsigned int size;
+	bool success;
+
+	if(length < MESSAGE_RECORD_HEADER - 2)
+	{
+		return false;
+	}
+	address = logdecode_Get32(&record[0]);
+	args = &record[MESSAGE_RECORD_HEADER - 2];
+	end = &record[length];
+	if((address < logdecode_Base) || (address - logdecode_Base >= (uint32_t)logdecode_ImageSize))
+	{
+		return false;
+	}
+	fmt = (const char *)&logdecode_Image[address - logdecode_Base];
+
+	//format a conversion at a time with the host printf
+	count = 0;
+	success = true;
+	while(success && (*fmt != '\0') && (count < sizeof(output) - 1))
+	{
+		if(*fmt != '%')
+		{
+			output[count++] = *fmt++;
+			continue;
+		}
+		start = fmt++;
+		while((*fmt >= '0') && (*fmt <= '9'))
+		{
+			fmt++;
+		}
+		size = fmt - start + 1;
+		success = (*fmt != '\0') && (size < sizeof(spec));
+		if(!success)
+		{
+			break;
+		}
+		memcpy(spec, start, size);
+		spec[size] = '\0';
+
+		switch(*fmt)
+		{
+			case 'i':
+			case 'd':
+				success = (end - args >= 4);
+				if(success)
+				{
+					count += snprintf(&output[count], sizeof(output) - count, spec, (int32_t)logdecode_Get32(args));
+					args += 4;
+				}
+				break;
+
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'c':
+				success = (end - args >= 4);
+				if(success)
+				{
+					count += snprintf(&output[count], sizeof(output) - count, spec, (unsigned int)logdecode_Get32(args));
+					args += 4;
+				}
+				break;
+
+			case 's':
+				success = (memchr(args, '\0', end - args) != NULL);
+				if(success)
+				{
+					count += snprintf(&output[count], sizeof(output) - count, spec, (const char *)args);
+					args += strlen((const char *)args) + 1;
+				}
+				break;
+
+			case '%':
+				output[count++] = '%';
+				break;
+
+			default:
+				success = false;
+				break;
+		}
+		if(count >= sizeof(output))
+		{
+			count = sizeof(output) - 1;
+		}
+		fmt++;
+	}
+	output[count] = '\0';
+
+	//every argument has to be used, otherwise the image doesn't match
+	success = success && (args == end);
+	if(success)
+	{
+		logdecode_Time = logdecode_Get32(&record[4]);
+		logdecode_Output(output);
+	}
+	return success;
+}
+
+/**
+ * @brief Decode a capture from stdin
+ */
+int main(int argc, char *argv[])
+{
+	unsigned char record[256];
+	int data;
+	int length;
+	char text[2] = {0, 0};
+
+	if((argc < 2) || (argc > 3))
+	{
+		fprintf(stderr, "Usage: %s image.bin [base] < capture\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	logdecode_Base = (argc == 3) ? strtoul(argv[2], NULL, 0) : LOGDECODE_BASE;
+	if(!logdecode_Load(argv[1]))
+	{
+		fprintf(stderr, "Unable to read %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	while((data = getchar()) != EOF)
+	{
+		if(data != MESSAGE_RECORD_START)
+		{
+			//plain text, such as echoed commands
+			text[0] = data;
+			logdecode_Output(text);
+			continue;
+		}
+
+		length = getchar();
+		if((length == EOF) || (fread(record, 1, length, stdin) != (size_t)length))
+		{
+			fprintf(stderr, "Truncated record\n");
+			break;
+		}
+		if(!logdecode_Record(record, length))
+		{
+			fprintf(stderr, "Undecodable record, is the image up to date?\n");
+		}
+	}
+
+	free(logdecode_Image);
+	return EXIT_SUCCESS;
+}